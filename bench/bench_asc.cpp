@@ -0,0 +1,32 @@
+#include "asc_file.hpp"
+#include "bench_common.hpp"
+#include <fmt/format.h>
+#include <catch2/benchmark/catch_benchmark.hpp>
+#include <catch2/catch_test_macros.hpp>
+#include <filesystem>
+
+TEST_CASE( "bench_asc_file", "[benchmark][asc]" )
+{
+    using namespace Flowy;
+    namespace fs = std::filesystem;
+
+    for( int n_cells : { 100, 1000 } )
+    {
+        auto path     = Bench::write_temporary_raster( n_cells, n_cells, 10.0, "flowy_bench_load.asc" );
+        auto path_out = fs::temp_directory_path() / "flowy_bench_save.asc";
+
+        BENCHMARK( fmt::format( "AscFile load ({0}x{0})", n_cells ) )
+        {
+            return AscFile( path );
+        };
+
+        auto asc_file = AscFile( path );
+        BENCHMARK( fmt::format( "AscFile save ({0}x{0})", n_cells ) )
+        {
+            asc_file.save( path_out );
+        };
+
+        fs::remove( path );
+        fs::remove( path_out );
+    }
+}
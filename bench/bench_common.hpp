@@ -0,0 +1,61 @@
+#pragma once
+#include "asc_file.hpp"
+#include "definitions.hpp"
+#include "lobe.hpp"
+#include "math.hpp"
+#include "topography.hpp"
+#include "xtensor/xbuilder.hpp"
+#include <cmath>
+#include <filesystem>
+
+namespace Flowy::Bench
+{
+
+// A smooth, hilly raster with n_x * n_y cells, which is used as input for the benchmarks
+inline AscFile make_raster( int n_x, int n_y, double cell_size )
+{
+    AscFile asc_file{};
+    asc_file.cell_size         = cell_size;
+    asc_file.lower_left_corner = { 0, 0 };
+    asc_file.x_data            = xt::arange<double>( 0, n_x * cell_size, cell_size );
+    asc_file.y_data            = xt::arange<double>( 0, n_y * cell_size, cell_size );
+    asc_file.height_data       = xt::zeros<double>( { std::size_t( n_x ), std::size_t( n_y ) } );
+
+    for( int i = 0; i < n_x; i++ )
+    {
+        for( int j = 0; j < n_y; j++ )
+        {
+            const double x               = i * cell_size;
+            const double y               = j * cell_size;
+            asc_file.height_data( i, j ) = 1000.0 - 0.1 * y + 20.0 * std::sin( 0.01 * x ) * std::cos( 0.013 * y );
+        }
+    }
+    return asc_file;
+}
+
+inline Topography make_topography( int n_cells, double cell_size )
+{
+    return Topography( make_raster( n_cells, n_cells, cell_size ) );
+}
+
+// An elliptic lobe in the center of a square domain with side length `domain_size`
+inline Lobe make_lobe( double domain_size, double semi_major_axis, double angle = 0.3 )
+{
+    Lobe lobe{};
+    lobe.center    = { 0.5 * domain_size + 0.123, 0.5 * domain_size + 0.456 };
+    lobe.semi_axes = { semi_major_axis, 0.5 * semi_major_axis };
+    lobe.thickness = 1.0;
+    lobe.set_azimuthal_angle( angle );
+    return lobe;
+}
+
+// Writes a generated raster to a temporary asc file and returns its path
+inline std::filesystem::path write_temporary_raster( int n_x, int n_y, double cell_size, const std::string & name )
+{
+    auto path     = std::filesystem::temp_directory_path() / name;
+    auto asc_file = make_raster( n_x, n_y, cell_size );
+    asc_file.save( path );
+    return path;
+}
+
+} // namespace Flowy::Bench
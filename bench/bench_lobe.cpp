@@ -0,0 +1,42 @@
+#include "bench_common.hpp"
+#include "definitions.hpp"
+#include "lobe.hpp"
+#include <catch2/benchmark/catch_benchmark.hpp>
+#include <catch2/catch_test_macros.hpp>
+#include <vector>
+
+TEST_CASE( "bench_lobe", "[benchmark][lobe]" )
+{
+    using namespace Flowy;
+
+    const Lobe lobe = Bench::make_lobe( 100.0, 10.0 );
+
+    // Points and horizontal lines scattered over the bounding box of the lobe
+    std::vector<Vector2> points{};
+    for( int i = 0; i < 64; i++ )
+    {
+        points.push_back( { 40.0 + 0.31 * i, 40.0 + 0.29 * ( 63 - i ) } );
+    }
+
+    BENCHMARK( "Lobe::is_point_in_lobe (64 points)" )
+    {
+        int n_inside = 0;
+        for( const auto & p : points )
+        {
+            n_inside += lobe.is_point_in_lobe( p );
+        }
+        return n_inside;
+    };
+
+    BENCHMARK( "Lobe::line_segment_intersects (64 lines)" )
+    {
+        int n_intersecting = 0;
+        for( const auto & p : points )
+        {
+            const Vector2 x1 = { 30.0, p[1] };
+            const Vector2 x2 = { 70.0, p[1] };
+            n_intersecting += lobe.line_segment_intersects( x1, x2 ).has_value();
+        }
+        return n_intersecting;
+    };
+}
@@ -0,0 +1,103 @@
+#include "config.hpp"
+#include "run_report.hpp"
+#include "simulation.hpp"
+#include "synthetic_terrain.hpp"
+#include <fmt/format.h>
+#include <catch2/catch_test_macros.hpp>
+#include <cmath>
+#include <filesystem>
+#include <string>
+
+// Scaling study of the phases of Simulation::run() on synthetic terrain
+// This runs complete simulations and takes a while, therefore it is hidden and has to be selected explicitly:
+//      build/flowy_bench "[scaling]"
+// The results are printed as csv lines (sweep, value, n_cells, n_lobes, stage, wall_seconds, cpu_seconds)
+
+namespace
+{
+
+using namespace Flowy;
+
+Config::InputParams scaling_input( double domain_size, double cell_size, int n_lobes )
+{
+    namespace fs = std::filesystem;
+
+    auto synthetic              = SyntheticTerrainParams{};
+    synthetic.kind              = TerrainKind::Fractal;
+    synthetic.cell_size         = cell_size;
+    synthetic.n_x               = std::size_t( std::round( domain_size / cell_size ) );
+    synthetic.n_y               = synthetic.n_x;
+    synthetic.slope             = { 0.0, -0.01 };
+    synthetic.fractal_amplitude = 20.0;
+    synthetic.seed              = 1;
+
+    auto input                 = Config::InputParams();
+    input.synthetic_terrain    = synthetic;
+    input.run_name             = "scaling";
+    input.output_folder        = fs::temp_directory_path() / "flowy_bench_scaling";
+    input.rng_seed             = 1;
+    input.vent_coordinates     = { { 0.5 * domain_size, 0.5 * domain_size } };
+    input.n_flows              = 4;
+    input.min_n_lobes          = n_lobes;
+    input.max_n_lobes          = n_lobes;
+    input.fixed_dimension_flag = 1;
+    input.prescribed_lobe_area = 2000;
+    input.total_volume         = 2000 * 0.5 * n_lobes * input.n_flows;
+    input.thickness_ratio      = 0.038;
+    input.masking_threshold    = { 0.97 };
+    input.save_hazard_data     = true;
+    input.lobe_exponent        = 0.01;
+    input.max_slope_prob       = 0.995;
+    input.inertial_exponent    = 0.125;
+    input.n_init               = 1;
+    input.max_aspect_ratio     = 2.5;
+    input.aspect_ratio_coeff   = 2.0;
+    return input;
+}
+
+void run_and_print( const std::string & sweep, double value, const Config::InputParams & input )
+{
+    auto simulation = Simulation( input, input.rng_seed );
+    simulation.run();
+
+    const auto & synthetic = input.synthetic_terrain.value();
+    for( const auto & stage : simulation.report.stages )
+    {
+        fmt::print(
+            "scaling,{},{},{},{},{},{},{}\n", sweep, value, synthetic.n_x * synthetic.n_y, input.max_n_lobes,
+            stage.name, stage.wall_seconds, stage.cpu_seconds );
+    }
+    std::filesystem::remove_all( input.output_folder );
+}
+
+} // namespace
+
+TEST_CASE( "bench_scaling", "[.][scaling]" )
+{
+    // DEM size at a fixed cell size
+    for( double domain_size : { 5000.0, 10000.0, 20000.0, 40000.0 } )
+    {
+        run_and_print( "domain_size", domain_size, scaling_input( domain_size, 10.0, 1000 ) );
+    }
+
+    // Cell size relative to the lobe size (lobe_area = 2000 m^2, i.e. a radius of about 25 m)
+    for( double cell_size : { 2.5, 5.0, 10.0, 20.0, 40.0 } )
+    {
+        run_and_print( "cell_size", cell_size, scaling_input( 5000.0, cell_size, 1000 ) );
+    }
+
+    // Number of lobes per flow
+    for( int n_lobes : { 100, 1000, 10000 } )
+    {
+        run_and_print( "n_lobes", n_lobes, scaling_input( 10000.0, 10.0, n_lobes ) );
+    }
+
+    // A window of a 50000 x 50000 cell DEM, only the cropped part is generated
+    auto input             = scaling_input( 500000.0, 10.0, 1000 );
+    input.vent_coordinates = { { 250000.0, 250000.0 } };
+    input.east_to_vent     = 5000.0;
+    input.west_to_vent     = 5000.0;
+    input.south_to_vent    = 5000.0;
+    input.north_to_vent    = 5000.0;
+    run_and_print( "cropped_50k", 50000, input );
+}
@@ -0,0 +1,84 @@
+#include "bench_common.hpp"
+#include "config.hpp"
+#include "lobe.hpp"
+#include "simulation.hpp"
+#include <fmt/format.h>
+#include <catch2/benchmark/catch_benchmark.hpp>
+#include <catch2/catch_test_macros.hpp>
+#include <filesystem>
+
+TEST_CASE( "bench_simulation", "[benchmark][simulation]" )
+{
+    using namespace Flowy;
+    namespace fs = std::filesystem;
+
+    auto input                          = Config::InputParams();
+    input.source                        = Bench::write_temporary_raster( 64, 64, 10.0, "flowy_bench_simulation.asc" );
+    input.output_folder                 = fs::temp_directory_path() / "flowy_bench_output";
+    input.total_volume                  = 1.0;
+    input.prescribed_avg_lobe_thickness = 1.0;
+
+    for( double lobe_exponent : { 0.0, 0.015, 1.0 } )
+    {
+        input.lobe_exponent = lobe_exponent;
+        auto simulation     = Simulation( input, 0 );
+
+        const int n_lobes = 10000;
+        simulation.lobes.resize( n_lobes );
+
+        Lobe lobe{};
+        BENCHMARK( fmt::format( "Simulation::select_parent_lobe (lobe_exponent = {})", lobe_exponent ) )
+        {
+            return simulation.select_parent_lobe( n_lobes - 1, lobe );
+        };
+    }
+
+    // Angle perturbation with a narrow and a very wide truncated normal distribution
+    for( double max_slope_prob : { 0.9, 0.001 } )
+    {
+        input.lobe_exponent  = 0.0;
+        input.max_slope_prob = max_slope_prob;
+        auto simulation      = Simulation( input, 0 );
+
+        Lobe lobe{};
+        const Vector2 slope = { 0.3, 0.1 };
+        BENCHMARK( fmt::format( "Simulation::perturb_lobe_angle (max_slope_prob = {})", max_slope_prob ) )
+        {
+            simulation.perturb_lobe_angle( lobe, slope );
+            return lobe.get_azimuthal_angle();
+        };
+    }
+    input.max_slope_prob = 0.0;
+
+    // Parent selection by distance to the vent, on a flow with a million lobes
+    input.lobe_exponent        = 0.015;
+    input.start_from_dist_flag = 1;
+    input.force_max_length     = 1;
+    input.max_length           = 1000;
+    auto simulation            = Simulation( input, 0 );
+
+    const int n_lobes = 1000000;
+    simulation.lobes.resize( n_lobes );
+    simulation.parent_sampler.reset( n_lobes );
+    for( int idx_lobe = 0; idx_lobe < n_lobes; idx_lobe++ )
+    {
+        simulation.lobes.dist_n_lobes[idx_lobe] = idx_lobe % 2000;
+        simulation.lobes.idx_parent[idx_lobe]   = idx_lobe / 2 - 1;
+        simulation.add_parent_candidate( idx_lobe );
+    }
+
+    Lobe lobe{};
+    BENCHMARK( "Simulation::select_parent_lobe (start_from_dist_flag, force_max_length, 10^6 lobes)" )
+    {
+        return simulation.select_parent_lobe( n_lobes - 1, lobe );
+    };
+
+    // The reverse sweep over the parent indices of a flow with a million lobes
+    BENCHMARK( "LobeStore::compute_cumulative_descendents (10^6 lobes)" )
+    {
+        simulation.lobes.compute_cumulative_descendents();
+        return simulation.lobes.n_descendents[0];
+    };
+
+    fs::remove( input.source );
+}
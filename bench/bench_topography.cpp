@@ -0,0 +1,170 @@
+#include "bench_common.hpp"
+#include "definitions.hpp"
+#include "lobe.hpp"
+#include "thread_pool.hpp"
+#include "topography.hpp"
+#include <fmt/format.h>
+#include <catch2/benchmark/catch_benchmark.hpp>
+#include <catch2/catch_test_macros.hpp>
+#include <algorithm>
+#include <cmath>
+#include <thread>
+#include <vector>
+
+TEST_CASE( "bench_topography", "[benchmark][topography]" )
+{
+    using namespace Flowy;
+
+    const int n_cells      = 512;
+    const double cell_size = 1.0;
+    const double size      = n_cells * cell_size;
+
+    auto topography = Bench::make_topography( n_cells, cell_size );
+
+    // The cost of the rasterization depends on how many cells a lobe covers
+    // Therefore, we benchmark several ratios of the semi major axis to the cell size
+    for( double ratio : { 2.0, 8.0, 32.0, 128.0 } )
+    {
+        const Lobe lobe = Bench::make_lobe( size, ratio * cell_size );
+
+        BENCHMARK( fmt::format( "Topography::get_cells_intersecting_lobe (a/cell_size = {})", ratio ) )
+        {
+            return topography.get_cells_intersecting_lobe( lobe );
+        };
+
+        BENCHMARK( fmt::format( "Topography::compute_intersection (a/cell_size = {})", ratio ) )
+        {
+            return topography.compute_intersection( lobe );
+        };
+
+        BENCHMARK( fmt::format( "Topography::add_lobe (a/cell_size = {})", ratio ) )
+        {
+            topography.add_lobe( lobe );
+        };
+
+        // Without feedback on the slopes, only the rows of enclosed cells are recorded in a difference array
+        topography.set_thickness_accumulation( true );
+        BENCHMARK( fmt::format( "Topography::add_lobe (accumulated, a/cell_size = {})", ratio ) )
+        {
+            topography.add_lobe( lobe );
+        };
+        topography.set_thickness_accumulation( false );
+    }
+
+    BENCHMARK( fmt::format( "Topography::apply_accumulated_thickness ({0}x{0} cells)", n_cells ) )
+    {
+        topography.set_thickness_accumulation( true );
+        topography.add_lobe( Bench::make_lobe( size, 8.0 * cell_size ) );
+        topography.apply_accumulated_thickness();
+    };
+    topography.set_thickness_accumulation( false );
+
+    std::vector<Vector2> points{};
+    for( int i = 0; i < 256; i++ )
+    {
+        points.push_back( { 10.0 + 1.93 * i, size - 10.0 - 1.87 * i } );
+    }
+
+    BENCHMARK( "Topography::height_and_slope (256 points)" )
+    {
+        double sum = 0;
+        for( const auto & p : points )
+        {
+            sum += topography.height_and_slope( p ).first;
+        }
+        return sum;
+    };
+
+    const Lobe lobe = Bench::make_lobe( size, 20.0 * cell_size );
+    BENCHMARK( "Topography::find_preliminary_budding_point (npoints = 30)" )
+    {
+        return topography.find_preliminary_budding_point( lobe, 30 );
+    };
+
+    // A flow of lobes, each of which queries the height at its center before it is added, with the lobes added
+    // immediately and deferred
+    std::vector<Lobe> flow{};
+    for( int i = 0; i < 200; i++ )
+    {
+        Lobe lobe_flow   = Bench::make_lobe( size, 8.0 * cell_size );
+        lobe_flow.center = { 0.5 * size + 40.0 * std::sin( 0.1 * i ), 0.2 * size + 1.5 * i };
+        flow.push_back( lobe_flow );
+    }
+
+    for( bool deferred : { false, true } )
+    {
+        topography.set_deferred_lobe_application( deferred );
+        BENCHMARK( fmt::format( "Topography::add_lobe (flow of 200 lobes, deferred = {})", deferred ) )
+        {
+            double sum = 0;
+            for( const auto & lobe_flow : flow )
+            {
+                sum += topography.height_and_slope( lobe_flow.center ).first;
+                topography.add_lobe( lobe_flow );
+            }
+            topography.flush_pending_lobes();
+            return sum;
+        };
+    }
+    topography.set_deferred_lobe_application( false );
+
+    // The same flow with the budding points searched on levels of the pyramid. The coarser levels read fewer cells,
+    // but recompute the tiles which the lobes have changed
+    for( int level : { 0, 2, 4 } )
+    {
+        topography.set_slope_level( level );
+        BENCHMARK( fmt::format( "Topography::add_lobe (flow of 200 lobes, budding points, slope level = {})", level ) )
+        {
+            double sum = 0;
+            for( const auto & lobe_flow : flow )
+            {
+                sum += topography.find_preliminary_budding_point( lobe_flow, 30 )[0];
+                topography.add_lobe( lobe_flow );
+            }
+            return sum;
+        };
+    }
+    topography.set_slope_level( 0 );
+
+    // The same flow with the slopes from a slope source, so that the queries never end a lobe window early
+    auto pool = ThreadPool( std::max( 1u, std::thread::hardware_concurrency() ) );
+    topography.enable_slope_source();
+    for( int lobe_window : { 0, 32 } )
+    {
+        topography.set_lobe_window( lobe_window, &pool );
+        BENCHMARK( fmt::format(
+            "Topography::add_lobe (flow of 200 lobes, slope source, lobe_window = {}, {} threads)", lobe_window,
+            pool.n_threads() ) )
+        {
+            double sum = 0;
+            for( const auto & lobe_flow : flow )
+            {
+                sum += topography.height_and_slope( lobe_flow.center ).first;
+                topography.add_lobe( lobe_flow );
+            }
+            topography.flush_pending_lobes();
+            return sum;
+        };
+    }
+    topography.set_lobe_window( 0, nullptr );
+
+    // The crossover of the row blocks: single lobes of growing size, rasterized serially and in row blocks. The
+    // parallel_lobe_min_cells threshold should be set to the smallest footprint for which the row blocks are faster
+    for( double semi_axis : { 4.0, 8.0, 16.0, 32.0, 64.0 } )
+    {
+        Lobe lobe_large    = Bench::make_lobe( size, semi_axis * cell_size );
+        const auto n_cells = topography.compute_intersection( lobe_large ).size();
+        for( bool row_blocks : { false, true } )
+        {
+            topography.set_row_blocks( row_blocks ? 1 : 0, &pool );
+            BENCHMARK( fmt::format(
+                "Topography::add_lobe ({} cells, row blocks = {}, {} threads)", n_cells, row_blocks,
+                pool.n_threads() ) )
+            {
+                topography.add_lobe( lobe_large );
+                return topography.height_data( 0, 0 );
+            };
+        }
+    }
+    topography.set_row_blocks( 0, nullptr );
+}
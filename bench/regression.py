@@ -0,0 +1,239 @@
+"""
+End-to-end performance regression harness for flowy.
+
+Runs scaled-down variants of the configurations in `examples/` with a fixed `rng_seed`, records the throughput,
+the stage times and the peak memory from the `{run_name}_report.json` written by flowy, checksums the thickness and
+hazard grids, and compares everything against a stored baseline.
+
+The run fails (exit code 1) if
+    - the checksums differ from the baseline (the results are not deterministic, or the physics changed),
+    - the throughput dropped by more than `--max-slowdown`,
+    - the peak memory grew by more than `--max-memory-growth`.
+
+Usage:
+    python3 bench/regression.py --flowy build/flowy --update-baseline   # record a new baseline
+    python3 bench/regression.py --flowy build/flowy                     # compare against it
+
+The DEMs of the `constant_slope` and `saddle` examples are generated on the fly. The Kilauea and Etna DEMs are
+not part of the repository; these cases are skipped unless the DEMs are found in the example folders (or in the
+folder given with `--dem-dir`).
+"""
+
+import argparse
+import hashlib
+import json
+import re
+import subprocess
+import sys
+import tempfile
+from pathlib import Path
+
+REPO_ROOT = Path(__file__).resolve().parent.parent
+DEFAULT_BASELINE = Path(__file__).resolve().parent / "regression_baseline.json"
+
+# The generated DEMs span 4 km around the vent, use (almost) all of it
+FULL_CROP = {"east_to_vent": 1900.0, "west_to_vent": 1900.0, "south_to_vent": 1900.0, "north_to_vent": 1900.0}
+
+# Every case runs an example config with a few overrides that keep the runtime in the order of seconds
+CASES = {
+    "constant_slope": {
+        "config": "examples/constant_slope/input.toml",
+        "dem": "generate:constant_slope",
+        "overrides": {"n_flows": 4, "min_n_lobes": 1000, "max_n_lobes": 1000, **FULL_CROP},
+    },
+    "saddle": {
+        "config": "examples/saddle/input.toml",
+        "dem": "generate:saddle",
+        "overrides": {"n_flows": 8, "min_n_lobes": 1000, "max_n_lobes": 1000, **FULL_CROP},
+    },
+    "kilauea": {
+        "config": "examples/KILAUEA2014-2015/input.toml",
+        "dem": "test20m.asc",
+        "overrides": {"n_flows": 8},
+    },
+    "etna": {
+        "config": "examples/ETNA_LFS1/input.toml",
+        "dem": "tinit_33.asc",
+        "overrides": {"n_flows": 256},
+    },
+}
+
+RNG_SEED = 12345
+
+
+def generate_dem(kind, path):
+    """Writes a synthetic DEM around the vent at (5000, 5000) of the constant_slope and saddle examples"""
+    n = 400
+    cell_size = 10.0
+    x0 = y0 = 3000.0
+    with open(path, "w") as f:
+        f.write(f"ncols {n}\nnrows {n}\nxllcorner {x0}\nyllcorner {y0}\ncellsize {cell_size}\nNODATA_value -9999\n")
+        # The first row of an asc file is the northernmost one
+        for row in range(n):
+            y = y0 + (n - 1 - row) * cell_size - 5000.0
+            values = []
+            for col in range(n):
+                x = x0 + col * cell_size - 5000.0
+                if kind == "constant_slope":
+                    z = 1000.0 - 0.05 * y
+                else:
+                    z = 1000.0 + 2e-5 * (x * x - y * y)
+                values.append(f"{z:.4f}")
+            f.write(" ".join(values) + "\n")
+
+
+def apply_overrides(config_text, overrides):
+    """Sets top level keys of a flowy TOML config, replacing existing assignments"""
+    lines = config_text.splitlines()
+    for key, value in overrides.items():
+        value_str = json.dumps(value)
+        pattern = re.compile(rf"^\s*{re.escape(key)}\s*=")
+        for i, line in enumerate(lines):
+            if pattern.match(line):
+                lines[i] = f"{key} = {value_str}"
+                break
+        else:
+            # Top level keys have to come before the first table
+            lines.insert(0, f"{key} = {value_str}")
+    return "\n".join(lines) + "\n"
+
+
+def checksum(path):
+    if not path.exists():
+        return None
+    return hashlib.sha256(path.read_bytes()).hexdigest()
+
+
+def run_case(name, case, flowy, dem_dir, work_dir):
+    config_path = REPO_ROOT / case["config"]
+    case_dir = work_dir / name
+    case_dir.mkdir(parents=True, exist_ok=True)
+
+    if case["dem"].startswith("generate:"):
+        dem_path = case_dir / f"{name}.asc"
+        generate_dem(case["dem"].split(":", 1)[1], dem_path)
+    else:
+        candidates = [config_path.parent / case["dem"]]
+        if dem_dir is not None:
+            candidates.insert(0, Path(dem_dir) / case["dem"])
+        dem_path = next((c for c in candidates if c.exists()), None)
+        if dem_path is None:
+            return None
+
+    overrides = dict(case["overrides"])
+    overrides["rng_seed"] = RNG_SEED
+    config = case_dir / "input.toml"
+    config.write_text(apply_overrides(config_path.read_text(), overrides))
+
+    output = case_dir / "output"
+    subprocess.run(
+        [str(flowy), str(config), "-a", str(dem_path), "-o", str(output), "-n", name],
+        check=True,
+        stdout=subprocess.DEVNULL,
+    )
+
+    report = json.loads((output / f"{name}_report.json").read_text())
+    return {
+        "lobes_per_second": report["lobes_per_second"],
+        "peak_rss_bytes": report["peak_rss_bytes"],
+        "n_lobes_processed": report["n_lobes_processed"],
+        "stages": {s["name"]: s["wall_seconds"] for s in report["stages"]},
+        "checksums": {
+            "thickness": checksum(output / f"{name}_thickness_full.asc"),
+            "hazard": checksum(output / f"{name}_hazard_full.asc"),
+        },
+    }
+
+
+def measure(name, case, flowy, dem_dir, repeats):
+    """Runs a case `repeats` times, keeps the fastest run and checks that all runs give identical grids"""
+    best = None
+    with tempfile.TemporaryDirectory(prefix="flowy_regression_") as tmp:
+        for i in range(repeats):
+            result = run_case(name, case, flowy, dem_dir, Path(tmp) / f"run_{i}")
+            if result is None:
+                return None
+            if best is not None and result["checksums"] != best["checksums"]:
+                raise RuntimeError(f"{name}: two runs with the same rng_seed produced different grids")
+            if best is None or result["lobes_per_second"] > best["lobes_per_second"]:
+                best = result
+    return best
+
+
+def compare(name, result, baseline, args):
+    failures = []
+    if result["checksums"] != baseline["checksums"]:
+        failures.append("checksums of the thickness/hazard grids differ from the baseline")
+
+    ratio = result["lobes_per_second"] / baseline["lobes_per_second"]
+    if ratio < 1.0 - args.max_slowdown:
+        failures.append(
+            f"throughput dropped to {100 * ratio:.1f}% of the baseline "
+            f"({result['lobes_per_second']:.0f} vs {baseline['lobes_per_second']:.0f} lobes/s)"
+        )
+
+    mem_ratio = result["peak_rss_bytes"] / max(baseline["peak_rss_bytes"], 1)
+    if mem_ratio > 1.0 + args.max_memory_growth:
+        failures.append(f"peak memory grew to {100 * mem_ratio:.1f}% of the baseline")
+
+    print(f"  lobes/s: {result['lobes_per_second']:.0f} (baseline {baseline['lobes_per_second']:.0f}, {ratio:.3f}x)")
+    print(f"  peak RSS: {result['peak_rss_bytes'] / 2**20:.1f} MiB (baseline {baseline['peak_rss_bytes'] / 2**20:.1f} MiB)")
+    for stage, t in result["stages"].items():
+        t_base = baseline["stages"].get(stage)
+        t_base_str = f"{t_base:.3f} s" if t_base is not None else "n/a"
+        print(f"  stage {stage}: {t:.3f} s (baseline {t_base_str})")
+    return failures
+
+
+def main():
+    parser = argparse.ArgumentParser(prog="regression", description=__doc__.split("\n\n")[1])
+    parser.add_argument("--flowy", default=str(REPO_ROOT / "build" / "flowy"), help="Path to the flowy executable")
+    parser.add_argument("--baseline", default=str(DEFAULT_BASELINE), help="Path to the baseline JSON file")
+    parser.add_argument("--dem-dir", default=None, help="Folder containing test20m.asc and tinit_33.asc")
+    parser.add_argument("--cases", nargs="*", default=list(CASES.keys()), choices=list(CASES.keys()))
+    parser.add_argument("--repeats", type=int, default=3, help="Number of runs per case, the fastest one is kept")
+    parser.add_argument("--max-slowdown", type=float, default=0.1, help="Tolerated relative throughput loss")
+    parser.add_argument("--max-memory-growth", type=float, default=0.1, help="Tolerated relative peak RSS growth")
+    parser.add_argument("--update-baseline", action="store_true", help="Store the results as the new baseline")
+    args = parser.parse_args()
+
+    baseline_path = Path(args.baseline)
+    baseline = json.loads(baseline_path.read_text()) if baseline_path.exists() else {}
+    if not baseline and not args.update_baseline:
+        print(f"No baseline found at {baseline_path}, run with --update-baseline first")
+        return 1
+
+    results = {}
+    failed = False
+    for name in args.cases:
+        print(f"{name}:")
+        result = measure(name, CASES[name], args.flowy, args.dem_dir, args.repeats)
+        if result is None:
+            print("  skipped (DEM not found)")
+            continue
+        results[name] = result
+
+        if args.update_baseline:
+            print(f"  lobes/s: {result['lobes_per_second']:.0f}, peak RSS: {result['peak_rss_bytes'] / 2**20:.1f} MiB")
+            continue
+
+        if name not in baseline:
+            print("  no baseline for this case")
+            continue
+
+        failures = compare(name, result, baseline[name], args)
+        for f in failures:
+            print(f"  FAILED: {f}")
+        failed = failed or len(failures) > 0
+
+    if args.update_baseline:
+        baseline.update(results)
+        baseline_path.write_text(json.dumps(baseline, indent=2) + "\n")
+        print(f"Baseline written to {baseline_path}")
+        return 0
+
+    return 1 if failed else 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
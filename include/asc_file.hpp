@@ -1,7 +1,10 @@
 #pragma once
 #include "definitions.hpp"
 #include <filesystem>
+#include <fstream>
 #include <optional>
+#include <string>
+#include <vector>
 
 namespace Flowy
 {
@@ -14,6 +17,42 @@ struct AscCrop
     double y_max;
 };
 
+// The six header lines of an asc file
+struct AscHeader
+{
+    int n_cols{};
+    int n_rows{};
+    Vector2 lower_left_corner = { 0, 0 };
+    double cell_size          = 0;
+    double no_data_value      = -9999;
+
+    // Reads the header from the beginning of the stream
+    static AscHeader read( std::istream & file );
+};
+
+// Reads the data of an asc file one row at a time, so that only a single row is in memory
+class AscRowReader
+{
+public:
+    AscRowReader( const std::filesystem::path & path );
+
+    const AscHeader & header() const
+    {
+        return asc_header;
+    }
+
+    // Reads the next row into `row` and returns its y index, counted from the bottom like the second index of
+    // AscFile::height_data. Returns std::nullopt after the last row
+    std::optional<int> next_row( std::vector<double> & row );
+
+private:
+    std::filesystem::path path{};
+    std::ifstream file{};
+    AscHeader asc_header{};
+    int idx_row = 0; // The number of rows read so far
+    std::string line{};
+};
+
 class AscFile
 {
 public:
@@ -21,6 +60,11 @@ public:
     AscFile( const std::filesystem::path & path, std::optional<AscCrop> crop = std::nullopt );
     void save( const std::filesystem::path & path );
 
+    // A copy on a grid with factor times the cell size, with the same lower left corner. Every cell is the mean of the
+    // cells with data among the factor x factor cells it covers, or no data if none of them has data. The cells at the
+    // upper edges can cover fewer cells
+    AscFile resample( int factor ) const;
+
     Vector2 lower_left_corner = { 0, 0 }; // Coordinates of lower left corner
     double cell_size          = 0;        // side length of square cell
     double no_data_value      = -9999;    // number that indicates lack of data
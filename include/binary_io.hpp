@@ -0,0 +1,64 @@
+#pragma once
+#include <fmt/format.h>
+#include <cstddef>
+#include <cstdint>
+#include <istream>
+#include <ostream>
+#include <stdexcept>
+#include <type_traits>
+#include <vector>
+
+// Raw binary (de)serialization of trivially copyable values, used for the checkpoints. The files are only meant to be
+// read by the same build on the same kind of machine, so there is no conversion of the byte order
+namespace Flowy::BinaryIO
+{
+
+template<typename T>
+void write_array( std::ostream & os, const T * data, std::size_t n )
+{
+    static_assert( std::is_trivially_copyable_v<T> );
+    os.write( reinterpret_cast<const char *>( data ), std::streamsize( n * sizeof( T ) ) );
+}
+
+template<typename T>
+void read_array( std::istream & is, T * data, std::size_t n )
+{
+    static_assert( std::is_trivially_copyable_v<T> );
+    is.read( reinterpret_cast<char *>( data ), std::streamsize( n * sizeof( T ) ) );
+    if( !is )
+    {
+        throw std::runtime_error(
+            fmt::format( "Unexpected end of binary data, while reading {} bytes", n * sizeof( T ) ) );
+    }
+}
+
+template<typename T>
+void write( std::ostream & os, const T & value )
+{
+    write_array( os, &value, 1 );
+}
+
+template<typename T>
+T read( std::istream & is )
+{
+    T value{};
+    read_array( is, &value, 1 );
+    return value;
+}
+
+template<typename T>
+void write_vector( std::ostream & os, const std::vector<T> & vec )
+{
+    write<uint64_t>( os, vec.size() );
+    write_array( os, vec.data(), vec.size() );
+}
+
+template<typename T>
+std::vector<T> read_vector( std::istream & is )
+{
+    std::vector<T> vec( read<uint64_t>( is ) );
+    read_array( is, vec.data(), vec.size() );
+    return vec;
+}
+
+} // namespace Flowy::BinaryIO
@@ -1,5 +1,6 @@
 #pragma once
 #include "definitions.hpp"
+#include "synthetic_terrain.hpp"
 #include <filesystem>
 #include <optional>
 #include <string>
@@ -24,13 +25,85 @@ public:
     bool save_final_dem         = false;
     std::optional<int> rng_seed = std::nullopt;
 
+    // If set to true, a timeline of the run is written to '{run_name}_trace.json' in the Chrome trace-event format
+    bool write_trace = false;
+
+    // If set (through the [Synthetic] table), a generated DEM is used instead of the asc file in `source`
+    std::optional<SyntheticTerrainParams> synthetic_terrain = std::nullopt;
+
+    // If set, a finer asc file inside of the DEM (e.g. LiDAR around the vents). The heights and the slopes come from it
+    // where it covers the DEM, the lobes are added to both grids, and its thickness (and hazard) is written to
+    // '{run_name}_*_inner.asc'. Only supported by the serial emplacement, without checkpoints, restarts and previews
+    std::optional<std::filesystem::path> inner_source = std::nullopt;
+
+    // Memory budget (in MB) for the cached lobe footprints of a flow. Once it is exhausted, the footprints of further
+    // lobes are recomputed when the hazard is computed, instead of being kept for the whole flow. Unbounded if not set.
+    // With n_threads > 1, it is the budget of all n_threads + 1 caches together
+    std::optional<double> max_cache_memory_mb = std::nullopt;
+
+    // If true, the thickness of a lobe is queued per tile of the topography and only added once a height in the tile
+    // is needed, or at the end of the flow. The results are exactly the same as without deferring
+    bool deferred_lobe_application = false;
+
+    // If true (only with topo_mod_flag = 0), the fully enclosed cells of a lobe are added to a difference array, which
+    // is summed up only when the heights are needed. Faster for large lobes, but the thickness then agrees with the
+    // cell by cell updates only to about 1e-12 m per lobe
+    bool accumulate_thickness = false;
+
+    // The number of flows which are emplaced concurrently, each by its own thread. The flows are committed in their
+    // order, and a flow which read a tile changed by an earlier flow of the same batch is emplaced again, so the
+    // results do not depend on the number of threads (see the README). Not supported with topo_mod_flag = 2. Every
+    // thread keeps its own copy of the height grid (see the README for the memory per thread)
+    int n_threads = 1;
+
+    // If > 1, the n_threads threads are used within the flows instead: the lobes are added in windows of up to
+    // lobe_window lobes, whose footprints are rasterized concurrently. A window ends early, when a lobe queries the
+    // height of a cell covered by a lobe in the window, so the results are exactly the same as without windows
+    int lobe_window = 0;
+
+    // If > 0, the footprints of lobes with at least this many cells are split into blocks of rows, which are
+    // rasterized by the n_threads threads. Then the threads are also used within the flows. Off by default, since the
+    // crossover depends on the number of cores (see the README)
+    int parallel_lobe_min_cells = 0;
+
+    // If set, the heights and slopes are interpolated from the coarsest level of a pyramid of block means of the
+    // topography, on which the radius of a circle with the lobe area still spans at least this many cells (see the
+    // README). On fine DEMs this smooths out the small scale roughness under a lobe. The finest grid if not set
+    std::optional<double> slope_cells_per_lobe_radius = std::nullopt;
+
+    // Wall clock budget (in seconds) for the flows. The run stops after the first flow, after which the next flow
+    // would on average not be finished within the budget, and writes the outputs of the completed flows
+    std::optional<double> max_run_time_seconds = std::nullopt;
+
+    // If > 1, a quick preview of the run is made instead: the DEM is coarsened by this factor, the lobes and the flows
+    // are scaled accordingly (see preview.hpp) and the runtime and the memory of the full run are extrapolated. The
+    // outputs are named '{run_name}_preview_*'
+    int preview_factor = 1;
+
+    // Every convergence_interval flows, the thickness, the hazard and the masked footprint are compared with the
+    // previous check, and the changes are written to '{run_name}_convergence.csv'. Disabled if 0
+    int convergence_interval = 0;
+
+    // If set, the run stops once every change was below the tolerance in convergence_n_checks consecutive checks.
+    // The thickness and hazard maps are then scaled by n_flows / (number of completed flows)
+    std::optional<double> convergence_tolerance = std::nullopt;
+    int convergence_n_checks                    = 2;
+
+    // Every checkpoint_interval flows (and when the run is stopped by the time budget or a signal), the state of the
+    // run is written to '{run_name}_checkpoint.bin'. Disabled if 0
+    int checkpoint_interval = 0;
+
+    // If set, the run continues from this checkpoint, and the outputs are the same as those of an uninterrupted run
+    std::optional<std::filesystem::path> resume_checkpoint = std::nullopt;
+
     // ===================================================================================
     // mr lava loba settings from input.py
     // ===================================================================================
 
-    std::string run_name{};                  // Name of the run (used to save the parameters and the output)
-    std::filesystem::path source{};          // File name of ASCII digital elevation model (.asc file)
-    std::vector<Vector2> vent_coordinates{}; // of shape [n_vents, 2]
+    std::string run_name{};                      // Name of the run (used to save the parameters and the output)
+    std::filesystem::path source{};              // File name of ASCII digital elevation model (.asc file)
+    std::vector<Vector2> vent_coordinates{};     // of shape [n_vents, 2]
+    std::vector<Vector2> vent_end_coordinates{}; // End points of the fissures (vent_flag 4, 5 and 7), [n_vents, 2]
 
     int n_vents() const
     {
@@ -42,6 +115,16 @@ public:
     int n_flows{};           // Number of flows per run
     int n_lobes{};           // Number of lobes per flow
     double thickening_parameter{}; // Parameter that affects calculation of the slope [0,1]
+
+    // How the slopes follow the emplaced lava. If not set, the slopes are always computed from the current topography.
+    // Otherwise, they are computed from initial + (1 - thickening_parameter) * (current - initial), which is updated
+    // 0 => never, i.e. the slopes of the initial topography are used
+    // 1 => every n_flows_counter flows
+    // 2 => every n_lobes_counter lobes and every n_flows_counter flows
+    std::optional<int> topo_mod_flag = std::nullopt;
+    int n_flows_counter              = 1;
+    int n_lobes_counter              = 1;
+
     std::optional<double>
         prescribed_lobe_area{}; // User defined (constant) lobe area. Either the lobe area or the average lobe thickness
                                 // is computed, depending on the fixed_dimension_flag.
@@ -124,10 +207,13 @@ public:
                       each fissure is fixed by "fissure_probabilities"
     vent_flag = 8 => the initial lobes are chosen randomly from the vents
                       coordinates and the probability of each vent
+                      is fixed by "fissure_probabilities"
     */
     int vent_flag{};
 
-    std::optional<double> fissure_probabilities{};
+    // Relative probabilities of the segments of the polyline (vent_flag = 6, n_vents - 1 entries), of the fissures
+    // (vent_flag = 7, n_vents entries) or of the vents (vent_flag = 8, n_vents entries)
+    std::vector<double> fissure_probabilities{};
     std::optional<double> total_volume{};
     std::optional<double> east_to_vent{};
     std::optional<double> west_to_vent{};
@@ -0,0 +1,85 @@
+#pragma once
+#include "definitions.hpp"
+#include "run_report.hpp"
+#include "topography.hpp"
+#include <cstdint>
+#include <filesystem>
+#include <istream>
+#include <optional>
+#include <ostream>
+#include <vector>
+
+namespace Flowy
+{
+
+/*
+Tracks how much the outputs of an ensemble still change as flows are added. At every check, the thickness and the
+hazard are normalized to a unit sum, so that they describe the shape of the ensemble and not its total volume, and are
+compared with the previous check. Only the cells that a lobe has touched so far are visited, which are flagged with
+one byte per cell and listed by their flat indices, so a check costs O(n_touched) (O(n_touched log n_touched) for the masked
+footprint) instead of O(n_x * n_y).
+*/
+class ConvergenceMonitor
+{
+public:
+    ConvergenceMonitor() = default;
+
+    // masking_threshold is the volume fraction of the masked footprint, which is not tracked if it is not set
+    ConvergenceMonitor( int n_x, int n_y, std::optional<double> masking_threshold, bool track_hazard );
+
+    // Marks the cells of the (inclusive) bounding box as touched
+    void mark_touched( const Topography::BoundingBox & box );
+
+    // Compares the thickness (height - height_initial) and the hazard on the touched cells with the previous check and
+    // appends the result to the convergence curve. The first check compares with an empty grid, so all changes are 1
+    const ConvergencePoint &
+    check( int n_flows, const MatrixX & height, const MatrixX & height_initial, const MatrixX & hazard );
+
+    // True if the largest change was below the tolerance in each of the last n_checks checks
+    bool is_converged( double tolerance, int n_checks ) const;
+
+    const std::vector<ConvergencePoint> & curve() const
+    {
+        return points;
+    }
+
+    std::size_t n_touched() const
+    {
+        return touched.size();
+    }
+
+    // Writes the convergence curve as csv, with one row per check
+    void write_csv( const std::filesystem::path & path ) const;
+
+    // Binary (de)serialization of the state for the checkpoints. The monitor has to be constructed with the same
+    // settings before load is called
+    void save( std::ostream & os ) const;
+    void load( std::istream & is );
+
+private:
+    int n_y                                 = 0;
+    std::optional<double> masking_threshold = std::nullopt;
+    bool track_hazard                       = false;
+
+    // The flat indices idx_x * n_y + idx_y exceed int on grids of more than 2^31 cells
+    std::vector<uint8_t> is_touched{};  // One byte per cell of the grid, 1 if the cell was touched
+    std::vector<std::size_t> touched{}; // Flat indices of the touched cells, in the order they were touched
+
+    // The state of the previous check, aligned with touched. Cells touched since then have zero entries
+    std::vector<double> thickness_prev{};
+    std::vector<double> hazard_prev{};
+    std::vector<uint8_t> footprint_prev{};
+
+    std::vector<ConvergencePoint> points{};
+
+    // Collects the values of the field on the touched cells
+    std::vector<double> gather( const MatrixX & field, const MatrixX * subtract = nullptr ) const;
+
+    // Normalizes values to a unit sum, returns the L1 distance to prev and stores the normalized values in prev
+    static double update_distribution( const std::vector<double> & values, std::vector<double> & prev );
+
+    // The Jaccard distance between the masked footprint of the thickness and the previous one, which is updated
+    double update_footprint( const std::vector<double> & thickness );
+};
+
+} // namespace Flowy
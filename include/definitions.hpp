@@ -1,6 +1,6 @@
 #pragma once
 
-#include "xtensor-blas/xlinalg.hpp"
+#include "vec2.hpp"
 #include "xtensor/xbuilder.hpp"
 #include "xtensor/xmanipulation.hpp"
 #include "xtensor/xmath.hpp"
@@ -13,9 +13,22 @@
 namespace Flowy
 {
 
-using Vector2 = xt::xtensor_fixed<double, xt::xshape<2>>;
+using Vector2 = Vec2;
 using Vector3 = xt::xtensor_fixed<double, xt::xshape<3>>;
 using MatrixX = xt::xtensor<double, 2>;
 using VectorX = xt::xtensor<double, 1>;
 
+// Explicit conversions between Vector2 and the xtensor containers
+inline xt::xtensor_fixed<double, xt::xshape<2>> to_xtensor( const Vector2 & v )
+{
+    return { v[0], v[1] };
+}
+
+template<typename E>
+inline Vector2 to_vector2( const xt::xexpression<E> & expression )
+{
+    const auto & e = expression.derived_cast();
+    return { e( 0 ), e( 1 ) };
+}
+
 } // namespace Flowy
\ No newline at end of file
@@ -23,6 +23,14 @@ public:
         cos_azimuthal_angle   = std::cos( azimuthal_angle );
     }
 
+    // Sets the angle together with its (previously computed) sine and cosine
+    void set_azimuthal_angle( double azimuthal_angle, double sin_azimuthal_angle, double cos_azimuthal_angle )
+    {
+        this->azimuthal_angle     = azimuthal_angle;
+        this->sin_azimuthal_angle = sin_azimuthal_angle;
+        this->cos_azimuthal_angle = cos_azimuthal_angle;
+    }
+
     double get_azimuthal_angle() const
     {
         return azimuthal_angle;
@@ -0,0 +1,66 @@
+#pragma once
+#include "lobe.hpp"
+#include <cstdint>
+#include <vector>
+
+namespace Flowy
+{
+
+/*
+Stores the lobes of a flow as a struct of arrays, so that the passes over a whole flow (cumulative descendents, hazard,
+lobe output) only stream the columns they need.
+    - The geometry stays in double precision, since the coordinates are typically UTM and float would lose sub-metre
+      precision. The sine and cosine of the azimuthal angle are stored, so that lobe() does not recompute them.
+    - The tree is stored as int32 indices, with -1 for the initial lobes which have no parent.
+    - The bookkeeping fields, which are only written to the lobes csv, are stored as float.
+*/
+class LobeStore
+{
+public:
+    // Removes all lobes
+    void clear();
+
+    // Reserves memory for n_lobes lobes
+    void reserve( int n_lobes );
+
+    // The memory of a lobe, summed over the columns below
+    static constexpr std::size_t bytes_per_lobe = 7 * sizeof( double ) + 3 * sizeof( int32_t ) + 3 * sizeof( float );
+
+    // Resizes to n_lobes lobes, new lobes are default constructed lobes
+    void resize( int n_lobes );
+
+    int size() const
+    {
+        return idx_parent.size();
+    }
+
+    void push_back( const Lobe & lobe );
+
+    // Reconstructs the full lobe with index idx_lobe
+    Lobe lobe( int idx_lobe ) const;
+
+    // Computes n_descendents for every lobe. Since a parent always has a smaller index than its descendents, a single
+    // reverse sweep accumulates the descendents of every lobe before they are added to its parent
+    void compute_cumulative_descendents();
+
+    // Geometry
+    std::vector<double> center_x{};
+    std::vector<double> center_y{};
+    std::vector<double> semi_axis_major{};
+    std::vector<double> semi_axis_minor{};
+    std::vector<double> azimuthal_angle{};
+    std::vector<double> sin_azimuthal_angle{};
+    std::vector<double> cos_azimuthal_angle{};
+
+    // Tree
+    std::vector<int32_t> idx_parent{};
+    std::vector<int32_t> dist_n_lobes{};
+    std::vector<int32_t> n_descendents{};
+
+    // Bookkeeping
+    std::vector<float> parent_weight{};
+    std::vector<float> alpha_inertial{};
+    std::vector<float> thickness{};
+};
+
+} // namespace Flowy
@@ -0,0 +1,53 @@
+#pragma once
+#include <optional>
+#include <vector>
+
+namespace Flowy
+{
+
+/*
+Keeps the candidate parent lobes of a flow in the order used to select them, when the selection depends on more
+than the lobe index (start_from_dist_flag and/or force_max_length). The parent is drawn by rank, so that the power
+law of lobe_exponent applies to the ordered candidates:
+    - order_by_distance = false: candidates are ordered by lobe index
+    - order_by_distance = true:  candidates are ordered by their distance to the vent (dist_n_lobes), ties by index
+    - max_length: lobes with dist_n_lobes >= max_length are never candidates
+Since the distance of a lobe never changes, insertion and lookup by rank are O(log n), by keeping a Fenwick tree of
+the number of candidates per distance.
+*/
+class ParentSampler
+{
+public:
+    ParentSampler() = default;
+    ParentSampler( bool order_by_distance, std::optional<double> max_length );
+
+    // Removes all lobes and preallocates for a flow with n_lobes lobes. Longer flows grow the sampler on demand
+    void reset( int n_lobes );
+
+    // Adds the lobe with index idx_lobe, lobes have to be added in order of their index
+    void add_lobe( int idx_lobe, int dist_n_lobes );
+
+    // The number of candidate lobes
+    int size() const
+    {
+        return n_candidates;
+    }
+
+    // Returns the index of the candidate lobe with the given rank (0 <= rank < size())
+    int lobe_at_rank( int rank ) const;
+
+private:
+    bool order_by_distance           = false;
+    std::optional<double> max_length = std::nullopt;
+    int n_candidates                 = 0;
+    int max_distance                 = -1; // Largest distance of any candidate since the last reset
+
+    std::vector<int> candidates_by_index{};                 // Used when order_by_distance = false
+    std::vector<int> fenwick_tree{};                        // Number of candidates per distance (1-based)
+    std::vector<std::vector<int>> candidates_by_distance{}; // Lobe indices per distance, sorted by index
+
+    // Resizes to at least n_distances distances (at least doubling) and rebuilds the Fenwick tree, in O(n_distances)
+    void grow( std::size_t n_distances );
+};
+
+} // namespace Flowy
@@ -0,0 +1,24 @@
+#pragma once
+#include "config.hpp"
+#include "run_report.hpp"
+#include <cstddef>
+
+// A preview runs the same simulation on the DEM coarsened by f = preview_factor (see AscFile::resample). The lobes keep
+// their size in cells, so their area grows by f^2, and a flow has f times fewer lobes, so that it keeps its length. The
+// lobes are f times thinner, so that the volume of a flow does not change. The number of flows shrinks by f^2 together
+// with the total volume, and the thickness and the hazard are scaled back up to the flows of the full run. A preview
+// therefore emplaces about f^3 times fewer lobes than the full run, each of which covers about as many cells
+namespace Flowy::Preview
+{
+
+// The settings of the preview of a run. The intervals, which are counted in flows or lobes, are scaled like the
+// numbers of flows and lobes. Checkpoints are not written, and resuming and restart files are not supported
+Config::InputParams scale_input( const Config::InputParams & input );
+
+// Extrapolates a preview to the full run. The time of the flows scales with the number of lobes, the time of the
+// outputs and the memory of the grids scale with the number of cells (cell_ratio = full cells / preview cells)
+PreviewEstimate estimate_full_run(
+    const Config::InputParams & input_full, const Config::InputParams & input_preview, int n_flows_completed,
+    double cell_ratio, double flow_seconds, double output_seconds, std::size_t grid_bytes );
+
+} // namespace Flowy::Preview
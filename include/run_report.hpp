@@ -0,0 +1,146 @@
+#pragma once
+#include "config.hpp"
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <ctime>
+#include <filesystem>
+#include <optional>
+#include <string>
+#include <vector>
+
+namespace Flowy
+{
+
+// The reason why the emplacement of a flow ended
+enum class StopReason
+{
+    MaxLobes,      // All lobes of the flow have been emplaced
+    ParentLobe,    // The parent lobe is close to the boundary or to a nodata cell
+    BuddingPoint,  // The final budding point is close to the boundary or to a nodata cell
+    NewLobeCenter, // The center of the new lobe is close to the boundary or to a nodata cell
+};
+
+std::string to_string( StopReason reason );
+
+// The reason why the loop over the flows ended
+enum class RunTermination
+{
+    Completed,  // All n_flows flows have been emplaced
+    Converged,  // The convergence_tolerance was met
+    TimeBudget, // The next flow would not have finished within max_run_time_seconds
+    Signal,     // A stop was requested with SIGTERM or SIGINT
+};
+
+std::string to_string( RunTermination termination );
+
+struct FlowStats
+{
+    int idx_flow{};
+    int n_lobes_target{};   // The number of lobes the flow was supposed to have
+    int n_lobes_emplaced{}; // The number of lobes that were actually added to the topography
+    StopReason stop_reason = StopReason::MaxLobes;
+    int n_footprints_uncached{}; // The number of lobe footprints that did not fit into max_cache_memory_mb
+};
+
+// One check of the convergence monitor. The changes are measured against the previous check
+struct ConvergencePoint
+{
+    int n_flows{};               // The number of flows completed at the check
+    std::size_t n_touched{};     // The number of cells touched by any lobe so far
+    double thickness_change = 0; // L1 distance of the thickness normalized to unit volume, in [0, 2]
+    double hazard_change    = 0; // L1 distance of the hazard normalized to a unit sum, in [0, 2]
+    double footprint_change = 0; // Jaccard distance of the masked footprint, in [0, 1]
+};
+
+// The extrapolation of a preview run (see preview_factor) to the full run
+struct PreviewEstimate
+{
+    int preview_factor{};
+    int n_flows_full{};
+    double seconds         = 0; // The wall clock time of the flows and the outputs of the full run
+    std::size_t grid_bytes = 0; // The memory of the grids of the full run
+};
+
+// Collects performance and accounting data of a run, which is written as a JSON file at the end of the run
+class RunReport
+{
+public:
+    struct StageTime
+    {
+        std::string name{};
+        double wall_seconds = 0;
+        double cpu_seconds  = 0;
+        int calls           = 0;
+    };
+
+    struct FileIO
+    {
+        std::filesystem::path path{};
+        std::uintmax_t bytes = 0;
+    };
+
+    struct Grid
+    {
+        std::string name{};
+        std::size_t bytes = 0;
+    };
+
+    // RAII timer, which adds the wall clock time and the cpu time of its lifetime to a stage of the report
+    class StageTimer
+    {
+    public:
+        StageTimer( RunReport & report, const char * stage )
+                : report( report ),
+                  stage( stage ),
+                  wall_start( std::chrono::steady_clock::now() ),
+                  cpu_start( std::clock() )
+        {
+        }
+
+        StageTimer( const StageTimer & )             = delete;
+        StageTimer & operator=( const StageTimer & ) = delete;
+
+        ~StageTimer()
+        {
+            const double wall = std::chrono::duration<double>( std::chrono::steady_clock::now() - wall_start ).count();
+            const double cpu  = double( std::clock() - cpu_start ) / CLOCKS_PER_SEC;
+            report.add_stage_time( stage, wall, cpu );
+        }
+
+    private:
+        RunReport & report;
+        const char * stage;
+        std::chrono::steady_clock::time_point wall_start;
+        std::clock_t cpu_start;
+    };
+
+    void add_stage_time( const std::string & stage, double wall_seconds, double cpu_seconds );
+    void add_file_read( const std::filesystem::path & path );
+    void add_file_written( const std::filesystem::path & path );
+    void add_grid( const std::string & name, std::size_t bytes );
+    void add_flow( const FlowStats & flow_stats );
+    void add_convergence_point( const ConvergencePoint & point );
+
+    // The summed wall clock time of a stage, 0 if it was never timed
+    double stage_wall_seconds( const std::string & stage ) const;
+
+    // Returns the peak resident set size of the process in bytes (0 if it cannot be determined)
+    static std::size_t peak_rss_bytes();
+
+    void write(
+        const std::filesystem::path & path, const Config::InputParams & input, int rng_seed, double total_seconds,
+        int n_lobes_processed ) const;
+
+    std::vector<StageTime> stages{};
+    std::vector<FileIO> files_read{};
+    std::vector<FileIO> files_written{};
+    std::vector<Grid> grids{};
+    std::vector<FlowStats> flows{};
+    std::vector<ConvergencePoint> convergence{};
+    RunTermination termination = RunTermination::Completed;
+    int n_flows_rerun          = 0; // Concurrently emplaced flows, which had to be emplaced again (see n_threads)
+    std::optional<PreviewEstimate> preview{}; // Only set for a preview run
+};
+
+} // namespace Flowy
@@ -0,0 +1,95 @@
+#pragma once
+#include <array>
+#include <cstdint>
+#include <limits>
+
+namespace Flowy
+{
+
+/*
+Counter based random number generator: the k-th number of a stream is a hash (the splitmix64 finalizer) of the seed,
+the stream index and k. Every lobe of a flow draws from its own stream (see key()), so the random numbers of a lobe
+do not depend on how many numbers the previous lobes consumed. Since the numbers of a stream are independent of each
+other, they are generated in batches of buffer_size, in a loop without dependencies between the iterations which the
+compiler can vectorize.
+*/
+class RandomStream
+{
+public:
+    using result_type = std::uint64_t;
+
+    static constexpr int buffer_size = 8;
+
+    RandomStream() = default;
+    explicit RandomStream( std::uint64_t seed, std::uint64_t stream = 0 );
+
+    // The stream index of the lobe idx_lobe of the flow idx_flow. Numbers which are drawn once per flow use
+    // idx_lobe = -1
+    static std::uint64_t key( int idx_flow, int idx_lobe )
+    {
+        return ( std::uint64_t( std::uint32_t( idx_flow ) ) << 32 ) | std::uint32_t( idx_lobe );
+    }
+
+    // Restarts at the beginning of the given stream
+    void set_stream( std::uint64_t stream );
+
+    static constexpr result_type min()
+    {
+        return 0;
+    }
+
+    static constexpr result_type max()
+    {
+        return std::numeric_limits<result_type>::max();
+    }
+
+    // The next 64 random bits, so that the class can be used with the distributions of <random>
+    result_type operator()()
+    {
+        if( idx_buffer == buffer_size )
+        {
+            refill();
+        }
+        return buffer[idx_buffer++];
+    }
+
+    // A uniform number in [0, 1)
+    double uniform()
+    {
+        return double( ( *this )() >> 11 ) * 0x1.0p-53;
+    }
+
+    // A uniform number in [a, b)
+    double uniform( double a, double b )
+    {
+        return a + ( b - a ) * uniform();
+    }
+
+    // A uniform integer in [a, b]
+    int uniform_int( int a, int b );
+
+    // Fills out[0, n) with the next n uniform numbers in [0, 1)
+    void fill_uniform( double * out, int n );
+
+private:
+    std::uint64_t stream_offset = 0; // Derived from the seed and the stream index
+    std::uint64_t counter       = 0; // The index of the next batch
+    std::uint64_t seed          = 0;
+    std::array<std::uint64_t, buffer_size> buffer{};
+    int idx_buffer = buffer_size;
+
+    void refill();
+};
+
+// The cumulative distribution function of the standard normal distribution
+double normal_cdf( double x );
+
+// The quantile function of the standard normal distribution, computed with the rational approximations of Wichura's
+// algorithm AS 241 (PPND16), which have a relative accuracy of about 1e-16
+double inverse_normal_cdf( double p );
+
+// Draws from the normal distribution N(mu, sigma) truncated to [a, b], by inverting the cumulative distribution
+// function. Every draw uses exactly one uniform number, no matter how narrow or wide the interval is
+double truncated_normal( RandomStream & gen, double mu, double sigma, double a, double b );
+
+} // namespace Flowy
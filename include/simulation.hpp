@@ -1,10 +1,19 @@
 #pragma once
 #include "asc_file.hpp"
 #include "config.hpp"
+#include "convergence_monitor.hpp"
 #include "definitions.hpp"
 #include "lobe.hpp"
+#include "lobe_store.hpp"
+#include "parent_sampler.hpp"
+#include "run_report.hpp"
+#include "sampling.hpp"
 #include "topography.hpp"
+#include "vent_sampler.hpp"
+#include <cstddef>
 #include <filesystem>
+#include <functional>
+#include <optional>
 #include <random>
 #include <vector>
 
@@ -25,10 +34,36 @@ public:
     double exp_lobe_exponent  = 1;
 };
 
+// Compile time policies of the lobe emplacement loop. The settings they depend on never change during a run, so run()
+// selects the matching instantiation of emplace_lobes once. Runtime reads the settings from the input for every lobe
+// and is the generic fallback for the combinations which are not instantiated
+enum class ParentPolicy
+{
+    Runtime,
+    Last,    // lobe_exponent <= 0
+    PowerLaw // 0 < lobe_exponent < 1, without start_from_dist_flag and force_max_length
+};
+
+enum class AnglePolicy
+{
+    Runtime,
+    TruncatedNormal // 0 < max_slope_prob < 1
+};
+
+enum class InertiaPolicy
+{
+    Runtime,
+    Inertial // inertial_exponent > 0
+};
+
 class Simulation
 {
 public:
-    Simulation( const Config::InputParams & input, std::optional<int> rng_seed );
+    Simulation( const Config::InputParams & input_params, std::optional<int> rng_seed );
+
+    // A replica of simulation for the concurrent flows, which emplaces lobes on worker_topography (a worker_copy of the
+    // topography of simulation). It only copies the settings and the samplers, not the grids for the outputs
+    Simulation( const Simulation & simulation, Topography && worker_topography );
 
     Config::InputParams input;
     AscFile asc_file;
@@ -36,8 +71,39 @@ public:
     Topography topography_thickness; // Stores the height_difference between initial and final topography
     Topography topography;           // The topography, which is modified during the simulation
     CommonLobeDimensions lobe_dimensions;
+    RunReport report; // Timings and accounting data, written to '{run_name}_report.json' at the end of the run
+
+    LobeStore lobes; // Lobes per flows
+
+    // The number of flows emplaced by run(). Smaller than n_flows, if the run stopped early (convergence, time budget
+    // or a stop signal), in which case the thickness and the hazard are scaled by n_flows / n_flows_completed
+    int n_flows_completed = 0;
+
+    // Only set for a preview (preview_factor > 1), in which case input holds the scaled settings of the preview, see
+    // preview.hpp. n_cells_full is the number of cells of the DEM before it was resampled
+    std::optional<Config::InputParams> input_full = std::nullopt;
+    std::size_t n_cells_full                      = 0;
+
+    // The number of flows of the full run, which the outputs are scaled to
+    int n_flows_full() const
+    {
+        return input_full.has_value() ? input_full->n_flows : input.n_flows;
+    }
+
+    // The factor by which the thickness and the hazard are scaled, so that they estimate all flows of the full run
+    double output_scale() const
+    {
+        return n_flows_completed > 0 ? double( n_flows_full() ) / n_flows_completed : 1.0;
+    }
 
-    std::vector<Lobe> lobes; // Lobes per flows
+    // Only set if convergence_interval > 0
+    std::optional<ConvergenceMonitor> convergence_monitor = std::nullopt;
+
+    // Candidate parent lobes of the current flow, only used if start_from_dist_flag or force_max_length is set
+    ParentSampler parent_sampler;
+
+    // Draws the positions of the initial lobes according to the vent_flag, built once in the constructor
+    VentSampler vent_sampler;
 
     // calculates the initial lobe position
     void compute_initial_lobe_position( int idx_flow, Lobe & lobe );
@@ -47,27 +113,103 @@ public:
 
     void compute_descendent_lobe_position( Lobe & lobe, const Lobe & parent, Vector2 final_budding_point );
 
+    template<AnglePolicy policy = AnglePolicy::Runtime>
     void perturb_lobe_angle( Lobe & lobe, const Vector2 & slope );
 
-    int select_parent_lobe( int idx_descendant );
+    // Selects the parent of the lobe with index idx_descendant among the lobes of the current flow and sets the
+    // parent related fields of lobe_descendent
+    template<ParentPolicy policy = ParentPolicy::Runtime>
+    int select_parent_lobe( int idx_descendant, Lobe & lobe_descendent );
 
-    void compute_cumulative_descendents( std::vector<Lobe> & lobes ) const;
+    // True if the parent lobe is selected with the parent_sampler, instead of directly by lobe index
+    bool uses_parent_sampler() const
+    {
+        return input.start_from_dist_flag == 1 || input.force_max_length == 1;
+    }
 
+    // Adds a lobe of the current flow to the candidate parent lobes
+    void add_parent_candidate( int idx_lobe );
+
+    template<InertiaPolicy policy = InertiaPolicy::Runtime>
     void add_inertial_contribution( Lobe & lobe, const Lobe & parent, const Vector2 & slope ) const;
 
-    void write_lobe_data_to_file( const std::vector<Lobe> & lobes, const std::filesystem::path & output_path );
+    // Emplaces the lobes of the flow idx_flow, which has at most n_lobes lobes, and records why the flow stopped
+    template<ParentPolicy parent_policy, AnglePolicy angle_policy, InertiaPolicy inertia_policy>
+    void emplace_lobes( int idx_flow, int n_lobes, FlowStats & flow_stats );
+
+    using EmplaceLobesFunction = void ( Simulation::* )( int idx_flow, int n_lobes, FlowStats & flow_stats );
+
+    // Selects the instantiation of emplace_lobes which matches the input settings
+    EmplaceLobesFunction select_emplace_lobes() const;
+
+    // Draws the number of lobes of the flow idx_flow, prepares the lobe store, the intersection cache and the parent
+    // sampler for it and emplaces its lobes
+    FlowStats emplace_flow( int idx_flow, EmplaceLobesFunction emplace_lobes_function );
+
+    void write_lobe_data_to_file( const LobeStore & lobes, const std::filesystem::path & output_path );
 
     bool stop_condition( const Vector2 & point, double radius );
 
     void write_avg_thickness_file();
 
-    std::optional<std::vector<double>> compute_cumulative_fissure_length();
+    // Saves an asc file and records it in the trace and the run report
+    void write_asc_file( AscFile & asc_file, const std::filesystem::path & path, const char * trace_name );
+
+    // Loads the DEM from the asc file in `source`, or generates it if a synthetic terrain is configured
+    AscFile load_dem( std::optional<AscCrop> crop );
+
+    // Loads the asc file in `inner_source`, cropped to the cells inside of the topography
+    AscFile load_inner_dem();
+
+    // Writes the initial (and final) heights, the thickness and the hazard of the inner grid
+    void write_inner_grid_files( double output_scale );
+
+    // Adds the lobes of the last flow to the touched cells of the monitor and, every convergence_interval flows, runs
+    // a check. Returns true if the run has converged according to convergence_tolerance
+    bool check_convergence( ConvergenceMonitor & monitor, int n_flows_completed );
+
+    // Adds the thickness in the restart_files (scaled by restart_filling_parameters) to the topography. The files are
+    // streamed row by row and have to be on the grid of the topography, but may cover a different extent
+    void add_restart_files();
+
+    // Writes the state after n_flows_completed flows (topography, hazard, flow statistics and the convergence monitor)
+    // atomically to path. The RNG needs no state, since the streams only depend on the seed and the lobe
+    void write_checkpoint( const std::filesystem::path & path );
+
+    // Restores the state written by write_checkpoint, after which run() continues with the next flow
+    void read_checkpoint( const std::filesystem::path & path );
+
+    // Updates the slope source of the topography from the lobes added since the last refresh (see topo_mod_flag)
+    void refresh_slope_source();
 
     void run();
 
 private:
     int rng_seed;
-    std::mt19937 gen{};
+    RandomStream gen{}; // Switched to the stream of the current lobe, see RandomStream::key()
+
+    int n_lobes_slope_refresh       = 0; // The slope source is refreshed every n_lobes_slope_refresh lobes, if > 0
+    int n_lobes_since_slope_refresh = 0;
+
+    // The number of footprint caches, which share max_cache_memory_mb (the one of this simulation and the ones of its
+    // replicas, see emplace_flows_concurrently)
+    int n_cache_shares = 1;
+
+    // Emplaces the flows from idx_flow_start on in batches of n_threads concurrent flows, each on a replica of the
+    // simulation, and commits them in the order of the flows. finish_flow is called for every committed flow and
+    // stops the run by returning true
+    void emplace_flows_concurrently(
+        int idx_flow_start, EmplaceLobesFunction emplace_lobes_function,
+        const std::function<bool( const FlowStats & flow_stats )> & finish_flow );
+
+    // Called for every lobe added to the topography
+    void count_lobe_for_slope_source()
+    {
+        if( n_lobes_slope_refresh > 0 && ++n_lobes_since_slope_refresh >= n_lobes_slope_refresh )
+        {
+            refresh_slope_source();
+        }
+    }
 };
 
 } // namespace Flowy
\ No newline at end of file
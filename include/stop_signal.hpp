@@ -0,0 +1,21 @@
+#pragma once
+
+// Graceful termination: SIGTERM (sent by batch schedulers before they kill a job) and SIGINT only raise a flag, which
+// the simulation polls after every flow. The run then stops after the current flow and still writes all its outputs.
+// A second signal terminates the process immediately.
+namespace Flowy::StopSignal
+{
+
+// Installs the handlers for SIGTERM and SIGINT
+void install();
+
+// True once a stop was requested, by a signal or by request()
+bool requested();
+
+// Requests a stop, as if a signal had been received
+void request();
+
+// Clears a previous request
+void reset();
+
+} // namespace Flowy::StopSignal
@@ -0,0 +1,53 @@
+#pragma once
+#include "asc_file.hpp"
+#include "definitions.hpp"
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <string>
+
+namespace Flowy
+{
+
+enum class TerrainKind
+{
+    ConstantSlope, // A plane with gradient `slope`
+    Saddle,        // z = base_height + saddle_curvature * ( dx^2 - dy^2 ), relative to the center of the domain
+    Fractal,       // Fractional Brownian motion noise on top of the plane with gradient `slope`
+};
+
+TerrainKind terrain_kind_from_string( const std::string & kind );
+std::string to_string( TerrainKind kind );
+
+// Parameters of a synthetic DEM, which can be used in place of an asc file
+// Every cell is a pure function of its index and the parameters, therefore a cropped window of a very large DEM
+// (e.g. 50000 x 50000 cells) can be generated without ever materializing the full raster
+struct SyntheticTerrainParams
+{
+    TerrainKind kind = TerrainKind::ConstantSlope;
+
+    std::size_t n_x            = 1000;        // Number of cells in x direction
+    std::size_t n_y            = 1000;        // Number of cells in y direction
+    double cell_size           = 10.0;        // Side length of a cell
+    Vector2 lower_left_corner  = { 0, 0 };    // Coordinates of the lower left corner
+    double base_height         = 1000.0;      // Height at the center of the domain
+    Vector2 slope              = { 0, -0.1 }; // Gradient (dz/dx, dz/dy) of the plane (constant_slope and fractal)
+    double saddle_curvature    = 1e-4;        // Curvature of the saddle
+    double fractal_amplitude   = 50.0;        // Amplitude of the largest octave of the noise
+    double fractal_wavelength  = 2000.0;      // Wavelength of the largest octave of the noise
+    int fractal_octaves        = 8;           // Each octave has half the wavelength of the previous one
+    double fractal_roughness   = 0.5;         // Amplitude ratio of consecutive octaves (2^-H, H = Hurst exponent)
+    double nodata_fraction     = 0.0;         // Fraction of the hole blocks that contain a nodata hole
+    double nodata_hole_radius  = 50.0;        // Radius of the nodata holes
+    double nodata_hole_spacing = 500.0;       // Side length of the blocks in which the holes are placed
+    std::uint64_t seed         = 0;           // Seed of the noise and of the holes
+    double no_data_value       = -9999;
+};
+
+// Generates the synthetic DEM, optionally only the part within `crop` (same semantics as the AscFile constructor)
+AscFile make_synthetic_terrain( const SyntheticTerrainParams & params, std::optional<AscCrop> crop = std::nullopt );
+
+// Height of the synthetic terrain at the grid point (idx_x, idx_y) of the full raster, ignoring nodata holes
+double synthetic_terrain_height( const SyntheticTerrainParams & params, std::size_t idx_x, std::size_t idx_y );
+
+} // namespace Flowy
@@ -0,0 +1,56 @@
+#pragma once
+#include <condition_variable>
+#include <cstdint>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace Flowy
+{
+
+// A fixed set of threads for fork-join parallelism. parallel_for hands out the tasks to the worker threads and to the
+// calling thread, and returns once all of them have finished. The threads are started once, so that a parallel_for
+// only costs a wake up of the workers
+class ThreadPool
+{
+public:
+    // The calling thread also runs tasks, so the pool starts n_threads - 1 worker threads
+    explicit ThreadPool( int n_threads );
+    ~ThreadPool();
+
+    ThreadPool( const ThreadPool & )             = delete;
+    ThreadPool & operator=( const ThreadPool & ) = delete;
+
+    int n_threads() const
+    {
+        return workers.size() + 1;
+    }
+
+    // Runs task( idx ) for every idx in [0, n_tasks). The tasks are claimed one by one, so they can run in any order
+    // and on any thread. If tasks throw, the first exception is rethrown after all tasks have finished
+    void parallel_for( int n_tasks, const std::function<void( int idx )> & task );
+
+private:
+    std::vector<std::thread> workers{};
+
+    // The state of the current parallel_for, guarded by mutex
+    std::mutex mutex{};
+    std::condition_variable cv_start{};
+    std::condition_variable cv_done{};
+    const std::function<void( int idx )> * task = nullptr;
+    int n_tasks                                 = 0;
+    int idx_next                                = 0; // The next task which has not been claimed yet
+    int n_finished                              = 0;
+    uint64_t generation                         = 0; // Incremented by every parallel_for
+    bool stopping                               = false;
+    std::exception_ptr exception{};
+
+    void worker_loop();
+
+    // Claims and runs tasks, until all tasks are claimed. Has to be called with the mutex locked
+    void run_tasks( std::unique_lock<std::mutex> & lock );
+};
+
+} // namespace Flowy
@@ -3,8 +3,13 @@
 #include "asc_file.hpp"
 #include "definitions.hpp"
 #include "lobe.hpp"
+#include "lobe_store.hpp"
 #include "xtensor/xbuilder.hpp"
+#include <algorithm>
+#include <array>
+#include <cstdint>
 #include <iterator>
+#include <limits>
 #include <memory>
 #include <optional>
 #include <utility>
@@ -13,6 +18,8 @@
 namespace Flowy
 {
 
+class ThreadPool;
+
 struct LobeCells
 {
     using cellvecT = std::vector<std::array<int, 2>>;
@@ -20,6 +27,36 @@ struct LobeCells
     cellvecT cells_enclosed{};
 };
 
+// The origin and the cell size of a grid of square cells, together with the quantities derived from them. This is
+// computed whenever x_data and y_data are set, so that the point queries do not have to recompute it on every call
+struct GridGeometry
+{
+    Vector2 origin{};         // The lower left corner of the cell (0, 0)
+    Vector2 upper_corner{};   // The upper right corner of the last cell
+    double cell_size     = 1;
+    double inv_cell_size = 1; // For the coarse levels of the slope pyramid, cell indices divide by cell_size
+    int n_x              = 0;
+    int n_y              = 0;
+
+    GridGeometry() = default;
+    GridGeometry( const VectorX & x_data, const VectorX & y_data );
+
+    // The cell containing the point. The point has to be inside the grid
+    std::array<int, 2> cell_index( const Vector2 & coordinates ) const
+    {
+        const int idx_x = int( ( coordinates[0] - origin[0] ) / cell_size );
+        const int idx_y = int( ( coordinates[1] - origin[1] ) / cell_size );
+        // Rounding in the division can push points right below the upper corner into the next cell
+        return { std::min( idx_x, n_x - 1 ), std::min( idx_y, n_y - 1 ) };
+    }
+
+    bool is_outside( const Vector2 & coordinates ) const
+    {
+        return !( coordinates[0] >= origin[0] && coordinates[0] < upper_corner[0] && coordinates[1] >= origin[1]
+                  && coordinates[1] < upper_corner[1] );
+    }
+};
+
 class Topography
 {
 
@@ -46,12 +83,21 @@ public:
             : height_data( asc_file.height_data ),
               hazard( xt::zeros_like( asc_file.height_data ) ),
               x_data( asc_file.x_data ),
-              y_data( asc_file.y_data )
+              y_data( asc_file.y_data ),
+              grid( x_data, y_data )
     {
+        compute_distance_to_invalid( asc_file.no_data_value );
     }
 
     Topography( const MatrixX & height_data, const VectorX & x_data, const VectorX & y_data )
-            : height_data( height_data ), hazard( xt::zeros_like( height_data ) ), x_data( x_data ), y_data( y_data ){};
+            : height_data( height_data ),
+              hazard( xt::zeros_like( height_data ) ),
+              x_data( x_data ),
+              y_data( y_data ),
+              grid( x_data, y_data )
+    {
+        compute_distance_to_invalid();
+    };
 
     Topography() = default;
 
@@ -60,40 +106,172 @@ public:
 
     MatrixX height_data{}; // The heights of the cells
     MatrixX hazard{};      // Contains data on the cumulative descendents
-    VectorX x_data{};
-    VectorX y_data{};
+
+    // The coordinates of the lower left corners of the cells
+    const VectorX & get_x_data() const
+    {
+        return x_data;
+    }
+
+    const VectorX & get_y_data() const
+    {
+        return y_data;
+    }
+
+    // Sets the coordinates and recomputes the geometry of the grid
+    void set_coordinates( const VectorX & x_data, const VectorX & y_data )
+    {
+        this->x_data = x_data;
+        this->y_data = y_data;
+        grid         = GridGeometry( x_data, y_data );
+    }
+
+    // The Chebyshev distance (in cells) of a cell to the nearest invalid cell, i.e. a no data cell or a cell beyond the
+    // edge of the grid. Saturates at the largest uint16_t
+    int distance_to_invalid( int idx_x, int idx_y ) const
+    {
+        if( distance_to_invalid_data.size() == 0 )
+        {
+            return distance_to_edge( idx_x, idx_y );
+        }
+        return distance_to_invalid_data( idx_x, idx_y );
+    }
 
     inline double get_height( int idx_x, int idx_y )
     {
+        apply_accumulated_thickness();
+        flush_pending_lobes( idx_x, idx_y );
         return height_data( idx_x, idx_y );
     }
 
     inline double get_height( const Vector2 & point )
     {
         auto [idx_x, idx_y] = locate_point( point );
-        return height_data( idx_x, idx_y );
+        return get_height( idx_x, idx_y );
     }
 
     inline void set_height( int idx_x, int idx_y, double height )
     {
+        apply_accumulated_thickness();
+        flush_pending_lobes( idx_x, idx_y );
         height_data( idx_x, idx_y ) = height;
+        if( !slope_source_enabled )
+        {
+            mark_pyramid_cell_dirty( idx_x, idx_y );
+        }
     }
 
     inline void set_height( const Vector2 & point, double height )
     {
-        auto [idx_x, idx_y]         = locate_point( point );
-        height_data( idx_x, idx_y ) = height;
+        auto [idx_x, idx_y] = locate_point( point );
+        set_height( idx_x, idx_y, height );
     }
 
-    inline double cell_size()
+    inline double cell_size() const
     {
-        return x_data[1] - x_data[0];
+        return grid.cell_size;
     };
 
+    const GridGeometry & geometry() const
+    {
+        return grid;
+    }
+
     // Calculate the height and the slope at coordinates
-    // via linear interpolation from the square grid
+    // via linear interpolation from the square grid. With a slope source, it is interpolated from the slope source
+    // instead of height_data, and with a slope level > 0 from a coarser level of the pyramid (see set_slope_level).
+    // With an inner grid, it is interpolated from the inner grid inside of it (see set_inner_grid)
     std::pair<double, Vector2> height_and_slope( const Vector2 & coordinates );
 
+    // The slope source is a second height grid, from which height_and_slope interpolates (see topo_mod_flag). It only
+    // changes in refresh_slope_source, so between two refreshes the slopes do not see the lobes added in the meantime.
+    // enable_slope_source initializes it with height_data
+    void enable_slope_source();
+
+    // A slope source which is never refreshed (topo_mod_flag = 0) stays equal to the initial heights, so instead of a
+    // copy it reads the heights of initial (and of its inner grid), which have to outlive this topography unchanged.
+    // No tiles are marked as dirty and refresh_slope_source does nothing. The workers of worker_copy share the slope
+    // source in the same way, which is only refreshed by the topography it belongs to
+    void share_slope_source( const Topography & initial );
+
+    bool has_slope_source() const
+    {
+        return slope_source_enabled;
+    }
+
+    bool is_slope_source_shared() const
+    {
+        return shared_slope_height_data != nullptr;
+    }
+
+    const MatrixX & slope_source() const
+    {
+        return is_slope_source_shared() ? *shared_slope_height_data : slope_height_data;
+    }
+
+    // Replaces the slope source (e.g. with the one of a checkpoint). All tiles are marked as dirty. Throws for a shared
+    // slope source
+    void set_slope_source( const MatrixX & heights );
+
+    // Sets the slope source to height_initial + (1 - thickening_parameter) * (height_data - height_initial), but only
+    // on the tiles which add_lobe has modified since the last refresh. On all other tiles it already has this value
+    void refresh_slope_source( const MatrixX & height_initial, double thickening_parameter );
+
+    // The same, with the heights of initial, which also refreshes the inner grid from the inner grid of initial
+    void refresh_slope_source( const Topography & initial, double thickening_parameter );
+
+    // The number of tiles which will be recomputed by the next refresh_slope_source
+    int n_dirty_slope_tiles() const
+    {
+        return dirty_slope_tiles.size();
+    }
+
+    // The slope source and the queued lobes are tracked in square tiles with this many cells per side
+    static constexpr int tile_size = 64;
+
+    // With a slope level > 0, height_and_slope interpolates on a coarser grid of the pyramid of the grid it reads from
+    // (height_data, or the slope source if there is one). A cell of level l holds the mean of the 2 x 2 cells below
+    // it, i.e. of 2^l x 2^l cells of the grid. The levels are updated lazily: when a query reads a tile, the cells
+    // above the cells of the grid which have changed on it are recomputed. Level 0 is the grid itself and disables the
+    // pyramid
+    void set_slope_level( int level );
+
+    int slope_level() const
+    {
+        return pyramid_level;
+    }
+
+    // A cell of the coarsest level covers exactly one tile
+    static constexpr int max_slope_level = 6;
+
+    // The heights of a level of the pyramid, with all tiles up to date
+    const MatrixX & pyramid_heights( int level );
+
+    // An inner grid is a finer grid inside of this one, e.g. a high resolution DEM around the vents. height_and_slope
+    // interpolates from the inner grid, more than one of its cells away from its edges, and blends it with this grid
+    // over a band of two cells of this grid, so that the heights and the slopes stay continuous across the edges.
+    // add_lobe adds the lobes to both grids, so the thickness is known at both resolutions. No data cells of the inner
+    // grid are filled with the heights of this grid.
+    // The inner grid follows the deferred lobe application, the thickness accumulation, the slope source and the
+    // intersection cache of this grid, but not the slope level, the lobe window, the row blocks, the lobe journal and
+    // the tile tracking, which have to stay disabled (apart from the slope level, which is set on the inner grid)
+    void set_inner_grid( const AscFile & asc_file );
+
+    bool has_inner_grid() const
+    {
+        return !inner_grids.empty();
+    }
+
+    Topography & inner_grid()
+    {
+        return inner_grids.front();
+    }
+
+    const Topography & inner_grid() const
+    {
+        return inner_grids.front();
+    }
+
     // Compute the indices of a rectangular bounding box
     // The box is computed such that a circle with centered at 'center' with radius 'radius'
     // Is completely contained in the bounding box
@@ -102,32 +280,411 @@ public:
     // Find all the cells that intersect the lobe and all the cells that are fully enclosed by the lobe
     LobeCells get_cells_intersecting_lobe( const Lobe & lobe, std::optional<int> idx_cache = std::nullopt );
 
+    // The default N of compute_intersection. Every path that adds a lobe uses it, so that they agree with each other
+    static constexpr int n_intersection_points = 15;
+
     // Find the fraction of the cells covered by the lobe by rasterizing each cell
     // into a grid of N*N points
     // This returns a vector of pairs
     // - the first entry of each pair contains an array<int, 2> with the idx_i, idx_j of the intersected cell
     // - the second entry contains the fraction of the cell that is covered by the ellips
-    std::vector<std::pair<std::array<int, 2>, double>>
-    compute_intersection( const Lobe & lobe, std::optional<int> idx_cache = std::nullopt, int N = 15 );
+    std::vector<std::pair<std::array<int, 2>, double>> compute_intersection(
+        const Lobe & lobe, std::optional<int> idx_cache = std::nullopt, int N = n_intersection_points );
 
     // Adds the lobe thickness to the topography, according to its fractional intersection with the cells
     void add_lobe( const Lobe & lobe, std::optional<int> idx_cache = std::nullopt );
 
+    // In the deferred mode, add_lobe only queues the thickness of the lobe on the tiles it covers. The queue of a
+    // tile is applied when a query (height_and_slope, get_height, ...) reads one of its cells, or by
+    // flush_pending_lobes, which has to be called before height_data is accessed directly. Since the lobes are added
+    // to every cell in the same order, the heights are exactly the same as with immediate updates
+    void set_deferred_lobe_application( bool deferred );
+
+    bool is_lobe_application_deferred() const
+    {
+        return lobe_application_deferred;
+    }
+
+    // Applies the queued lobes of all tiles, in the order of the tiles
+    void flush_pending_lobes();
+
+    // Applies the lobes of the lobe window, if the cell is in the bounding box of one of them, and the queued lobes of
+    // the tile containing the cell, if there are any
+    void flush_pending_lobes( int idx_x, int idx_y )
+    {
+        if( !lobe_window.empty() && is_in_lobe_window( idx_x, idx_y ) )
+        {
+            flush_lobe_window();
+        }
+        if( lobe_application_deferred )
+        {
+            const int idx_tile = tile_index( idx_x, idx_y );
+            if( !pending_lobe_cells[idx_tile].empty() )
+            {
+                flush_pending_tile( idx_tile );
+            }
+        }
+    }
+
+    // The number of queued cell updates
+    std::size_t n_pending_lobe_cells() const
+    {
+        return n_pending_cells;
+    }
+
+    // Footprints with at least min_cells cells are split into blocks of rows, whose boundary cells are rasterized and
+    // whose heights are updated on the pool. Disabled if min_cells is 0, the pool has to outlive the setting
+    void set_row_blocks( int min_cells, ThreadPool * pool );
+
+    // With a lobe window, add_lobe only collects the lobes, until window_size lobes are collected or a query reads a
+    // cell in the bounding box of one of them. The footprints of the collected lobes are then rasterized in parallel
+    // on the pool, since they do not depend on the heights, and the lobes are added in their order. So the heights are
+    // exactly the same as with immediate updates, and the lobes between two reads of their cells are rasterized
+    // concurrently. flush_pending_lobes also flushes the window. Disabled if window_size < 2, the pool has to outlive
+    // the window. Not used together with the thickness accumulation
+    void set_lobe_window( int window_size, ThreadPool * pool );
+
+    void flush_lobe_window();
+
+    // The number of lobes in the lobe window
+    int n_lobes_in_window() const
+    {
+        return lobe_window.size();
+    }
+
+    // A thickness increment of a cell, with the flat index idx_x * n_y + idx_y of the cell (which exceeds int on grids
+    // of more than 2^31 cells)
+    struct CellIncrement
+    {
+        std::size_t idx_cell;
+        double thickness;
+    };
+
+    // With the lobe journal, add_lobe also appends the increments it adds to the cells to lobe_journal(), so that
+    // apply_lobe_journal can replay them on another topography with the same grid. The increments are exactly the
+    // ones add_lobe adds, so the replayed heights are the same as if the lobes had been added there. Not supported
+    // together with the thickness accumulation
+    void set_lobe_journal( bool enabled );
+
+    std::vector<CellIncrement> & lobe_journal()
+    {
+        return journal;
+    }
+
+    void apply_lobe_journal( const std::vector<CellIncrement> & increments );
+
+    // Tile tracking for the concurrent emplacement of flows. If enabled, the tiles which height_and_slope reads from
+    // and the tiles on which the grid that it reads from changes (height_data, or the slope source if there is one)
+    // are recorded, until reset_tile_tracking is called
+    void set_tile_tracking( bool enabled );
+
+    void reset_tile_tracking();
+
+    const std::vector<int> & tiles_read() const
+    {
+        return tiles_read_list;
+    }
+
+    const std::vector<int> & tiles_changed() const
+    {
+        return tiles_changed_list;
+    }
+
+    bool was_tile_changed( int idx_tile ) const
+    {
+        return is_tile_changed[idx_tile];
+    }
+
+    // Copies the grid which height_and_slope reads from (height_data, or the slope source if there is one) on the
+    // tiles from source, which has to be on the same grid. A shared slope source is not copied, only the pyramid above
+    // it is updated
+    void copy_tiles_from( const Topography & source, const std::vector<int> & tiles );
+
+    // A copy for a worker, which emplaces lobes concurrently and only commits them through its lobe journal. It has
+    // neither the hazard nor the cached footprints of this topography, and it reads the slope source of this
+    // topography (see share_slope_source), which has to outlive it. These are moved aside while the copy is made, so
+    // they are never duplicated
+    Topography worker_copy();
+
+    // Exchanges the cached lobe footprints with other, e.g. to compute the hazard of a flow which was emplaced on
+    // another topography
+    void swap_intersection_cache( Topography & other );
+
+    // If the heights are not read during the emplacement (i.e. the slopes come from a slope source, which is never
+    // refreshed), add_lobe can skip the writes to the fully enclosed cells. Instead, every row of enclosed cells
+    // [idx_x_start, idx_x_stop] adds the thickness at idx_x_start and subtracts it at idx_x_stop + 1 in a difference
+    // array. The boundary cells are added to height_data as usual. apply_accumulated_thickness reconstructs the
+    // thickness with a prefix sum along x and adds it to height_data, which has to be called before height_data is
+    // accessed directly.
+    // The difference array holds integer multiples of thickness_quantum, so that the additions and subtractions
+    // cancel exactly and cells outside of the lobes stay exactly unchanged. The enclosed cells therefore differ from
+    // the per cell updates by at most thickness_quantum / 2 per lobe
+    void set_thickness_accumulation( bool accumulate );
+
+    static constexpr double thickness_quantum = 0x1p-40; // About 1e-12 m
+
+    bool is_thickness_accumulated() const
+    {
+        return thickness_accumulated;
+    }
+
+    // Adds the accumulated thickness to height_data and clears the difference array. Costs O(n_x * n_y), but only if
+    // a lobe has been added since the last call
+    void apply_accumulated_thickness()
+    {
+        if( has_accumulated_thickness )
+        {
+            apply_thickness_difference();
+        }
+    }
+
+    const xt::xtensor<int64_t, 2> & thickness_difference() const
+    {
+        return thickness_difference_data;
+    }
+
     // Computes the hazard for a flow
-    void compute_hazard_flow( const std::vector<Lobe> & lobes, MatrixX & flow_hazard );
+    void compute_hazard_flow( const LobeStore & lobes, MatrixX & flow_hazard );
 
     // Check if a point is near the boundary
     bool is_point_near_boundary( const Vector2 & coordinates, double radius );
 
+    // (Re)computes distance_to_invalid from the current height_data. Cells with a height <= no_data_value are invalid.
+    // The distances are only stored if there are cells without data, otherwise they are the distances to the edges
+    void compute_distance_to_invalid( std::optional<double> no_data_value = std::nullopt );
+
+    // Check if a point is outside of the grid, or if there is an invalid cell within ceil(radius/cell_size) cells
+    // of it. This is a single lookup in distance_to_invalid
+    bool is_point_near_invalid( const Vector2 & coordinates, double radius );
+
     // Figure out which cell a given point is in, returning the indices of the lowest left corner
     std::array<int, 2> locate_point( const Vector2 & coordinates );
 
     Vector2 find_preliminary_budding_point( const Lobe & lobe, int npoints );
 
-    void reset_intersection_cache( int N );
+    // Prepares the cache of lobe footprints for a flow with N lobes. If max_bytes is set, footprints that do not fit
+    // into the budget any more are not cached, and are recomputed whenever they are needed again. The budget counts
+    // the allocated capacity, including the slots kept from the previous flow. It is shared with the inner grid
+    void reset_intersection_cache( int N, std::optional<std::size_t> max_bytes = std::nullopt );
+
+    // The memory allocated by the intersection cache
+    std::size_t intersection_cache_bytes() const
+    {
+        return cache_bytes;
+    }
+
+    // The number of footprints that were not cached, because the budget was exhausted
+    int intersection_cache_n_dropped() const
+    {
+        return cache_n_dropped;
+    }
 
 private:
+    VectorX x_data{};
+    VectorX y_data{};
+    GridGeometry grid{}; // Derived from x_data and y_data whenever they are set
+
+    // Empty if all cells of the grid have data
+    xt::xtensor<uint16_t, 2> distance_to_invalid_data{};
+
+    int distance_to_edge( int idx_x, int idx_y ) const
+    {
+        constexpr int max_distance = std::numeric_limits<uint16_t>::max();
+        return std::min( { idx_x + 1, grid.n_x - 1 - idx_x, idx_y + 1, grid.n_y - 1 - idx_y, max_distance } );
+    }
+
+    static constexpr std::size_t cache_slot_bytes = sizeof( std::optional<LobeCells> );
     std::vector<std::optional<LobeCells>> intersection_cache{};
+    int cache_n_lobes                          = 0; // Only lobes with an index below cache_n_lobes are cached
+    std::optional<std::size_t> cache_max_bytes = std::nullopt;
+    std::size_t cache_bytes                    = 0;
+    int cache_n_dropped                        = 0;
+
+    bool slope_source_enabled = false;
+    MatrixX slope_height_data{};
+    const MatrixX * shared_slope_height_data = nullptr; // Set instead of slope_height_data by share_slope_source
+
+    // Bitmap of the tiles and the indices of the tiles, which have changed since the last refresh of the slope source
+    std::vector<uint8_t> is_slope_tile_dirty{};
+    std::vector<int> dirty_slope_tiles{};
+
+    bool lobe_application_deferred = false;
+    std::vector<std::vector<CellIncrement>> pending_lobe_cells{}; // Per tile, in the order of the lobes
+    std::vector<int> tiles_with_pending_lobes{};
+    std::size_t n_pending_cells = 0;
+
+    int n_tiles_x() const
+    {
+        return ( grid.n_x + tile_size - 1 ) / tile_size;
+    }
+
+    int n_tiles_y() const
+    {
+        return ( grid.n_y + tile_size - 1 ) / tile_size;
+    }
+
+    // The tiles are indexed by idx_tile_x * n_tiles_y + idx_tile_y
+    int tile_index( int idx_x, int idx_y ) const
+    {
+        return ( idx_x / tile_size ) * n_tiles_y() + idx_y / tile_size;
+    }
+
+    void flush_pending_tile( int idx_tile );
+
+    struct WindowLobe
+    {
+        Lobe lobe;
+        std::optional<int> idx_cache;
+        BoundingBox box; // Contains all cells the lobe can intersect
+        LobeCells lobe_cells{};
+        std::vector<std::pair<std::array<int, 2>, double>> intersection_data{};
+    };
+
+    int lobe_window_size          = 0;
+    ThreadPool * lobe_window_pool = nullptr;
+    std::vector<WindowLobe> lobe_window{};
+    BoundingBox lobe_window_box{}; // The union of the boxes of the lobes in the window
+
+    bool is_in_lobe_window( int idx_x, int idx_y ) const
+    {
+        auto is_in_box = [&]( const BoundingBox & box )
+        {
+            return idx_x >= box.idx_x_lower && idx_x <= box.idx_x_higher && idx_y >= box.idx_y_lower
+                   && idx_y <= box.idx_y_higher;
+        };
+        return is_in_box( lobe_window_box )
+               && std::any_of(
+                   lobe_window.begin(), lobe_window.end(), [&]( const WindowLobe & w ) { return is_in_box( w.box ); } );
+    }
+
+    // Adds the thickness of the lobe to the cells of its intersection data (or queues it in the deferred mode)
+    void add_intersection(
+        const Lobe & lobe, const std::vector<std::pair<std::array<int, 2>, double>> & intersection_data );
+
+    // The fractions of the cells of lobe_cells covered by the lobe, see compute_intersection. Must not use the row
+    // blocks, if it runs on a thread of the pool
+    std::vector<std::pair<std::array<int, 2>, double>>
+    intersection_fractions( const Lobe & lobe, const LobeCells & lobe_cells, int N, bool allow_row_blocks ) const;
+
+    int row_block_min_cells     = 0;
+    ThreadPool * row_block_pool = nullptr;
+
+    bool uses_row_blocks( std::size_t n_cells ) const
+    {
+        return row_block_min_cells > 0 && n_cells >= std::size_t( row_block_min_cells );
+    }
+
+    bool lobe_journal_enabled = false;
+    std::vector<CellIncrement> journal{};
+
+    bool tile_tracking = false;
+    std::vector<uint8_t> is_tile_read{};
+    std::vector<uint8_t> is_tile_changed{};
+    std::vector<int> tiles_read_list{};
+    std::vector<int> tiles_changed_list{};
+
+    void mark_tile_read( int idx_x, int idx_y )
+    {
+        const int idx_tile = tile_index( idx_x, idx_y );
+        if( !is_tile_read[idx_tile] )
+        {
+            is_tile_read[idx_tile] = 1;
+            tiles_read_list.push_back( idx_tile );
+        }
+    }
+
+    void mark_tile_changed( int idx_tile )
+    {
+        if( !is_tile_changed[idx_tile] )
+        {
+            is_tile_changed[idx_tile] = 1;
+            tiles_changed_list.push_back( idx_tile );
+        }
+    }
+
+    // The first and one past the last cell of a tile, in x and y
+    std::array<int, 4> tile_extent( int idx_tile ) const;
+
+    bool thickness_accumulated     = false;
+    bool has_accumulated_thickness = false;
+    xt::xtensor<int64_t, 2> thickness_difference_data{}; // In units of thickness_quantum
+
+    void apply_thickness_difference();
+
+    void add_lobe_accumulated( const Lobe & lobe, std::optional<int> idx_cache );
+
+    // The cells of a lobe which reaches beyond the edges of the grid, on the part of its bounding box (in fractional
+    // cell indices x_lower, x_upper, y_lower, y_upper) which is on the grid
+    LobeCells get_cells_intersecting_clipped_lobe( const Lobe & lobe, const std::array<double, 4> & box ) const;
+
+    // The fraction of the cell covered by the lobe, by rasterizing the cell into N columns
+    double intersection_fraction( const Lobe & lobe, int idx_x, int idx_y, int N ) const;
+
+    void store_in_intersection_cache( int idx_cache, const LobeCells & lobe_cells );
+
+    // Only a slope source of its own is refreshed, so only then add_lobe has to track the tiles it changes
+    bool is_slope_source_refreshable() const
+    {
+        return slope_source_enabled && !is_slope_source_shared();
+    }
+
+    void mark_slope_tile_dirty( int idx_tile )
+    {
+        if( !is_slope_tile_dirty[idx_tile] )
+        {
+            is_slope_tile_dirty[idx_tile] = 1;
+            dirty_slope_tiles.push_back( idx_tile );
+        }
+    }
+
+    int pyramid_level = 0;
+    std::vector<MatrixX> pyramid{}; // The levels 1 to pyramid_level
+
+    // Per tile, the bounding box of the cells which have changed since its levels were computed, in the same format as
+    // tile_extent. Empty if the lower index is not below the higher one
+    std::vector<std::array<int, 4>> pyramid_dirty_boxes{};
+
+    static constexpr std::array<int, 4> empty_box
+        = { std::numeric_limits<int>::max(), std::numeric_limits<int>::min(), std::numeric_limits<int>::max(),
+            std::numeric_limits<int>::min() };
+
+    void mark_pyramid_cell_dirty( int idx_x, int idx_y )
+    {
+        if( pyramid_level > 0 )
+        {
+            auto & box = pyramid_dirty_boxes[tile_index( idx_x, idx_y )];
+            box        = { std::min( box[0], idx_x ), std::max( box[1], idx_x + 1 ), std::min( box[2], idx_y ),
+                           std::max( box[3], idx_y + 1 ) };
+        }
+    }
+
+    void mark_pyramid_tile_dirty( int idx_tile )
+    {
+        if( pyramid_level > 0 )
+        {
+            pyramid_dirty_boxes[idx_tile] = tile_extent( idx_tile );
+        }
+    }
+
+    void mark_all_pyramid_tiles_dirty()
+    {
+        for( std::size_t idx_tile = 0; idx_tile < pyramid_dirty_boxes.size(); idx_tile++ )
+        {
+            pyramid_dirty_boxes[idx_tile] = tile_extent( idx_tile );
+        }
+    }
+
+    // Applies the lobes which are not yet in the grid on the tile and recomputes the cells of its levels above the
+    // changed cells
+    void update_pyramid_tile( int idx_tile );
+
+    std::pair<double, Vector2> height_and_slope_on_level( const Vector2 & coordinates );
+
+    // The interpolation of height_and_slope on this grid alone, without the inner grid
+    std::pair<double, Vector2> interpolate_height_and_slope( const Vector2 & coordinates );
+
+    // At most one element. A vector, since the member cannot be a Topography itself
+    std::vector<Topography> inner_grids{};
 };
 
 } // namespace Flowy
\ No newline at end of file
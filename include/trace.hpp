@@ -0,0 +1,91 @@
+#pragma once
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <filesystem>
+
+// Opt-in timeline tracing in the Chrome trace-event format (can be opened in chrome://tracing or ui.perfetto.dev)
+// Every thread records its spans into its own fixed size, lock-free ring buffer. The buffers are only
+// serialized to JSON once, when `flush` is called at the end of the run.
+namespace Flowy::Trace
+{
+
+using clock = std::chrono::steady_clock;
+
+struct Event
+{
+    const char * name     = nullptr; // Must be a string with static storage duration
+    const char * category = nullptr; // Must be a string with static storage duration
+    const char * arg_name = nullptr; // Optional integer argument, shown in the details of the span
+    int64_t arg           = 0;
+    int64_t ts_ns         = 0; // Start of the span, relative to the moment tracing was enabled
+    int64_t dur_ns        = 0; // Duration of the span
+};
+
+// Turns tracing on. Spans created before this call are not recorded.
+// `events_per_thread` is the capacity of each per-thread ring buffer, events beyond it are dropped and counted
+void enable( std::size_t events_per_thread = 1 << 18 );
+
+// Writes all recorded events to `path` and clears the buffers
+// Must not be called while other threads are still recording
+void flush( const std::filesystem::path & path );
+
+namespace Detail
+{
+inline std::atomic<bool> enabled = false;
+void record( const Event & event );
+int64_t now_ns();
+} // namespace Detail
+
+inline bool is_enabled()
+{
+    return Detail::enabled.load( std::memory_order_relaxed );
+}
+
+// RAII span: measures the time between construction and destruction
+// When tracing is disabled, this costs a single relaxed atomic load
+class Span
+{
+public:
+    explicit Span( const char * name, const char * category = "flowy" )
+    {
+        if( is_enabled() )
+        {
+            event.name     = name;
+            event.category = category;
+            event.ts_ns    = Detail::now_ns();
+            active         = true;
+        }
+    }
+
+    Span( const char * name, const char * category, const char * arg_name, int64_t arg ) : Span( name, category )
+    {
+        event.arg_name = arg_name;
+        event.arg      = arg;
+    }
+
+    Span( const Span & )             = delete;
+    Span & operator=( const Span & ) = delete;
+
+    ~Span()
+    {
+        end();
+    }
+
+    // Ends the span before the end of the enclosing scope
+    void end()
+    {
+        if( active )
+        {
+            event.dur_ns = Detail::now_ns() - event.ts_ns;
+            Detail::record( event );
+            active = false;
+        }
+    }
+
+private:
+    Event event{};
+    bool active = false;
+};
+
+} // namespace Flowy::Trace
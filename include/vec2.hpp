@@ -0,0 +1,154 @@
+#pragma once
+#include <cmath>
+#include <cstddef>
+#include <ostream>
+#include <type_traits>
+
+namespace Flowy
+{
+
+// A two dimensional vector of doubles, used for the points and directions in the hot loops (lobe geometry, topography
+// queries). Unlike xt::xtensor_fixed, it is a plain pair of doubles, so that the arithmetic compiles to a few scalar
+// instructions without expression templates. Conversions to and from xtensor are explicit (see definitions.hpp)
+struct Vec2
+{
+    double data[2] = { 0, 0 };
+
+    constexpr Vec2() = default;
+    constexpr Vec2( double x, double y ) : data{ x, y } {}
+
+    constexpr double & operator[]( int i )
+    {
+        return data[i];
+    }
+
+    constexpr const double & operator[]( int i ) const
+    {
+        return data[i];
+    }
+
+    constexpr double & operator()( int i )
+    {
+        return data[i];
+    }
+
+    constexpr const double & operator()( int i ) const
+    {
+        return data[i];
+    }
+
+    static constexpr std::size_t size()
+    {
+        return 2;
+    }
+
+    // Iterators, so that the vector can be used with range based for loops and printed with fmt/ranges.h
+    constexpr double * begin()
+    {
+        return data;
+    }
+
+    constexpr double * end()
+    {
+        return data + 2;
+    }
+
+    constexpr const double * begin() const
+    {
+        return data;
+    }
+
+    constexpr const double * end() const
+    {
+        return data + 2;
+    }
+
+    constexpr Vec2 & operator+=( const Vec2 & other )
+    {
+        data[0] += other.data[0];
+        data[1] += other.data[1];
+        return *this;
+    }
+
+    constexpr Vec2 & operator-=( const Vec2 & other )
+    {
+        data[0] -= other.data[0];
+        data[1] -= other.data[1];
+        return *this;
+    }
+
+    constexpr Vec2 & operator*=( double s )
+    {
+        data[0] *= s;
+        data[1] *= s;
+        return *this;
+    }
+
+    constexpr Vec2 & operator/=( double s )
+    {
+        data[0] /= s;
+        data[1] /= s;
+        return *this;
+    }
+};
+
+static_assert( std::is_trivially_copyable_v<Vec2> );
+static_assert( sizeof( Vec2 ) == 2 * sizeof( double ) );
+
+constexpr Vec2 operator+( const Vec2 & a, const Vec2 & b )
+{
+    return { a[0] + b[0], a[1] + b[1] };
+}
+
+constexpr Vec2 operator-( const Vec2 & a, const Vec2 & b )
+{
+    return { a[0] - b[0], a[1] - b[1] };
+}
+
+constexpr Vec2 operator-( const Vec2 & a )
+{
+    return { -a[0], -a[1] };
+}
+
+constexpr Vec2 operator*( double s, const Vec2 & a )
+{
+    return { s * a[0], s * a[1] };
+}
+
+constexpr Vec2 operator*( const Vec2 & a, double s )
+{
+    return { a[0] * s, a[1] * s };
+}
+
+constexpr Vec2 operator/( const Vec2 & a, double s )
+{
+    return { a[0] / s, a[1] / s };
+}
+
+constexpr bool operator==( const Vec2 & a, const Vec2 & b )
+{
+    return a[0] == b[0] && a[1] == b[1];
+}
+
+constexpr bool operator!=( const Vec2 & a, const Vec2 & b )
+{
+    return !( a == b );
+}
+
+constexpr double dot( const Vec2 & a, const Vec2 & b )
+{
+    return a[0] * b[0] + a[1] * b[1];
+}
+
+// The euclidean norm
+inline double norm( const Vec2 & a )
+{
+    return std::sqrt( dot( a, a ) );
+}
+
+inline std::ostream & operator<<( std::ostream & os, const Vec2 & a )
+{
+    return os << "{" << a[0] << ", " << a[1] << "}";
+}
+
+} // namespace Flowy
@@ -0,0 +1,56 @@
+#pragma once
+#include "config.hpp"
+#include "definitions.hpp"
+#include "sampling.hpp"
+#include <vector>
+
+namespace Flowy
+{
+
+// Walker/Vose alias table: draws an index with probability proportional to its weight in O(1), using a single
+// uniform random number
+class AliasTable
+{
+public:
+    AliasTable() = default;
+    explicit AliasTable( const std::vector<double> & weights );
+
+    int sample( RandomStream & gen ) const;
+
+    int size() const
+    {
+        return probability.size();
+    }
+
+private:
+    std::vector<double> probability{}; // Probability to keep the drawn column instead of taking its alias
+    std::vector<int> alias{};
+};
+
+// Draws the positions of the initial lobes, according to the vent_flag (see config.hpp for the description of the
+// modes). All tables are built once, so that every draw is O(1) or O(log n_vents).
+class VentSampler
+{
+public:
+    VentSampler() = default;
+    explicit VentSampler( const Config::InputParams & input );
+
+    Vector2 sample( int idx_flow, RandomStream & gen ) const;
+
+private:
+    int vent_flag = 0;
+    int n_flows   = 1;
+
+    // The vents, or the start points of the segments of the polyline/fissures
+    std::vector<Vector2> segment_start{};
+    // The end points of the segments (empty for the modes that only draw vents)
+    std::vector<Vector2> segment_end{};
+    // Normalized cumulative length of the segments (n_segments + 1 entries, starting at 0), for modes 2 and 4
+    std::vector<double> cumulative_length{};
+    // Probabilities of the segments or vents, for modes 6, 7 and 8
+    AliasTable alias_table{};
+
+    Vector2 point_on_segment( int idx_segment, double alpha ) const;
+};
+
+} // namespace Flowy
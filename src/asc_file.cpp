@@ -1,21 +1,18 @@
 #include "asc_file.hpp"
 #include "dump_csv.hpp"
+#include "trace.hpp"
 #include <fmt/format.h>
 #include <algorithm>
+#include <cstdlib>
 #include <fstream>
 #include <stdexcept>
+#include <string>
 
 namespace Flowy
 {
 
-AscFile::AscFile( const std::filesystem::path & path, std::optional<AscCrop> crop )
+AscHeader AscHeader::read( std::istream & file )
 {
-    std::ifstream file( path.string() ); // Open the file
-    if( !file.is_open() )
-    {
-        throw std::runtime_error( fmt::format( "Unable to open asc file: '{}'", path.string() ) );
-    }
-
     /* This is what the first six lines look like
     ncols 2
     nrows 2
@@ -33,17 +30,88 @@ AscFile::AscFile( const std::filesystem::path & path, std::optional<AscCrop> cro
         return line.substr( pos_space, std::string::npos );
     };
 
-    size_t ncols_header = std::stoi( get_number_string() );
-    size_t nrows_header = std::stoi( get_number_string() );
+    AscHeader header{};
+    header.n_cols = std::stoi( get_number_string() );
+    header.n_rows = std::stoi( get_number_string() );
+
+    const double lx          = std::stod( get_number_string() );
+    const double ly          = std::stod( get_number_string() );
+    header.lower_left_corner = { lx, ly };
+
+    header.cell_size     = std::stod( get_number_string() );
+    header.no_data_value = std::stod( get_number_string() );
+    return header;
+}
+
+AscRowReader::AscRowReader( const std::filesystem::path & path ) : path( path ), file( path.string() )
+{
+    if( !file.is_open() )
+    {
+        throw std::runtime_error( fmt::format( "Unable to open asc file: '{}'", path.string() ) );
+    }
+    asc_header = AscHeader::read( file );
+}
+
+std::optional<int> AscRowReader::next_row( std::vector<double> & row )
+{
+    if( idx_row == asc_header.n_rows )
+    {
+        return std::nullopt;
+    }
+
+    // Skip empty lines
+    do
+    {
+        if( !std::getline( file, line ) )
+        {
+            throw std::runtime_error( fmt::format(
+                "nrows in header of '{}' is {}, but there are {} rows of data", path.string(), asc_header.n_rows,
+                idx_row ) );
+        }
+    } while( line.find_first_not_of( " \t\r" ) == std::string::npos );
+
+    row.resize( asc_header.n_cols );
+    const char * begin = line.c_str();
+    char * end         = nullptr;
+    for( int idx_col = 0; idx_col < asc_header.n_cols; idx_col++ )
+    {
+        row[idx_col] = std::strtod( begin, &end );
+        if( end == begin )
+        {
+            throw std::runtime_error( fmt::format(
+                "ncols in header of '{}' is {}, but row {} has {} cols of data", path.string(), asc_header.n_cols,
+                idx_row, idx_col ) );
+        }
+        begin = end;
+    }
 
-    auto lx           = std::stod( get_number_string() );
-    auto ly           = std::stod( get_number_string() );
+    // The first row of the file is the top row of the grid
+    return asc_header.n_rows - 1 - idx_row++;
+}
+
+AscFile::AscFile( const std::filesystem::path & path, std::optional<AscCrop> crop )
+{
+    std::ifstream file( path.string() ); // Open the file
+    if( !file.is_open() )
+    {
+        throw std::runtime_error( fmt::format( "Unable to open asc file: '{}'", path.string() ) );
+    }
+
+    const AscHeader header = AscHeader::read( file );
+
+    size_t ncols_header = header.n_cols;
+    size_t nrows_header = header.n_rows;
+
+    auto lx           = header.lower_left_corner[0];
+    auto ly           = header.lower_left_corner[1];
     lower_left_corner = { lx, ly };
 
-    cell_size     = std::stod( get_number_string() );
-    no_data_value = std::stod( get_number_string() );
+    cell_size     = header.cell_size;
+    no_data_value = header.no_data_value;
 
+    Trace::Span span_parse( "parse_dem" );
     height_data = xt::load_csv<double>( file, ' ' );
+    span_parse.end();
 
     if( nrows_header != height_data.shape()[0] )
     {
@@ -64,6 +132,8 @@ AscFile::AscFile( const std::filesystem::path & path, std::optional<AscCrop> cro
     // If cropping is used, we slice the height_data array
     if( crop.has_value() )
     {
+        Trace::Span span( "crop_dem" );
+
         int idx_x_min = std::clamp<int>( ( crop->x_min - lx ) / cell_size, 0, height_data.shape()[0] - 1 );
         int idx_x_max = std::clamp<int>( ( crop->x_max - lx ) / cell_size, 0, height_data.shape()[0] - 1 );
         int idx_y_min = std::clamp<int>( ( crop->y_min - ly ) / cell_size, 0, height_data.shape()[1] - 1 );
@@ -82,6 +152,57 @@ AscFile::AscFile( const std::filesystem::path & path, std::optional<AscCrop> cro
         lower_left_corner[1], lower_left_corner[1] + ( double( height_data.shape()[1] ) ) * cell_size, cell_size );
 }
 
+AscFile AscFile::resample( int factor ) const
+{
+    if( factor < 1 )
+    {
+        throw std::runtime_error( fmt::format( "Cannot resample a grid by a factor of {}", factor ) );
+    }
+
+    // The blocks at the right and top edges can be partial
+    const int n_x_fine = height_data.shape()[0];
+    const int n_y_fine = height_data.shape()[1];
+    const int n_x      = ( n_x_fine + factor - 1 ) / factor;
+    const int n_y      = ( n_y_fine + factor - 1 ) / factor;
+
+    AscFile res{};
+    res.lower_left_corner = lower_left_corner;
+    res.cell_size         = cell_size * factor;
+    res.no_data_value     = no_data_value;
+    res.height_data       = xt::zeros<double>( { std::size_t( n_x ), std::size_t( n_y ) } );
+
+    for( int idx_x = 0; idx_x < n_x; idx_x++ )
+    {
+        for( int idx_y = 0; idx_y < n_y; idx_y++ )
+        {
+            // The mean of the cells with data, a block is only no data if all of its cells are
+            const int idx_x_end = std::min( ( idx_x + 1 ) * factor, n_x_fine );
+            const int idx_y_end = std::min( ( idx_y + 1 ) * factor, n_y_fine );
+            double sum          = 0;
+            int n_valid         = 0;
+            for( int idx_x_fine = idx_x * factor; idx_x_fine < idx_x_end; idx_x_fine++ )
+            {
+                for( int idx_y_fine = idx_y * factor; idx_y_fine < idx_y_end; idx_y_fine++ )
+                {
+                    const double height = height_data( idx_x_fine, idx_y_fine );
+                    if( height > no_data_value )
+                    {
+                        sum += height;
+                        n_valid++;
+                    }
+                }
+            }
+            res.height_data( idx_x, idx_y ) = n_valid > 0 ? sum / n_valid : no_data_value;
+        }
+    }
+
+    res.x_data
+        = xt::arange( lower_left_corner[0], lower_left_corner[0] + double( n_x ) * res.cell_size, res.cell_size );
+    res.y_data
+        = xt::arange( lower_left_corner[1], lower_left_corner[1] + double( n_y ) * res.cell_size, res.cell_size );
+    return res;
+}
+
 void AscFile::save( const std::filesystem::path & path )
 {
     std::fstream file;
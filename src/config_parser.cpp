@@ -2,6 +2,7 @@
 #include "config.hpp"
 #include <fmt/format.h>
 #include <toml++/toml.h>
+#include <algorithm>
 #include <filesystem>
 #include <optional>
 #include <stdexcept>
@@ -42,6 +43,9 @@ InputParams parse_config( const std::filesystem::path & path )
     set_if_specified( params.write_lobes_csv, tbl["write_lobes_csv"] );
     set_if_specified( params.print_remaining_time, tbl["print_remaining_time"] );
     set_if_specified( params.save_final_dem, tbl["save_final_dem"] );
+    set_if_specified( params.write_trace, tbl["write_trace"] );
+    set_if_specified( params.deferred_lobe_application, tbl["deferred_lobe_application"] );
+    set_if_specified( params.accumulate_thickness, tbl["accumulate_thickness"] );
 
     std::optional<std::string> output_folder_string{};
     output_folder_string = tbl["output_folder"].value<std::string>();
@@ -50,7 +54,71 @@ InputParams parse_config( const std::filesystem::path & path )
         params.output_folder = output_folder_string.value();
     }
 
-    params.rng_seed = tbl["rng_seed"].value<int>();
+    set_if_specified( params.n_threads, tbl["n_threads"] );
+    set_if_specified( params.lobe_window, tbl["lobe_window"] );
+    set_if_specified( params.parallel_lobe_min_cells, tbl["parallel_lobe_min_cells"] );
+    set_if_specified( params.preview_factor, tbl["preview_factor"] );
+
+    params.rng_seed             = tbl["rng_seed"].value<int>();
+    params.max_cache_memory_mb  = tbl["max_cache_memory_mb"].value<double>();
+    params.max_run_time_seconds = tbl["max_run_time_seconds"].value<double>();
+
+    params.slope_cells_per_lobe_radius = tbl["slope_cells_per_lobe_radius"].value<double>();
+
+    set_if_specified( params.convergence_interval, tbl["convergence_interval"] );
+    set_if_specified( params.convergence_n_checks, tbl["convergence_n_checks"] );
+    params.convergence_tolerance = tbl["convergence_tolerance"].value<double>();
+
+    set_if_specified( params.checkpoint_interval, tbl["checkpoint_interval"] );
+    auto resume_checkpoint_string = tbl["resume_checkpoint"].value<std::string>();
+    if( resume_checkpoint_string.has_value() )
+    {
+        params.resume_checkpoint = resume_checkpoint_string.value();
+    }
+
+    if( tbl["Synthetic"].is_table() )
+    {
+        auto synthetic = SyntheticTerrainParams{};
+
+        std::string kind = to_string( synthetic.kind );
+        set_if_specified( kind, tbl["Synthetic"]["kind"] );
+        synthetic.kind = terrain_kind_from_string( kind );
+
+        int n_x = synthetic.n_x;
+        int n_y = synthetic.n_y;
+        set_if_specified( n_x, tbl["Synthetic"]["n_x"] );
+        set_if_specified( n_y, tbl["Synthetic"]["n_y"] );
+        synthetic.n_x = std::max( n_x, 0 );
+        synthetic.n_y = std::max( n_y, 0 );
+
+        auto lower_left_corner = parse_vector<double>( tbl["Synthetic"]["lower_left_corner"] );
+        if( lower_left_corner.size() == 2 )
+        {
+            synthetic.lower_left_corner = { lower_left_corner[0], lower_left_corner[1] };
+        }
+        auto slope = parse_vector<double>( tbl["Synthetic"]["slope"] );
+        if( slope.size() == 2 )
+        {
+            synthetic.slope = { slope[0], slope[1] };
+        }
+
+        int seed = 0;
+        set_if_specified( seed, tbl["Synthetic"]["seed"] );
+        synthetic.seed = seed;
+
+        set_if_specified( synthetic.cell_size, tbl["Synthetic"]["cell_size"] );
+        set_if_specified( synthetic.base_height, tbl["Synthetic"]["base_height"] );
+        set_if_specified( synthetic.saddle_curvature, tbl["Synthetic"]["saddle_curvature"] );
+        set_if_specified( synthetic.fractal_amplitude, tbl["Synthetic"]["fractal_amplitude"] );
+        set_if_specified( synthetic.fractal_wavelength, tbl["Synthetic"]["fractal_wavelength"] );
+        set_if_specified( synthetic.fractal_octaves, tbl["Synthetic"]["fractal_octaves"] );
+        set_if_specified( synthetic.fractal_roughness, tbl["Synthetic"]["fractal_roughness"] );
+        set_if_specified( synthetic.nodata_fraction, tbl["Synthetic"]["nodata_fraction"] );
+        set_if_specified( synthetic.nodata_hole_radius, tbl["Synthetic"]["nodata_hole_radius"] );
+        set_if_specified( synthetic.nodata_hole_spacing, tbl["Synthetic"]["nodata_hole_spacing"] );
+
+        params.synthetic_terrain = synthetic;
+    }
 
     // From input.py
     set_if_specified( params.run_name, tbl["run_name"] );
@@ -59,6 +127,12 @@ InputParams parse_config( const std::filesystem::path & path )
     set_if_specified( source_string, tbl["source"] );
     params.source = std::filesystem::path( source_string );
 
+    auto inner_source_string = tbl["inner_source"].value<std::string>();
+    if( inner_source_string.has_value() )
+    {
+        params.inner_source = inner_source_string.value();
+    }
+
     std::vector<double> x_vent = parse_vector<double>( tbl["x_vent"] );
     std::vector<double> y_vent = parse_vector<double>( tbl["y_vent"] );
     if( x_vent.size() != y_vent.size() )
@@ -70,6 +144,17 @@ InputParams parse_config( const std::filesystem::path & path )
         params.vent_coordinates.push_back( { x_vent[i], y_vent[i] } );
     }
 
+    std::vector<double> x_vent_end = parse_vector<double>( tbl["x_vent_end"] );
+    std::vector<double> y_vent_end = parse_vector<double>( tbl["y_vent_end"] );
+    if( x_vent_end.size() != y_vent_end.size() )
+    {
+        throw std::runtime_error( "x_vent_end and y_vent_end have different sizes" );
+    }
+    for( size_t i = 0; i < x_vent_end.size(); i++ )
+    {
+        params.vent_end_coordinates.push_back( { x_vent_end[i], y_vent_end[i] } );
+    }
+
     std::optional<int> hazard_flag = tbl["hazard_flag"].value<int>();
     if( hazard_flag.has_value() )
     {
@@ -97,6 +182,9 @@ InputParams parse_config( const std::filesystem::path & path )
     set_if_specified( params.n_flows, tbl["n_flows"] );
     set_if_specified( params.n_lobes, tbl["n_lobes"] );
     set_if_specified( params.thickening_parameter, tbl["thickening_parameter"] );
+    params.topo_mod_flag = tbl["topo_mod_flag"].value<int>();
+    set_if_specified( params.n_flows_counter, tbl["n_flows_counter"] );
+    set_if_specified( params.n_lobes_counter, tbl["n_lobes_counter"] );
     params.prescribed_lobe_area          = tbl["lobe_area"].value<double>();
     params.prescribed_avg_lobe_thickness = tbl["avg_lobe_thickness"].value<double>();
 
@@ -110,18 +198,31 @@ InputParams parse_config( const std::filesystem::path & path )
 
     set_if_specified( params.vent_flag, tbl["vent_flag"] );
 
-    params.fissure_probabilities = tbl["fissure_probabilities"].value<double>();
-    params.total_volume          = tbl["total_volume"].value<double>();
-    params.east_to_vent          = tbl["east_to_vent"].value<double>();
-    params.west_to_vent          = tbl["west_to_vent"].value<double>();
-    params.south_to_vent         = tbl["south_to_vent"].value<double>();
-    params.north_to_vent         = tbl["north_to_vent"].value<double>();
-    params.channel_file          = tbl["channel_file"].value<std::string>();
-    params.alfa_channel          = tbl["alfa_channel"].value<double>();
-    params.d1                    = tbl["d1"].value<double>();
-    params.d2                    = tbl["d2"].value<double>();
-    params.eps                   = tbl["eps"].value<double>();
-    params.union_diff_file       = tbl["union_diff_file"].value<std::string>();
+    // Like the masking threshold, fissure_probabilities can be a single float or an array
+    if( tbl["fissure_probabilities"].is_array() )
+    {
+        params.fissure_probabilities = parse_vector<double>( tbl["fissure_probabilities"] );
+    }
+    else
+    {
+        std::optional<double> val = tbl["fissure_probabilities"].value<double>();
+        if( val.has_value() )
+        {
+            params.fissure_probabilities.push_back( val.value() );
+        }
+    }
+
+    params.total_volume    = tbl["total_volume"].value<double>();
+    params.east_to_vent    = tbl["east_to_vent"].value<double>();
+    params.west_to_vent    = tbl["west_to_vent"].value<double>();
+    params.south_to_vent   = tbl["south_to_vent"].value<double>();
+    params.north_to_vent   = tbl["north_to_vent"].value<double>();
+    params.channel_file    = tbl["channel_file"].value<std::string>();
+    params.alfa_channel    = tbl["alfa_channel"].value<double>();
+    params.d1              = tbl["d1"].value<double>();
+    params.d2              = tbl["d2"].value<double>();
+    params.eps             = tbl["eps"].value<double>();
+    params.union_diff_file = tbl["union_diff_file"].value<std::string>();
 
     // from input_advanced.py
     set_if_specified( params.npoints, tbl["Advanced"]["npoints"] );
@@ -190,8 +291,113 @@ void validate_settings( const InputParams & options )
     check( name_and_var( options.n_init ), []( auto x ) { return x >= 1; } );
     check( name_and_var( options.dist_fact ), geq_zero_leq_one );
     check( name_and_var( options.npoints ), []( auto x ) { return x >= 1; } );
+    check( name_and_var( options.thickening_parameter ), geq_zero_leq_one );
+    if( options.topo_mod_flag.has_value() )
+    {
+        const int topo_mod_flag = options.topo_mod_flag.value();
+        check( name_and_var( topo_mod_flag ), []( auto x ) { return x >= 0 && x <= 2; } );
+        check( name_and_var( options.n_flows_counter ), []( auto x ) { return x >= 1; } );
+        check( name_and_var( options.n_lobes_counter ), []( auto x ) { return x >= 1; } );
+    }
+    if( options.topo_mod_flag != 0 )
+    {
+        check(
+            name_and_var( options.accumulate_thickness ), []( auto x ) { return !x; },
+            "accumulate_thickness needs topo_mod_flag = 0, since otherwise the heights are read during the flows" );
+    }
+    check( name_and_var( options.n_threads ), []( auto x ) { return x >= 1; } );
+    check( name_and_var( options.lobe_window ), geq_zero );
+    check( name_and_var( options.parallel_lobe_min_cells ), geq_zero );
+    if( options.n_threads > 1 && options.lobe_window < 2 && options.parallel_lobe_min_cells == 0
+        && options.topo_mod_flag == 2 )
+    {
+        check(
+            name_and_var( options.n_threads ), []( auto x ) { return x == 1; },
+            "Flows can not be emplaced concurrently with topo_mod_flag = 2, since the slope source is refreshed during "
+            "the flows. Use lobe_window or parallel_lobe_min_cells instead" );
+    }
     check( name_and_var( options.aspect_ratio_coeff ), geq_zero );
     check( name_and_var( options.max_aspect_ratio ), g_zero );
+
+    if( options.force_max_length == 1 )
+    {
+        check(
+            name_and_var( options.max_length ), g_zero,
+            "max_length has to be positive if force_max_length = 1, otherwise no lobe can be a parent" );
+    }
+
+    if( options.max_cache_memory_mb.has_value() )
+    {
+        // A budget of zero disables the cache
+        const double max_cache_memory_mb = options.max_cache_memory_mb.value();
+        check( name_and_var( max_cache_memory_mb ), geq_zero );
+    }
+
+    if( options.max_run_time_seconds.has_value() )
+    {
+        const double max_run_time_seconds = options.max_run_time_seconds.value();
+        check( name_and_var( max_run_time_seconds ), g_zero );
+    }
+
+    check( name_and_var( options.preview_factor ), []( auto x ) { return x >= 1; } );
+
+    if( options.slope_cells_per_lobe_radius.has_value() )
+    {
+        const double slope_cells_per_lobe_radius = options.slope_cells_per_lobe_radius.value();
+        check( name_and_var( slope_cells_per_lobe_radius ), g_zero );
+    }
+
+    check( name_and_var( options.convergence_interval ), geq_zero );
+    check( name_and_var( options.convergence_n_checks ), []( auto x ) { return x >= 1; } );
+    if( options.convergence_tolerance.has_value() )
+    {
+        const double convergence_tolerance = options.convergence_tolerance.value();
+        check( name_and_var( convergence_tolerance ), g_zero );
+        check(
+            name_and_var( options.convergence_interval ), g_zero,
+            "convergence_interval has to be positive if convergence_tolerance is set" );
+    }
+
+    check( name_and_var( options.checkpoint_interval ), geq_zero );
+
+    if( options.restart_files.has_value() && options.restart_filling_parameters.has_value() )
+    {
+        const auto n_filling_parameters = options.restart_filling_parameters.value().size();
+        check(
+            name_and_var( n_filling_parameters ),
+            [&]( auto n ) { return n == 0 || n == options.restart_files.value().size(); },
+            "restart_filling_parameters has to be empty or have one entry per restart file" );
+    }
+
+    if( options.inner_source.has_value() )
+    {
+        // The replicas of the concurrent flows, the lobe windows, the row blocks, the checkpoints and the previews
+        // only know the outer grid
+        const std::string explanation = "This is not supported together with inner_source";
+        check( name_and_var( options.n_threads ), []( auto x ) { return x == 1; }, explanation );
+        check( name_and_var( options.lobe_window ), []( auto x ) { return x < 2; }, explanation );
+        check( name_and_var( options.parallel_lobe_min_cells ), []( auto x ) { return x == 0; }, explanation );
+        check( name_and_var( options.checkpoint_interval ), []( auto x ) { return x == 0; }, explanation );
+        check( name_and_var( options.preview_factor ), []( auto x ) { return x == 1; }, explanation );
+        const bool resume_checkpoint = options.resume_checkpoint.has_value();
+        const bool restart_files     = options.restart_files.has_value();
+        check( name_and_var( resume_checkpoint ), []( auto x ) { return !x; }, explanation );
+        check( name_and_var( restart_files ), []( auto x ) { return !x; }, explanation );
+    }
+
+    if( options.synthetic_terrain.has_value() )
+    {
+        const auto & synthetic = options.synthetic_terrain.value();
+        check( name_and_var( synthetic.n_x ), []( auto x ) { return x >= 2; } );
+        check( name_and_var( synthetic.n_y ), []( auto x ) { return x >= 2; } );
+        check( name_and_var( synthetic.cell_size ), g_zero );
+        check( name_and_var( synthetic.fractal_wavelength ), g_zero );
+        check( name_and_var( synthetic.fractal_octaves ), geq_zero );
+        check( name_and_var( synthetic.fractal_roughness ), geq_zero_leq_one );
+        check( name_and_var( synthetic.nodata_fraction ), geq_zero_leq_one );
+        check( name_and_var( synthetic.nodata_hole_radius ), geq_zero );
+        check( name_and_var( synthetic.nodata_hole_spacing ), g_zero );
+    }
 }
 
 } // namespace Flowy::Config
@@ -0,0 +1,177 @@
+#include "convergence_monitor.hpp"
+#include "binary_io.hpp"
+#include <fmt/format.h>
+#include <fmt/os.h>
+#include <algorithm>
+#include <cmath>
+#include <numeric>
+#include <stdexcept>
+
+namespace Flowy
+{
+
+ConvergenceMonitor::ConvergenceMonitor( int n_x, int n_y, std::optional<double> masking_threshold, bool track_hazard )
+        : n_y( n_y ),
+          masking_threshold( masking_threshold ),
+          track_hazard( track_hazard ),
+          is_touched( std::size_t( n_x ) * n_y, 0 )
+{
+}
+
+void ConvergenceMonitor::mark_touched( const Topography::BoundingBox & box )
+{
+    for( int idx_x = box.idx_x_lower; idx_x <= box.idx_x_higher; idx_x++ )
+    {
+        for( int idx_y = box.idx_y_lower; idx_y <= box.idx_y_higher; idx_y++ )
+        {
+            const std::size_t idx = std::size_t( idx_x ) * n_y + idx_y;
+            if( !is_touched[idx] )
+            {
+                is_touched[idx] = 1;
+                touched.push_back( idx );
+            }
+        }
+    }
+}
+
+std::vector<double> ConvergenceMonitor::gather( const MatrixX & field, const MatrixX * subtract ) const
+{
+    std::vector<double> res( touched.size() );
+    for( std::size_t i = 0; i < touched.size(); i++ )
+    {
+        const int idx_x = touched[i] / n_y;
+        const int idx_y = touched[i] % n_y;
+        res[i]          = field( idx_x, idx_y ) - ( subtract != nullptr ? ( *subtract )( idx_x, idx_y ) : 0.0 );
+    }
+    return res;
+}
+
+double ConvergenceMonitor::update_distribution( const std::vector<double> & values, std::vector<double> & prev )
+{
+    const double total = std::accumulate( values.begin(), values.end(), 0.0 );
+    const double scale = total > 0 ? 1.0 / total : 0.0;
+
+    prev.resize( values.size(), 0.0 );
+    double distance = 0;
+    for( std::size_t i = 0; i < values.size(); i++ )
+    {
+        const double p = values[i] * scale;
+        distance += std::abs( p - prev[i] );
+        prev[i] = p;
+    }
+    return distance;
+}
+
+double ConvergenceMonitor::update_footprint( const std::vector<double> & thickness )
+{
+    // The footprint is the smallest set of the thickest cells, which contains masking_threshold of the volume. This is
+    // the same mask as for the '*_masked_*.asc' files
+    std::vector<std::size_t> order( thickness.size() );
+    std::iota( order.begin(), order.end(), 0 );
+    std::sort(
+        order.begin(), order.end(), [&]( std::size_t a, std::size_t b ) { return thickness[a] > thickness[b]; } );
+
+    const double total  = std::accumulate( thickness.begin(), thickness.end(), 0.0 );
+    const double target = masking_threshold.value() * total;
+
+    std::vector<uint8_t> footprint( thickness.size(), 0 );
+    double volume = 0;
+    for( std::size_t i : order )
+    {
+        if( volume >= target || !( thickness[i] > 0 ) )
+        {
+            break;
+        }
+        footprint[i] = 1;
+        volume += thickness[i];
+    }
+
+    footprint_prev.resize( thickness.size(), 0 );
+    std::size_t n_intersection = 0;
+    std::size_t n_union        = 0;
+    for( std::size_t i = 0; i < footprint.size(); i++ )
+    {
+        n_intersection += footprint[i] && footprint_prev[i];
+        n_union += footprint[i] || footprint_prev[i];
+    }
+    footprint_prev = std::move( footprint );
+
+    return n_union > 0 ? 1.0 - double( n_intersection ) / n_union : 0.0;
+}
+
+const ConvergencePoint & ConvergenceMonitor::check(
+    int n_flows, const MatrixX & height, const MatrixX & height_initial, const MatrixX & hazard )
+{
+    ConvergencePoint point{};
+    point.n_flows   = n_flows;
+    point.n_touched = touched.size();
+
+    std::vector<double> thickness = gather( height, &height_initial );
+    if( masking_threshold.has_value() )
+    {
+        point.footprint_change = update_footprint( thickness );
+    }
+    point.thickness_change = update_distribution( thickness, thickness_prev );
+
+    if( track_hazard )
+    {
+        std::vector<double> hazard_values = gather( hazard );
+        point.hazard_change               = update_distribution( hazard_values, hazard_prev );
+    }
+
+    points.push_back( point );
+    return points.back();
+}
+
+bool ConvergenceMonitor::is_converged( double tolerance, int n_checks ) const
+{
+    if( int( points.size() ) < n_checks )
+    {
+        return false;
+    }
+    return std::all_of(
+        points.end() - n_checks, points.end(),
+        [&]( const ConvergencePoint & p )
+        { return std::max( { p.thickness_change, p.hazard_change, p.footprint_change } ) < tolerance; } );
+}
+
+void ConvergenceMonitor::write_csv( const std::filesystem::path & path ) const
+{
+    auto file = fmt::output_file( path.string() );
+    file.print( "n_flows,n_touched,thickness_change,hazard_change,footprint_change\n" );
+    for( const auto & p : points )
+    {
+        file.print(
+            "{},{},{},{},{}\n", p.n_flows, p.n_touched, p.thickness_change, p.hazard_change, p.footprint_change );
+    }
+}
+
+void ConvergenceMonitor::save( std::ostream & os ) const
+{
+    BinaryIO::write_vector( os, touched );
+    BinaryIO::write_vector( os, thickness_prev );
+    BinaryIO::write_vector( os, hazard_prev );
+    BinaryIO::write_vector( os, footprint_prev );
+    BinaryIO::write_vector( os, points );
+}
+
+void ConvergenceMonitor::load( std::istream & is )
+{
+    touched        = BinaryIO::read_vector<std::size_t>( is );
+    thickness_prev = BinaryIO::read_vector<double>( is );
+    hazard_prev    = BinaryIO::read_vector<double>( is );
+    footprint_prev = BinaryIO::read_vector<uint8_t>( is );
+    points         = BinaryIO::read_vector<ConvergencePoint>( is );
+
+    std::fill( is_touched.begin(), is_touched.end(), 0 );
+    for( std::size_t idx : touched )
+    {
+        if( idx >= is_touched.size() )
+        {
+            throw std::runtime_error( "The convergence monitor state does not match the grid" );
+        }
+        is_touched[idx] = 1;
+    }
+}
+
+} // namespace Flowy
@@ -0,0 +1,96 @@
+#include "lobe_store.hpp"
+#include <algorithm>
+
+namespace Flowy
+{
+
+void LobeStore::clear()
+{
+    resize( 0 );
+}
+
+void LobeStore::reserve( int n_lobes )
+{
+    center_x.reserve( n_lobes );
+    center_y.reserve( n_lobes );
+    semi_axis_major.reserve( n_lobes );
+    semi_axis_minor.reserve( n_lobes );
+    azimuthal_angle.reserve( n_lobes );
+    sin_azimuthal_angle.reserve( n_lobes );
+    cos_azimuthal_angle.reserve( n_lobes );
+    idx_parent.reserve( n_lobes );
+    dist_n_lobes.reserve( n_lobes );
+    n_descendents.reserve( n_lobes );
+    parent_weight.reserve( n_lobes );
+    alpha_inertial.reserve( n_lobes );
+    thickness.reserve( n_lobes );
+}
+
+void LobeStore::resize( int n_lobes )
+{
+    const Lobe lobe{};
+    center_x.resize( n_lobes, lobe.center[0] );
+    center_y.resize( n_lobes, lobe.center[1] );
+    semi_axis_major.resize( n_lobes, lobe.semi_axes[0] );
+    semi_axis_minor.resize( n_lobes, lobe.semi_axes[1] );
+    azimuthal_angle.resize( n_lobes, lobe.get_azimuthal_angle() );
+    sin_azimuthal_angle.resize( n_lobes, lobe.get_sin_azimuthal_angle() );
+    cos_azimuthal_angle.resize( n_lobes, lobe.get_cos_azimuthal_angle() );
+    idx_parent.resize( n_lobes, lobe.idx_parent.value_or( -1 ) );
+    dist_n_lobes.resize( n_lobes, lobe.dist_n_lobes );
+    n_descendents.resize( n_lobes, lobe.n_descendents );
+    parent_weight.resize( n_lobes, lobe.parent_weight );
+    alpha_inertial.resize( n_lobes, lobe.alpha_inertial );
+    thickness.resize( n_lobes, lobe.thickness );
+}
+
+void LobeStore::push_back( const Lobe & lobe )
+{
+    center_x.push_back( lobe.center[0] );
+    center_y.push_back( lobe.center[1] );
+    semi_axis_major.push_back( lobe.semi_axes[0] );
+    semi_axis_minor.push_back( lobe.semi_axes[1] );
+    azimuthal_angle.push_back( lobe.get_azimuthal_angle() );
+    sin_azimuthal_angle.push_back( lobe.get_sin_azimuthal_angle() );
+    cos_azimuthal_angle.push_back( lobe.get_cos_azimuthal_angle() );
+    idx_parent.push_back( lobe.idx_parent.value_or( -1 ) );
+    dist_n_lobes.push_back( lobe.dist_n_lobes );
+    n_descendents.push_back( lobe.n_descendents );
+    parent_weight.push_back( lobe.parent_weight );
+    alpha_inertial.push_back( lobe.alpha_inertial );
+    thickness.push_back( lobe.thickness );
+}
+
+Lobe LobeStore::lobe( int idx_lobe ) const
+{
+    Lobe res{};
+    res.center    = { center_x[idx_lobe], center_y[idx_lobe] };
+    res.semi_axes = { semi_axis_major[idx_lobe], semi_axis_minor[idx_lobe] };
+    res.set_azimuthal_angle( azimuthal_angle[idx_lobe], sin_azimuthal_angle[idx_lobe], cos_azimuthal_angle[idx_lobe] );
+    res.dist_n_lobes   = dist_n_lobes[idx_lobe];
+    res.parent_weight  = parent_weight[idx_lobe];
+    res.alpha_inertial = alpha_inertial[idx_lobe];
+    res.n_descendents  = n_descendents[idx_lobe];
+    res.thickness      = thickness[idx_lobe];
+    if( idx_parent[idx_lobe] >= 0 )
+    {
+        res.idx_parent = idx_parent[idx_lobe];
+    }
+    return res;
+}
+
+void LobeStore::compute_cumulative_descendents()
+{
+    std::fill( n_descendents.begin(), n_descendents.end(), 0 );
+
+    for( int idx_lobe = size() - 1; idx_lobe >= 0; idx_lobe-- )
+    {
+        const int idx = idx_parent[idx_lobe];
+        if( idx >= 0 )
+        {
+            n_descendents[idx] += 1 + n_descendents[idx_lobe];
+        }
+    }
+}
+
+} // namespace Flowy
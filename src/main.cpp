@@ -1,6 +1,7 @@
 #include "config_parser.hpp"
 #include "fmt/core.h"
 #include "simulation.hpp"
+#include "stop_signal.hpp"
 
 #include <fmt/format.h>
 #include <fmt/ostream.h>
@@ -16,13 +17,21 @@ int main( int argc, char * argv[] )
 
     program.add_argument( "config_file" ).help( "The config file to be used. Has to be in TOML format." );
     program.add_argument( "-a", "--asc_file" )
-        .help( "The .asc file to be used for the terrain. This overwrites the `source` field in the input.toml file." );
+        .help( "The .asc file to be used for the terrain. This overwrites the `source` field and the [Synthetic] table "
+               "in the input.toml file." );
     program.add_argument( "-n", "--name" )
         .help( "The run_name to be used. This overwrites the `run_name` in the input file and disables the system for "
                "automatically appending numbers to the run_name" );
     program.add_argument( "-o", "--output" )
         .help( fmt::format(
             "Specify the output directory. Defaults to `{}`", Config::InputParams().output_folder.string() ) );
+    program.add_argument( "-r", "--resume" )
+        .help( "Continue the run from a checkpoint file (see `checkpoint_interval`). This overwrites the "
+               "`resume_checkpoint` field in the input file. Use together with `-n` to keep the run_name." );
+    program.add_argument( "-p", "--preview" )
+        .help( "Make a quick preview on the DEM coarsened by this factor, with an estimate of the runtime and the "
+               "memory of the full run. This overwrites the `preview_factor` field in the input file." )
+        .scan<'i', int>();
 
     try
     {
@@ -38,13 +47,16 @@ int main( int argc, char * argv[] )
     std::optional<fs::path> asc_file_path          = program.present<std::string>( "-a" );
     std::optional<std::string> output_dir_path_cli = program.present<std::string>( "-o" );
     std::optional<std::string> run_name            = program.present<std::string>( "-n" );
+    std::optional<fs::path> resume_checkpoint      = program.present<std::string>( "-r" );
+    std::optional<int> preview_factor              = program.present<int>( "-p" );
 
     auto input_params = Config::parse_config( config_file_path );
     validate_settings( input_params );
 
     if( asc_file_path.has_value() )
     {
-        input_params.source = asc_file_path.value();
+        input_params.source            = asc_file_path.value();
+        input_params.synthetic_terrain = std::nullopt;
     }
 
     if( output_dir_path_cli.has_value() )
@@ -52,6 +64,21 @@ int main( int argc, char * argv[] )
         input_params.output_folder = output_dir_path_cli.value();
     }
 
+    if( resume_checkpoint.has_value() )
+    {
+        input_params.resume_checkpoint = resume_checkpoint.value();
+    }
+
+    if( preview_factor.has_value() )
+    {
+        if( preview_factor.value() < 1 )
+        {
+            fmt::print( stderr, "The preview factor has to be at least 1\n" );
+            return 1;
+        }
+        input_params.preview_factor = preview_factor.value();
+    }
+
     // lambda to get the name of the input backup file
     auto get_input_backup_name = [&]() { return fmt::format( "{}_inp.bak", input_params.run_name ); };
 
@@ -101,6 +128,9 @@ int main( int argc, char * argv[] )
     fmt::print( "Output directory path set to: {}\n", input_params.output_folder.string() );
     fmt::print( "run_name = {}\n", input_params.run_name );
     auto simulation = Simulation( input_params, input_params.rng_seed );
+
+    // SIGTERM and SIGINT stop the run after the current flow, and the outputs of the completed flows are written
+    StopSignal::install();
     simulation.run();
     fmt::print( "=================================================================\n" );
 }
\ No newline at end of file
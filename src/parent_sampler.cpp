@@ -0,0 +1,107 @@
+#include "parent_sampler.hpp"
+#include <algorithm>
+#include <bit>
+
+namespace Flowy
+{
+
+ParentSampler::ParentSampler( bool order_by_distance, std::optional<double> max_length )
+        : order_by_distance( order_by_distance ), max_length( max_length )
+{
+}
+
+void ParentSampler::reset( int n_lobes )
+{
+    n_candidates = 0;
+    candidates_by_index.clear();
+
+    if( order_by_distance )
+    {
+        // The distance of a lobe is at most the number of lobes in the flow
+        for( int d = 0; d <= max_distance && d < int( candidates_by_distance.size() ); d++ )
+        {
+            candidates_by_distance[d].clear();
+        }
+        candidates_by_distance.resize( std::max<std::size_t>( candidates_by_distance.size(), n_lobes + 1 ) );
+        fenwick_tree.assign( candidates_by_distance.size() + 1, 0 );
+    }
+    else
+    {
+        candidates_by_index.reserve( n_lobes );
+    }
+
+    max_distance = -1;
+}
+
+void ParentSampler::add_lobe( int idx_lobe, int dist_n_lobes )
+{
+    if( max_length.has_value() && dist_n_lobes >= max_length.value() )
+    {
+        return;
+    }
+
+    n_candidates++;
+
+    if( !order_by_distance )
+    {
+        candidates_by_index.push_back( idx_lobe );
+        return;
+    }
+
+    if( dist_n_lobes >= int( candidates_by_distance.size() ) )
+    {
+        grow( dist_n_lobes + 1 );
+    }
+
+    candidates_by_distance[dist_n_lobes].push_back( idx_lobe );
+    max_distance = std::max( max_distance, dist_n_lobes );
+
+    for( std::size_t i = dist_n_lobes + 1; i < fenwick_tree.size(); i += i & ( ~i + 1 ) )
+    {
+        fenwick_tree[i]++;
+    }
+}
+
+void ParentSampler::grow( std::size_t n_distances )
+{
+    candidates_by_distance.resize( std::max( n_distances, 2 * candidates_by_distance.size() ) );
+
+    // Every node adds its count to the next node covering it
+    fenwick_tree.assign( candidates_by_distance.size() + 1, 0 );
+    for( std::size_t i = 1; i < fenwick_tree.size(); i++ )
+    {
+        fenwick_tree[i] += int( candidates_by_distance[i - 1].size() );
+        const std::size_t j = i + ( i & ( ~i + 1 ) );
+        if( j < fenwick_tree.size() )
+        {
+            fenwick_tree[j] += fenwick_tree[i];
+        }
+    }
+}
+
+int ParentSampler::lobe_at_rank( int rank ) const
+{
+    if( !order_by_distance )
+    {
+        return candidates_by_index[rank];
+    }
+
+    // Descend the Fenwick tree to find the smallest distance, such that the number of candidates with a distance
+    // less or equal to it is larger than rank
+    const std::size_t n = fenwick_tree.size() - 1;
+    std::size_t pos     = 0;
+    int remaining       = rank;
+    for( std::size_t step = std::bit_floor( n ); step > 0; step >>= 1 )
+    {
+        if( pos + step <= n && fenwick_tree[pos + step] <= remaining )
+        {
+            pos += step;
+            remaining -= fenwick_tree[pos];
+        }
+    }
+
+    // pos is the number of distances that were skipped, i.e. the distance of the candidate
+    return candidates_by_distance[pos][remaining];
+}
+
+} // namespace Flowy
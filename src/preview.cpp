@@ -0,0 +1,81 @@
+#include "preview.hpp"
+#include <fmt/format.h>
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+
+namespace Flowy::Preview
+{
+
+namespace
+{
+// Divides a count by the factor, but keeps at least one
+int scale_count( int count, double factor )
+{
+    return std::max<int>( 1, std::lround( count / factor ) );
+}
+} // namespace
+
+Config::InputParams scale_input( const Config::InputParams & input )
+{
+    if( input.resume_checkpoint.has_value() || input.restart_files.has_value() )
+    {
+        throw std::runtime_error( "A preview can not be resumed from a checkpoint or use restart files" );
+    }
+
+    const int f         = input.preview_factor;
+    const double f_area = double( f ) * f;
+
+    Config::InputParams res = input;
+    res.run_name            = fmt::format( "{}_preview", input.run_name );
+
+    res.min_n_lobes = scale_count( input.min_n_lobes, f );
+    res.max_n_lobes = std::max( res.min_n_lobes, scale_count( input.max_n_lobes, f ) );
+    if( input.fixed_dimension_flag == 1 && input.prescribed_lobe_area.has_value() )
+    {
+        res.prescribed_lobe_area = input.prescribed_lobe_area.value() * f_area;
+    }
+    else if( input.prescribed_avg_lobe_thickness.has_value() )
+    {
+        res.prescribed_avg_lobe_thickness = input.prescribed_avg_lobe_thickness.value() / f;
+    }
+
+    // The volume per flow stays the same. The beta law of the number of lobes needs at least two flows
+    res.n_flows = scale_count( input.n_flows, f_area );
+    if( ( input.a_beta != 0 || input.b_beta != 0 ) && input.n_flows >= 2 )
+    {
+        res.n_flows = std::max( res.n_flows, 2 );
+    }
+    if( input.total_volume.has_value() )
+    {
+        res.total_volume = input.total_volume.value() * res.n_flows / input.n_flows;
+    }
+
+    res.n_lobes_counter = scale_count( input.n_lobes_counter, f );
+    res.n_flows_counter = scale_count( input.n_flows_counter, f_area );
+    if( input.convergence_interval > 0 )
+    {
+        res.convergence_interval = scale_count( input.convergence_interval, f_area );
+    }
+    res.checkpoint_interval = 0;
+
+    return res;
+}
+
+PreviewEstimate estimate_full_run(
+    const Config::InputParams & input_full, const Config::InputParams & input_preview, int n_flows_completed,
+    double cell_ratio, double flow_seconds, double output_seconds, std::size_t grid_bytes )
+{
+    const double n_lobes_full    = double( input_full.n_flows ) * ( input_full.min_n_lobes + input_full.max_n_lobes );
+    const double n_lobes_preview = double( std::max( n_flows_completed, 1 ) )
+                                   * ( input_preview.min_n_lobes + input_preview.max_n_lobes );
+
+    PreviewEstimate res{};
+    res.preview_factor = input_preview.preview_factor;
+    res.n_flows_full   = input_full.n_flows;
+    res.seconds        = flow_seconds * n_lobes_full / n_lobes_preview + output_seconds * cell_ratio;
+    res.grid_bytes     = grid_bytes * cell_ratio;
+    return res;
+}
+
+} // namespace Flowy::Preview
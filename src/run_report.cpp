@@ -0,0 +1,404 @@
+#include "run_report.hpp"
+#include "config.hpp"
+#include <fmt/format.h>
+#include <fmt/os.h>
+#include <algorithm>
+#include <cmath>
+#include <optional>
+#include <string>
+#include <vector>
+
+#if defined( _WIN32 )
+#define NOMINMAX
+#include <windows.h>
+#include <psapi.h>
+#else
+#include <sys/resource.h>
+#endif
+
+namespace Flowy
+{
+
+std::string to_string( StopReason reason )
+{
+    switch( reason )
+    {
+        case StopReason::MaxLobes: return "max_lobes";
+        case StopReason::ParentLobe: return "parent_lobe";
+        case StopReason::BuddingPoint: return "budding_point";
+        case StopReason::NewLobeCenter: return "new_lobe_center";
+    }
+    return "unknown";
+}
+
+std::string to_string( RunTermination termination )
+{
+    switch( termination )
+    {
+        case RunTermination::Completed: return "completed";
+        case RunTermination::Converged: return "converged";
+        case RunTermination::TimeBudget: return "time_budget";
+        case RunTermination::Signal: return "signal";
+    }
+    return "unknown";
+}
+
+void RunReport::add_stage_time( const std::string & stage, double wall_seconds, double cpu_seconds )
+{
+    auto it = std::find_if( stages.begin(), stages.end(), [&]( const StageTime & s ) { return s.name == stage; } );
+    if( it == stages.end() )
+    {
+        stages.push_back( { stage } );
+        it = stages.end() - 1;
+    }
+    it->wall_seconds += wall_seconds;
+    it->cpu_seconds += cpu_seconds;
+    it->calls++;
+}
+
+double RunReport::stage_wall_seconds( const std::string & stage ) const
+{
+    auto it = std::find_if( stages.begin(), stages.end(), [&]( const StageTime & s ) { return s.name == stage; } );
+    return it != stages.end() ? it->wall_seconds : 0.0;
+}
+
+void RunReport::add_file_read( const std::filesystem::path & path )
+{
+    std::error_code ec{};
+    files_read.push_back( { path, std::filesystem::file_size( path, ec ) } );
+}
+
+void RunReport::add_file_written( const std::filesystem::path & path )
+{
+    std::error_code ec{};
+    files_written.push_back( { path, std::filesystem::file_size( path, ec ) } );
+}
+
+void RunReport::add_grid( const std::string & name, std::size_t bytes )
+{
+    grids.push_back( { name, bytes } );
+}
+
+void RunReport::add_flow( const FlowStats & flow_stats )
+{
+    flows.push_back( flow_stats );
+}
+
+void RunReport::add_convergence_point( const ConvergencePoint & point )
+{
+    convergence.push_back( point );
+}
+
+std::size_t RunReport::peak_rss_bytes()
+{
+#if defined( _WIN32 )
+    PROCESS_MEMORY_COUNTERS counters{};
+    if( GetProcessMemoryInfo( GetCurrentProcess(), &counters, sizeof( counters ) ) )
+    {
+        return counters.PeakWorkingSetSize;
+    }
+    return 0;
+#else
+    rusage usage{};
+    if( getrusage( RUSAGE_SELF, &usage ) != 0 )
+    {
+        return 0;
+    }
+#if defined( __APPLE__ )
+    return usage.ru_maxrss; // bytes on macOS
+#else
+    return std::size_t( usage.ru_maxrss ) * 1024; // kilobytes on Linux
+#endif
+#endif
+}
+
+namespace
+{
+
+// Helpers to serialize values to JSON
+std::string json( const std::string & s )
+{
+    std::string res = "\"";
+    for( char c : s )
+    {
+        switch( c )
+        {
+            case '"': res += "\\\""; break;
+            case '\\': res += "\\\\"; break;
+            case '\n': res += "\\n"; break;
+            case '\t': res += "\\t"; break;
+            default: res += c;
+        }
+    }
+    return res + "\"";
+}
+
+std::string json( const std::filesystem::path & p )
+{
+    return json( p.string() );
+}
+
+std::string json( bool b )
+{
+    return b ? "true" : "false";
+}
+
+std::string json( int i )
+{
+    return fmt::format( "{}", i );
+}
+
+std::string json( std::size_t i )
+{
+    return fmt::format( "{}", i );
+}
+
+// JSON has no representation of nan and inf
+std::string json( double d )
+{
+    return std::isfinite( d ) ? fmt::format( "{}", d ) : "null";
+}
+
+std::string json( const Vector2 & v )
+{
+    return fmt::format( "[{}, {}]", json( v[0] ), json( v[1] ) );
+}
+
+template<typename T>
+std::string json( const std::vector<T> & vec )
+{
+    std::string res = "[";
+    for( std::size_t i = 0; i < vec.size(); i++ )
+    {
+        res += ( i > 0 ? ", " : "" ) + json( vec[i] );
+    }
+    return res + "]";
+}
+
+template<typename T>
+std::string json( const std::optional<T> & opt )
+{
+    return opt.has_value() ? json( opt.value() ) : "null";
+}
+
+// Writes the members of an object, the first entry of each pair is the key, the second the serialized value
+std::string json_object( const std::vector<std::pair<std::string, std::string>> & members, int indent )
+{
+    const std::string pad( indent + 2, ' ' );
+    std::string res = "{\n";
+    for( std::size_t i = 0; i < members.size(); i++ )
+    {
+        res += fmt::format( "{}{}: {}{}\n", pad, json( members[i].first ), members[i].second,
+                            i + 1 < members.size() ? "," : "" );
+    }
+    return res + std::string( indent, ' ' ) + "}";
+}
+
+std::string json_array( const std::vector<std::string> & elements, int indent )
+{
+    const std::string pad( indent + 2, ' ' );
+    std::string res = "[";
+    for( std::size_t i = 0; i < elements.size(); i++ )
+    {
+        res += fmt::format( "\n{}{}{}", pad, elements[i], i + 1 < elements.size() ? "," : "" );
+    }
+    return res + ( elements.empty() ? "]" : "\n" + std::string( indent, ' ' ) + "]" );
+}
+
+std::string json_synthetic_terrain( const std::optional<SyntheticTerrainParams> & synthetic, int indent )
+{
+    if( !synthetic.has_value() )
+    {
+        return "null";
+    }
+
+    const auto & s = synthetic.value();
+    // clang-format off
+    return json_object( {
+        { "kind", json( to_string( s.kind ) ) },
+        { "n_x", json( s.n_x ) },
+        { "n_y", json( s.n_y ) },
+        { "cell_size", json( s.cell_size ) },
+        { "lower_left_corner", json( s.lower_left_corner ) },
+        { "base_height", json( s.base_height ) },
+        { "slope", json( s.slope ) },
+        { "saddle_curvature", json( s.saddle_curvature ) },
+        { "fractal_amplitude", json( s.fractal_amplitude ) },
+        { "fractal_wavelength", json( s.fractal_wavelength ) },
+        { "fractal_octaves", json( s.fractal_octaves ) },
+        { "fractal_roughness", json( s.fractal_roughness ) },
+        { "nodata_fraction", json( s.nodata_fraction ) },
+        { "nodata_hole_radius", json( s.nodata_hole_radius ) },
+        { "nodata_hole_spacing", json( s.nodata_hole_spacing ) },
+        { "seed", json( std::size_t( s.seed ) ) },
+    }, indent );
+    // clang-format on
+}
+
+std::string json_config( const Config::InputParams & input, int indent )
+{
+    // clang-format off
+    return json_object( {
+        { "output_folder", json( input.output_folder ) },
+        { "write_lobes_csv", json( input.write_lobes_csv ) },
+        { "print_remaining_time", json( input.print_remaining_time ) },
+        { "save_final_dem", json( input.save_final_dem ) },
+        { "rng_seed", json( input.rng_seed ) },
+        { "write_trace", json( input.write_trace ) },
+        { "max_cache_memory_mb", json( input.max_cache_memory_mb ) },
+        { "deferred_lobe_application", json( input.deferred_lobe_application ) },
+        { "accumulate_thickness", json( input.accumulate_thickness ) },
+        { "n_threads", json( input.n_threads ) },
+        { "lobe_window", json( input.lobe_window ) },
+        { "parallel_lobe_min_cells", json( input.parallel_lobe_min_cells ) },
+        { "slope_cells_per_lobe_radius", json( input.slope_cells_per_lobe_radius ) },
+        { "max_run_time_seconds", json( input.max_run_time_seconds ) },
+        { "preview_factor", json( input.preview_factor ) },
+        { "convergence_interval", json( input.convergence_interval ) },
+        { "convergence_tolerance", json( input.convergence_tolerance ) },
+        { "convergence_n_checks", json( input.convergence_n_checks ) },
+        { "checkpoint_interval", json( input.checkpoint_interval ) },
+        { "resume_checkpoint", json( input.resume_checkpoint ) },
+        { "synthetic_terrain", json_synthetic_terrain( input.synthetic_terrain, indent + 2 ) },
+        { "run_name", json( input.run_name ) },
+        { "source", json( input.source ) },
+        { "inner_source", json( input.inner_source ) },
+        { "vent_coordinates", json( input.vent_coordinates ) },
+        { "vent_end_coordinates", json( input.vent_end_coordinates ) },
+        { "save_hazard_data", json( input.save_hazard_data ) },
+        { "n_flows", json( input.n_flows ) },
+        { "n_lobes", json( input.n_lobes ) },
+        { "thickening_parameter", json( input.thickening_parameter ) },
+        { "topo_mod_flag", json( input.topo_mod_flag ) },
+        { "n_flows_counter", json( input.n_flows_counter ) },
+        { "n_lobes_counter", json( input.n_lobes_counter ) },
+        { "lobe_area", json( input.prescribed_lobe_area ) },
+        { "avg_lobe_thickness", json( input.prescribed_avg_lobe_thickness ) },
+        { "masking_threshold", json( input.masking_threshold ) },
+        { "min_n_lobes", json( input.min_n_lobes ) },
+        { "max_n_lobes", json( input.max_n_lobes ) },
+        { "inertial_exponent", json( input.inertial_exponent ) },
+        { "lobe_exponent", json( input.lobe_exponent ) },
+        { "max_slope_prob", json( input.max_slope_prob ) },
+        { "thickness_ratio", json( input.thickness_ratio ) },
+        { "fixed_dimension_flag", json( input.fixed_dimension_flag ) },
+        { "vent_flag", json( input.vent_flag ) },
+        { "fissure_probabilities", json( input.fissure_probabilities ) },
+        { "total_volume", json( input.total_volume ) },
+        { "east_to_vent", json( input.east_to_vent ) },
+        { "west_to_vent", json( input.west_to_vent ) },
+        { "south_to_vent", json( input.south_to_vent ) },
+        { "north_to_vent", json( input.north_to_vent ) },
+        { "npoints", json( input.npoints ) },
+        { "n_init", json( input.n_init ) },
+        { "dist_fact", json( input.dist_fact ) },
+        { "a_beta", json( input.a_beta ) },
+        { "b_beta", json( input.b_beta ) },
+        { "max_aspect_ratio", json( input.max_aspect_ratio ) },
+        { "aspect_ratio_coeff", json( input.aspect_ratio_coeff ) },
+        { "start_from_dist_flag", json( input.start_from_dist_flag ) },
+        { "force_max_length", json( input.force_max_length ) },
+        { "max_length", json( input.max_length ) },
+        { "n_check_loop", json( input.n_check_loop ) },
+        { "restart_files", json( input.restart_files ) },
+        { "restart_filling_parameters", json( input.restart_filling_parameters ) },
+    }, indent );
+    // clang-format on
+}
+
+} // namespace
+
+void RunReport::write(
+    const std::filesystem::path & path, const Config::InputParams & input, int rng_seed, double total_seconds,
+    int n_lobes_processed ) const
+{
+    std::vector<std::string> stages_json{};
+    for( const auto & s : stages )
+    {
+        stages_json.push_back( json_object(
+            { { "name", json( s.name ) },
+              { "wall_seconds", json( s.wall_seconds ) },
+              { "cpu_seconds", json( s.cpu_seconds ) },
+              { "calls", json( s.calls ) } },
+            4 ) );
+    }
+
+    std::vector<std::string> flows_json{};
+    for( const auto & f : flows )
+    {
+        flows_json.push_back( json_object(
+            { { "idx_flow", json( f.idx_flow ) },
+              { "n_lobes_target", json( f.n_lobes_target ) },
+              { "n_lobes_emplaced", json( f.n_lobes_emplaced ) },
+              { "stop_reason", json( to_string( f.stop_reason ) ) },
+              { "n_footprints_uncached", json( f.n_footprints_uncached ) } },
+            4 ) );
+    }
+
+    auto files_json = []( const std::vector<FileIO> & files )
+    {
+        std::vector<std::string> res{};
+        for( const auto & f : files )
+        {
+            res.push_back(
+                json_object( { { "path", json( f.path ) }, { "bytes", json( std::size_t( f.bytes ) ) } }, 4 ) );
+        }
+        return res;
+    };
+
+    std::vector<std::string> convergence_json{};
+    for( const auto & c : convergence )
+    {
+        convergence_json.push_back( json_object(
+            { { "n_flows", json( c.n_flows ) },
+              { "n_touched", json( c.n_touched ) },
+              { "thickness_change", json( c.thickness_change ) },
+              { "hazard_change", json( c.hazard_change ) },
+              { "footprint_change", json( c.footprint_change ) } },
+            4 ) );
+    }
+
+    std::vector<std::string> grids_json{};
+    for( const auto & g : grids )
+    {
+        grids_json.push_back( json_object( { { "name", json( g.name ) }, { "bytes", json( g.bytes ) } }, 4 ) );
+    }
+
+    const double lobes_per_second = total_seconds > 0 ? n_lobes_processed / total_seconds : 0.0;
+
+    std::string preview_json = "null";
+    if( preview.has_value() )
+    {
+        preview_json = json_object(
+            { { "preview_factor", json( preview->preview_factor ) },
+              { "n_flows_full", json( preview->n_flows_full ) },
+              { "estimated_seconds", json( preview->seconds ) },
+              { "estimated_grid_bytes", json( preview->grid_bytes ) } },
+            2 );
+    }
+
+    const std::string report = json_object(
+        { { "run_name", json( input.run_name ) },
+          { "rng_seed", json( rng_seed ) },
+          { "total_seconds", json( total_seconds ) },
+          { "n_lobes_processed", json( n_lobes_processed ) },
+          { "lobes_per_second", json( lobes_per_second ) },
+          { "peak_rss_bytes", json( peak_rss_bytes() ) },
+          { "stages", json_array( stages_json, 2 ) },
+          { "n_flows_completed", json( flows.size() ) },
+          { "termination", json( to_string( termination ) ) },
+          { "n_flows_rerun", json( n_flows_rerun ) },
+          { "preview", preview_json },
+          { "flows", json_array( flows_json, 2 ) },
+          { "convergence", json_array( convergence_json, 2 ) },
+          { "grids", json_array( grids_json, 2 ) },
+          { "files_read", json_array( files_json( files_read ), 2 ) },
+          { "files_written", json_array( files_json( files_written ), 2 ) },
+          { "config", json_config( input, 2 ) } },
+        0 );
+
+    auto file = fmt::output_file( path.string() );
+    file.print( "{}\n", report );
+}
+
+} // namespace Flowy
@@ -0,0 +1,190 @@
+#include "sampling.hpp"
+#include <fmt/format.h>
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+
+namespace Flowy
+{
+
+namespace
+{
+
+constexpr std::uint64_t golden_gamma = 0x9E3779B97F4A7C15ull;
+
+// splitmix64 finalizer
+inline std::uint64_t mix( std::uint64_t z )
+{
+    z = ( z ^ ( z >> 30 ) ) * 0xBF58476D1CE4E5B9ull;
+    z = ( z ^ ( z >> 27 ) ) * 0x94D049BB133111EBull;
+    return z ^ ( z >> 31 );
+}
+
+// Evaluates a polynomial with the coefficients c (constant term first) at x
+template<std::size_t N>
+inline double polynomial( const std::array<double, N> & c, double x )
+{
+    double res = c[N - 1];
+    for( int i = int( N ) - 2; i >= 0; i-- )
+    {
+        res = res * x + c[i];
+    }
+    return res;
+}
+
+} // namespace
+
+RandomStream::RandomStream( std::uint64_t seed, std::uint64_t stream ) : seed( seed )
+{
+    set_stream( stream );
+}
+
+void RandomStream::set_stream( std::uint64_t stream )
+{
+    stream_offset = mix( seed * golden_gamma + mix( stream + golden_gamma ) );
+    counter       = 0;
+    idx_buffer    = buffer_size;
+}
+
+void RandomStream::refill()
+{
+    const std::uint64_t start = stream_offset + counter * buffer_size * golden_gamma;
+    for( int i = 0; i < buffer_size; i++ )
+    {
+        buffer[i] = mix( start + std::uint64_t( i + 1 ) * golden_gamma );
+    }
+    counter++;
+    idx_buffer = 0;
+}
+
+int RandomStream::uniform_int( int a, int b )
+{
+    if( b < a )
+    {
+        throw std::runtime_error( fmt::format( "RandomStream::uniform_int: empty interval [{}, {}]", a, b ) );
+    }
+    const double n = double( b ) - double( a ) + 1.0;
+    return std::min( a + int( n * uniform() ), b );
+}
+
+void RandomStream::fill_uniform( double * out, int n )
+{
+    int i = 0;
+
+    // Use up the numbers which are left in the buffer
+    for( ; i < n && idx_buffer < buffer_size; i++ )
+    {
+        out[i] = uniform();
+    }
+
+    // Whole batches are written directly to out
+    for( ; i + buffer_size <= n; i += buffer_size )
+    {
+        const std::uint64_t start = stream_offset + counter * buffer_size * golden_gamma;
+        for( int j = 0; j < buffer_size; j++ )
+        {
+            out[i + j] = double( mix( start + std::uint64_t( j + 1 ) * golden_gamma ) >> 11 ) * 0x1.0p-53;
+        }
+        counter++;
+    }
+
+    for( ; i < n; i++ )
+    {
+        out[i] = uniform();
+    }
+}
+
+double normal_cdf( double x )
+{
+    return 0.5 * std::erfc( -x / std::sqrt( 2.0 ) );
+}
+
+double inverse_normal_cdf( double p )
+{
+    if( !( p > 0.0 && p < 1.0 ) )
+    {
+        if( p == 0.0 )
+        {
+            return -std::numeric_limits<double>::infinity();
+        }
+        if( p == 1.0 )
+        {
+            return std::numeric_limits<double>::infinity();
+        }
+        throw std::runtime_error( fmt::format( "inverse_normal_cdf: p = {} is not a probability", p ) );
+    }
+
+    // clang-format off
+    static constexpr std::array<double, 8> a = {
+        3.3871328727963666080e0, 1.3314166789178437745e+2, 1.9715909503065514427e+3, 1.3731693765509461125e+4,
+        4.5921953931549871457e+4, 6.7265770927008700853e+4, 3.3430575583588128105e+4, 2.5090809287301226727e+3 };
+    static constexpr std::array<double, 8> b = {
+        1.0, 4.2313330701600911252e+1, 6.8718700749205790830e+2, 5.3941960214247511077e+3,
+        2.1213794301586595867e+4, 3.9307895800092710610e+4, 2.8729085735721942674e+4, 5.2264952788528545610e+3 };
+    static constexpr std::array<double, 8> c = {
+        1.42343711074968357734e0, 4.63033784615654529590e0, 5.76949722146069140550e0, 3.64784832476320460504e0,
+        1.27045825245236838258e0, 2.41780725177450611770e-1, 2.27238449892691845833e-2, 7.74545014278341407640e-4 };
+    static constexpr std::array<double, 8> d = {
+        1.0, 2.05319162663775882187e0, 1.67638483018380384940e0, 6.89767334985100004550e-1,
+        1.48103976427480074590e-1, 1.51986665636164571966e-2, 5.47593808499534494600e-4, 1.05075007164441684324e-9 };
+    static constexpr std::array<double, 8> e = {
+        6.65790464350110377720e0, 5.46378491116411436990e0, 1.78482653991729133580e0, 2.96560571828504891230e-1,
+        2.65321895265761230930e-2, 1.24266094738807843860e-3, 2.71155556874348757815e-5, 2.01033439929228813265e-7 };
+    static constexpr std::array<double, 8> f = {
+        1.0, 5.99832206555887937690e-1, 1.36929880922735805310e-1, 1.48753612908506148525e-2,
+        7.86869131145613259100e-4, 1.84631831751005468180e-5, 1.42151175831644588870e-7, 2.04426310338993978564e-15 };
+    // clang-format on
+
+    const double q = p - 0.5;
+
+    // Central region
+    if( std::abs( q ) <= 0.425 )
+    {
+        const double r = 0.180625 - q * q;
+        return q * polynomial( a, r ) / polynomial( b, r );
+    }
+
+    // Tails
+    double r = std::sqrt( -std::log( q < 0 ? p : 1.0 - p ) );
+    double x{};
+    if( r <= 5.0 )
+    {
+        r -= 1.6;
+        x = polynomial( c, r ) / polynomial( d, r );
+    }
+    else
+    {
+        r -= 5.0;
+        x = polynomial( e, r ) / polynomial( f, r );
+    }
+    return q < 0 ? -x : x;
+}
+
+double truncated_normal( RandomStream & gen, double mu, double sigma, double a, double b )
+{
+    const double alpha = ( a - mu ) / sigma;
+    const double beta  = ( b - mu ) / sigma;
+    const double u     = gen.uniform();
+
+    // The probability p = Phi(x) is uniform in [Phi(alpha), Phi(beta)]. In the upper half, the quantile is computed
+    // from the complement 1 - p, which keeps the full precision in the upper tail
+    const double p_alpha = normal_cdf( alpha );
+    const double p_beta  = normal_cdf( beta );
+    const double p       = p_alpha + u * ( p_beta - p_alpha );
+
+    double x{};
+    if( p <= 0.5 )
+    {
+        x = inverse_normal_cdf( p );
+    }
+    else
+    {
+        const double q_alpha = normal_cdf( -alpha );
+        const double q_beta  = normal_cdf( -beta );
+        x                    = -inverse_normal_cdf( q_alpha - u * ( q_alpha - q_beta ) );
+    }
+
+    return std::clamp( mu + sigma * x, a, b );
+}
+
+} // namespace Flowy
@@ -1,10 +1,19 @@
 #include "simulation.hpp"
+#include "asc_file.hpp"
+#include "binary_io.hpp"
+#include "convergence_monitor.hpp"
 #include "definitions.hpp"
 #include "lobe.hpp"
 #include "math.hpp"
-#include "probability_dist.hpp"
-#include "reservoir_sampling.hpp"
+#include "preview.hpp"
+#include "run_report.hpp"
+#include "sampling.hpp"
+#include "stop_signal.hpp"
+#include "synthetic_terrain.hpp"
+#include "thread_pool.hpp"
 #include "topography.hpp"
+#include "trace.hpp"
+#include "vent_sampler.hpp"
 #include "xtensor/xbuilder.hpp"
 #include "xtensor/xmath.hpp"
 #include "xtensor/xsort.hpp"
@@ -15,8 +24,13 @@
 #include <chrono>
 #include <cmath>
 #include <cstddef>
+#include <cstdint>
+#include <fstream>
+#include <memory>
+#include <optional>
 #include <random>
 #include <stdexcept>
+#include <utility>
 #include <vector>
 
 namespace Flowy
@@ -54,10 +68,23 @@ CommonLobeDimensions::CommonLobeDimensions( const Config::InputParams & input, c
     thickness_min     = 2.0 * input.thickness_ratio / ( input.thickness_ratio + 1.0 ) * avg_lobe_thickness;
 }
 
-Simulation::Simulation( const Config::InputParams & input, std::optional<int> rng_seed ) : input( input )
+Simulation::Simulation( const Config::InputParams & input_params, std::optional<int> rng_seed )
+        : input( input_params.preview_factor > 1 ? Preview::scale_input( input_params ) : input_params )
 {
+    // For a preview, input holds the scaled settings, which are used throughout. The full settings are only kept to
+    // scale the outputs and to estimate the full run
+    if( input_params.preview_factor > 1 )
+    {
+        input_full = input_params;
+    }
+
     this->rng_seed = rng_seed.value_or( std::random_device()() );
-    gen            = std::mt19937( this->rng_seed );
+    gen            = RandomStream( this->rng_seed );
+
+    if( input.write_trace )
+    {
+        Trace::enable();
+    }
 
     // Create output directory
     std::filesystem::create_directories( input.output_folder ); // Create the output directory
@@ -86,98 +113,315 @@ Simulation::Simulation( const Config::InputParams & input, std::optional<int> rn
         crop.y_min = ( *min_y_it )[1] - input.south_to_vent.value();
         crop.y_max = ( *max_y_it )[1] + input.north_to_vent.value();
 
-        asc_file = AscFile( input.source, crop );
+        Trace::Span span( "load_dem" );
+        RunReport::StageTimer timer( report, "load_dem" );
+        asc_file = load_dem( crop );
     }
     else
     {
-        asc_file = AscFile( input.source );
+        Trace::Span span( "load_dem" );
+        RunReport::StageTimer timer( report, "load_dem" );
+        asc_file = load_dem( std::nullopt );
+    }
+
+    if( input_full.has_value() )
+    {
+        Trace::Span span( "resample_dem" );
+        RunReport::StageTimer timer( report, "resample_dem" );
+        n_cells_full = asc_file.height_data.size();
+        asc_file     = asc_file.resample( input.preview_factor );
+        fmt::print(
+            "Preview: the DEM is resampled to {} m cells, {} of {} flows are emplaced\n", asc_file.cell_size,
+            input.n_flows, input_params.n_flows );
     }
 
     topography      = Topography( asc_file );
     lobe_dimensions = CommonLobeDimensions( input, asc_file );
 
+    if( input.inner_source.has_value() )
+    {
+        Trace::Span span( "load_inner_dem" );
+        RunReport::StageTimer timer( report, "load_inner_dem" );
+        topography.set_inner_grid( load_inner_dem() );
+        fmt::print(
+            "Inner grid with {} m cells: {} x {} cells\n", topography.inner_grid().cell_size(),
+            topography.inner_grid().geometry().n_x, topography.inner_grid().geometry().n_y );
+    }
+
+    std::optional<double> max_length{};
+    if( input.force_max_length == 1 )
+    {
+        max_length = input.max_length;
+    }
+    parent_sampler = ParentSampler( input.start_from_dist_flag == 1, max_length );
+
+    vent_sampler = VentSampler( input );
+
+    // The thickness of previous flows becomes part of the initial topography
+    if( input.restart_files.has_value() )
+    {
+        Trace::Span span( "restart_files", "io" );
+        RunReport::StageTimer timer( report, "restart_files" );
+        add_restart_files();
+    }
+
     // Make a copy of the initial topography
     topography_initial = topography;
 };
 
-std::optional<std::vector<double>> Simulation::compute_cumulative_fissure_length()
+Simulation::Simulation( const Simulation & simulation, Topography && worker_topography )
+        : input( simulation.input ),
+          topography( std::move( worker_topography ) ),
+          lobe_dimensions( simulation.lobe_dimensions ),
+          input_full( simulation.input_full ),
+          n_cells_full( simulation.n_cells_full ),
+          parent_sampler( simulation.parent_sampler ),
+          vent_sampler( simulation.vent_sampler ),
+          rng_seed( simulation.rng_seed ),
+          gen( simulation.gen ),
+          n_cache_shares( simulation.n_cache_shares )
 {
+}
 
-    auto lengths = std::vector<double>{};
-    lengths.reserve( input.n_vents() );
-    lengths.push_back( 0.0 );
-    int n_vents = input.n_vents();
+void Simulation::add_restart_files()
+{
+    const auto & restart_files   = input.restart_files.value();
+    const auto filling_parameter = input.restart_filling_parameters.value_or( std::vector<double>{} );
+    const GridGeometry & grid    = topography.geometry();
 
-    for( int ivent = 1; ivent < n_vents; ivent++ )
+    std::vector<double> row{};
+    for( std::size_t idx_file = 0; idx_file < restart_files.size(); idx_file++ )
     {
-        Vector2 delta_vent = input.vent_coordinates[ivent] - input.vent_coordinates[ivent - 1];
-        lengths.push_back(
-            lengths[ivent - 1] + std::sqrt( delta_vent[0] * delta_vent[0] + delta_vent[1] * delta_vent[1] ) );
-    }
+        // The files are read row by row and added directly to the topography, without loading them as a whole
+        auto reader                 = AscRowReader( restart_files[idx_file] );
+        const AscHeader & header    = reader.header();
+        const double filling_factor = idx_file < filling_parameter.size() ? filling_parameter[idx_file] : 1.0;
+
+        // The grid of the restart file can be larger or smaller (e.g. cropped differently), but it has to have the same
+        // cell size and be aligned with the topography
+        const double offset_x  = ( header.lower_left_corner[0] - grid.origin[0] ) * grid.inv_cell_size;
+        const double offset_y  = ( header.lower_left_corner[1] - grid.origin[1] ) * grid.inv_cell_size;
+        const int idx_offset_x = std::lround( offset_x );
+        const int idx_offset_y = std::lround( offset_y );
+
+        const bool is_aligned
+            = std::abs( offset_x - idx_offset_x ) < 1e-3 && std::abs( offset_y - idx_offset_y ) < 1e-3;
+        const bool is_same_size = std::abs( header.cell_size - grid.cell_size ) <= 1e-9 * grid.cell_size;
+        if( !is_aligned || !is_same_size )
+        {
+            throw std::runtime_error( fmt::format(
+                "The grid of the restart file '{}' (cell size {}, lower left corner {}) is not aligned with the grid "
+                "of the topography (cell size {}, lower left corner {})",
+                restart_files[idx_file].string(), header.cell_size, header.lower_left_corner, grid.cell_size,
+                grid.origin ) );
+        }
 
-    if( lengths.size() > 1 )
-    {
-        for( int ivent = 0; ivent < n_vents; ivent++ )
+        while( const auto idx_row = reader.next_row( row ) )
         {
-            lengths[ivent] /= lengths[n_vents - 1];
+            const int idx_y = idx_row.value() + idx_offset_y;
+            if( idx_y < 0 || idx_y >= grid.n_y )
+            {
+                continue;
+            }
+
+            for( int idx_col = 0; idx_col < header.n_cols; idx_col++ )
+            {
+                const int idx_x = idx_col + idx_offset_x;
+                if( idx_x < 0 || idx_x >= grid.n_x || row[idx_col] == header.no_data_value
+                    || topography.height_data( idx_x, idx_y ) <= asc_file.no_data_value )
+                {
+                    continue;
+                }
+                topography.height_data( idx_x, idx_y ) += filling_factor * row[idx_col];
+            }
         }
-        return lengths;
+        report.add_file_read( restart_files[idx_file] );
     }
-    else
+}
+
+namespace
+{
+// 0 without a slope source, 1 for a slope source of its own and 2 for a shared one
+uint8_t slope_source_mode( const Topography & topography )
+{
+    if( !topography.has_slope_source() )
     {
-        return std::nullopt;
+        return 0;
     }
+    return topography.is_slope_source_shared() ? 2 : 1;
 }
 
-void Simulation::compute_initial_lobe_position( int idx_flow, Lobe & lobe )
+constexpr char checkpoint_magic[8]    = { 'F', 'L', 'O', 'W', 'Y', 'C', 'K', 'P' };
+constexpr uint32_t checkpoint_version = 4;
+} // namespace
+
+void Simulation::write_checkpoint( const std::filesystem::path & path )
+{
+    Trace::Span span( "write_checkpoint", "io" );
+    RunReport::StageTimer timer( report, "checkpoint" );
+
+    // The checkpoint is written to a temporary file first, which only replaces the previous checkpoint once it is
+    // complete. Like this, a checkpoint is never left half written, if the process is killed
+    topography.apply_accumulated_thickness();
+
+    auto path_tmp = path;
+    path_tmp += ".tmp";
+
+    std::ofstream file( path_tmp, std::ios::binary | std::ios::trunc );
+    if( !file.is_open() )
+    {
+        throw std::runtime_error( fmt::format( "Unable to create checkpoint file: '{}'", path_tmp.string() ) );
+    }
+
+    BinaryIO::write_array( file, checkpoint_magic, sizeof( checkpoint_magic ) );
+    BinaryIO::write( file, checkpoint_version );
+    BinaryIO::write<int32_t>( file, rng_seed );
+    BinaryIO::write<int32_t>( file, input.n_flows );
+    BinaryIO::write<int32_t>( file, n_flows_completed );
+    BinaryIO::write<uint64_t>( file, topography.height_data.shape()[0] );
+    BinaryIO::write<uint64_t>( file, topography.height_data.shape()[1] );
+    BinaryIO::write_array( file, topography.height_data.data(), topography.height_data.size() );
+    BinaryIO::write_array( file, topography.hazard.data(), topography.hazard.size() );
+    BinaryIO::write_vector( file, report.flows );
+    BinaryIO::write<uint8_t>( file, convergence_monitor.has_value() );
+    if( convergence_monitor.has_value() )
+    {
+        convergence_monitor->save( file );
+    }
+    // A shared slope source is the initial topography, which is not part of the checkpoint
+    BinaryIO::write<uint8_t>( file, slope_source_mode( topography ) );
+    if( slope_source_mode( topography ) == 1 )
+    {
+        BinaryIO::write_array( file, topography.slope_source().data(), topography.slope_source().size() );
+        BinaryIO::write<int32_t>( file, n_lobes_since_slope_refresh );
+    }
+
+    file.close();
+    if( !file )
+    {
+        throw std::runtime_error( fmt::format( "Unable to write checkpoint file: '{}'", path_tmp.string() ) );
+    }
+    std::filesystem::rename( path_tmp, path );
+}
+
+void Simulation::read_checkpoint( const std::filesystem::path & path )
 {
-    // Initial lobes are on the vent and flow starts from the first vent, second vent and so on
-    if( input.vent_flag == 0 )
+    Trace::Span span( "read_checkpoint", "io" );
+    RunReport::StageTimer timer( report, "checkpoint" );
+
+    std::ifstream file( path, std::ios::binary );
+    if( !file.is_open() )
     {
-        int idx_vent = std::floor( idx_flow * input.n_vents() / input.n_flows );
-        lobe.center  = input.vent_coordinates[idx_vent];
+        throw std::runtime_error( fmt::format( "Unable to open checkpoint file: '{}'", path.string() ) );
     }
-    else if( input.vent_flag == 2 )
+
+    char magic[sizeof( checkpoint_magic )] = {};
+    BinaryIO::read_array( file, magic, sizeof( magic ) );
+    const auto version = BinaryIO::read<uint32_t>( file );
+    if( !std::equal( magic, magic + sizeof( magic ), checkpoint_magic ) || version != checkpoint_version )
     {
-        auto cumulative_fissure_lens = compute_cumulative_fissure_length();
+        throw std::runtime_error( fmt::format( "'{}' is not a checkpoint of this version of flowy", path.string() ) );
+    }
 
-        // You must have at least two vents.
-        if( !cumulative_fissure_lens.has_value() )
-        {
-            throw std::runtime_error(
-                fmt::format( "You must have more than one vent to use vent_flag={}", input.vent_flag ) );
-        }
+    const int checkpoint_rng_seed          = BinaryIO::read<int32_t>( file );
+    const int checkpoint_n_flows           = BinaryIO::read<int32_t>( file );
+    const int checkpoint_n_flows_completed = BinaryIO::read<int32_t>( file );
+    const auto n_x                         = BinaryIO::read<uint64_t>( file );
+    const auto n_y                         = BinaryIO::read<uint64_t>( file );
 
-        // Find a random point on the polyline.
-        std::uniform_real_distribution<double> dist( 0.0, 1.0 );
-        double cum_dist = dist( gen );
-        // cumulative_fissure_len is sorted.
-        auto it = std::lower_bound(
-            cumulative_fissure_lens.value().begin(), cumulative_fissure_lens.value().end(), cum_dist );
-        // if (it == cumulative_fissure_lens.value().begin()){
-        //     lobe.center  = input.vent_coordinates[0];
-        //     return;
-        // }
-        size_t x_vent_index = it - cumulative_fissure_lens.value().begin();
-
-        auto diff_from_prev_vent = cum_dist - cumulative_fissure_lens.value()[x_vent_index - 1];
-
-        double diff_between_vents
-            = cumulative_fissure_lens.value()[x_vent_index] - cumulative_fissure_lens.value()[x_vent_index - 1];
-        double alpha_segment = diff_from_prev_vent / diff_between_vents;
-        double x             = alpha_segment * input.vent_coordinates[x_vent_index][0]
-                   + ( 1.0 - alpha_segment ) * input.vent_coordinates[x_vent_index - 1][0];
-        double y = alpha_segment * input.vent_coordinates[x_vent_index][1]
-                   + ( 1.0 - alpha_segment ) * input.vent_coordinates[x_vent_index - 1][1];
-        lobe.center = { x, y };
+    if( checkpoint_n_flows != input.n_flows )
+    {
+        throw std::runtime_error( fmt::format(
+            "The checkpoint '{}' was written by a run with n_flows = {}, but n_flows = {}", path.string(),
+            checkpoint_n_flows, input.n_flows ) );
     }
-    else
+    if( n_x != topography.height_data.shape()[0] || n_y != topography.height_data.shape()[1] )
     {
-        throw std::runtime_error( fmt::format( "Not implemented vent_flag={}", input.vent_flag ) );
+        throw std::runtime_error( fmt::format(
+            "The checkpoint '{}' has a grid of {}x{} cells, but the topography has {}x{}", path.string(), n_x, n_y,
+            topography.height_data.shape()[0], topography.height_data.shape()[1] ) );
     }
+
+    // The random numbers of a flow only depend on the seed and the index of the flow, so continuing with the seed of
+    // the checkpoint gives the same flows as an uninterrupted run
+    if( checkpoint_rng_seed != rng_seed )
+    {
+        fmt::print( "Using the RNG seed of the checkpoint: {}\n", checkpoint_rng_seed );
+        rng_seed = checkpoint_rng_seed;
+        gen      = RandomStream( rng_seed );
+    }
+
+    n_flows_completed = checkpoint_n_flows_completed;
+    BinaryIO::read_array( file, topography.height_data.data(), topography.height_data.size() );
+    BinaryIO::read_array( file, topography.hazard.data(), topography.hazard.size() );
+    report.flows = BinaryIO::read_vector<FlowStats>( file );
+
+    const bool has_monitor = BinaryIO::read<uint8_t>( file );
+    if( has_monitor != convergence_monitor.has_value() )
+    {
+        throw std::runtime_error( fmt::format(
+            "The convergence monitor settings of the checkpoint '{}' differ from the current ones", path.string() ) );
+    }
+    if( convergence_monitor.has_value() )
+    {
+        convergence_monitor->load( file );
+        report.convergence = convergence_monitor->curve();
+    }
+
+    // The slope source lags behind the topography, so it cannot be recomputed from it
+    const uint8_t mode = BinaryIO::read<uint8_t>( file );
+    if( mode != slope_source_mode( topography ) )
+    {
+        throw std::runtime_error( fmt::format(
+            "The topo_mod_flag setting of the checkpoint '{}' differs from the current one", path.string() ) );
+    }
+    if( mode == 1 )
+    {
+        MatrixX slope_source = xt::zeros_like( topography.height_data );
+        BinaryIO::read_array( file, slope_source.data(), slope_source.size() );
+        topography.set_slope_source( slope_source );
+        n_lobes_since_slope_refresh = BinaryIO::read<int32_t>( file );
+    }
+
+    report.add_file_read( path );
+}
+
+AscFile Simulation::load_dem( std::optional<AscCrop> crop )
+{
+    if( input.synthetic_terrain.has_value() )
+    {
+        return make_synthetic_terrain( input.synthetic_terrain.value(), crop );
+    }
+
+    auto res = AscFile( input.source, crop );
+    report.add_file_read( input.source );
+    return res;
 }
 
-void Simulation::write_lobe_data_to_file( const std::vector<Lobe> & lobes, const std::filesystem::path & path )
+AscFile Simulation::load_inner_dem()
+{
+    const auto & path            = input.inner_source.value();
+    const double inner_cell_size = AscRowReader( path ).header().cell_size;
+
+    // A crop keeps all cells which overlap its bounds, so the bounds are moved in by one cell of the inner grid
+    const GridGeometry & grid = topography.geometry();
+    AscCrop crop{};
+    crop.x_min = grid.origin[0] + inner_cell_size;
+    crop.x_max = grid.upper_corner[0] - inner_cell_size;
+    crop.y_min = grid.origin[1] + inner_cell_size;
+    crop.y_max = grid.upper_corner[1] - inner_cell_size;
+
+    auto res = AscFile( path, crop );
+    report.add_file_read( path );
+    return res;
+}
+
+void Simulation::compute_initial_lobe_position( int idx_flow, Lobe & lobe )
+{
+    lobe.center = vent_sampler.sample( idx_flow, gen );
+}
+
+void Simulation::write_lobe_data_to_file( const LobeStore & lobes, const std::filesystem::path & path )
 {
     std::fstream file;
     file.open( path, std::fstream::in | std::fstream::out | std::fstream::trunc );
@@ -190,21 +434,21 @@ void Simulation::write_lobe_data_to_file( const std::vector<Lobe> & lobes, const
     file << fmt::format( "azimuthal_angle,centerx,centery,major_axis,minor_axis,dist_n_lobes,parent_weight,"
                          "n_descendents,idx_parent,alpha_intertial,thickness,height_center,slopex,slopey\n" );
 
-    for( const auto & lobe : lobes )
-    {
-        file << fmt::format( "{},", lobe.get_azimuthal_angle() );
-        file << fmt::format( "{},", lobe.center( 0 ) );
-        file << fmt::format( "{},", lobe.center( 1 ) );
-        file << fmt::format( "{},", lobe.semi_axes( 0 ) );
-        file << fmt::format( "{},", lobe.semi_axes( 1 ) );
-        file << fmt::format( "{},", lobe.dist_n_lobes );
-        file << fmt::format( "{},", lobe.parent_weight );
-        file << fmt::format( "{},", lobe.n_descendents );
-        file << fmt::format( "{},", lobe.idx_parent.value_or( -1 ) );
-        file << fmt::format( "{},", lobe.alpha_inertial );
-        file << fmt::format( "{},", lobe.thickness );
-
-        auto const [height, slope] = topography.height_and_slope( lobe.center );
+    for( int idx = 0; idx < lobes.size(); idx++ )
+    {
+        file << fmt::format( "{},", lobes.azimuthal_angle[idx] );
+        file << fmt::format( "{},", lobes.center_x[idx] );
+        file << fmt::format( "{},", lobes.center_y[idx] );
+        file << fmt::format( "{},", lobes.semi_axis_major[idx] );
+        file << fmt::format( "{},", lobes.semi_axis_minor[idx] );
+        file << fmt::format( "{},", lobes.dist_n_lobes[idx] );
+        file << fmt::format( "{},", lobes.parent_weight[idx] );
+        file << fmt::format( "{},", lobes.n_descendents[idx] );
+        file << fmt::format( "{},", lobes.idx_parent[idx] );
+        file << fmt::format( "{},", lobes.alpha_inertial[idx] );
+        file << fmt::format( "{},", lobes.thickness[idx] );
+
+        auto const [height, slope] = topography.height_and_slope( { lobes.center_x[idx], lobes.center_y[idx] } );
         file << fmt::format( "{},", height );
         file << fmt::format( "{},", slope[0] );
         file << fmt::format( "{}", slope[1] );
@@ -213,36 +457,41 @@ void Simulation::write_lobe_data_to_file( const std::vector<Lobe> & lobes, const
     file.close();
 }
 
+template<AnglePolicy policy>
 void Simulation::perturb_lobe_angle( Lobe & lobe, const Vector2 & slope )
 {
-    lobe.set_azimuthal_angle( std::atan2( slope[1], slope[0] ) ); // Sets the angle prior to perturbation
-    const double slope_norm = xt::linalg::norm( slope, 2 );       // Similar to np.linalg.norm
+    const double angle      = std::atan2( slope[1], slope[0] ); // The angle prior to perturbation
+    const double slope_norm = norm( slope );
     const double slope_deg  = std::atan( slope_norm );
 
-    if( input.max_slope_prob < 1 )
+    // With AnglePolicy::TruncatedNormal, 0 < max_slope_prob < 1 is known at compile time
+    constexpr bool runtime = policy == AnglePolicy::Runtime;
+
+    if( runtime && input.max_slope_prob >= 1 )
     {
-        if( slope_deg > 0.0 && input.max_slope_prob > 0 )
-        {
-            // Since we use radians instead of degrees, max_slope_prob has to be rescaled accordingly
-            const double sigma = ( 1.0 - input.max_slope_prob ) / input.max_slope_prob * Math::pi / 180
-                                 * ( Math::pi / 2.0 - slope_deg ) / slope_deg;
+        lobe.set_azimuthal_angle( angle );
+        return;
+    }
 
-            ProbabilityDist::truncated_normal_distribution<double> dist_truncated( 0, sigma, -Math::pi, Math::pi );
-            const double angle_perturbation = dist_truncated( gen );
-            lobe.set_azimuthal_angle( lobe.get_azimuthal_angle() + angle_perturbation );
-        }
-        else
-        {
-            std::uniform_real_distribution<double> dist_uniform( -Math::pi / 2, Math::pi / 2 );
-            const double angle_perturbation = dist_uniform( gen );
-            lobe.set_azimuthal_angle( lobe.get_azimuthal_angle() + angle_perturbation );
-        }
+    if( slope_deg > 0.0 && ( !runtime || input.max_slope_prob > 0 ) )
+    {
+        // Since we use radians instead of degrees, max_slope_prob has to be rescaled accordingly
+        const double sigma = ( 1.0 - input.max_slope_prob ) / input.max_slope_prob * Math::pi / 180
+                             * ( Math::pi / 2.0 - slope_deg ) / slope_deg;
+
+        const double angle_perturbation = truncated_normal( gen, 0, sigma, -Math::pi, Math::pi );
+        lobe.set_azimuthal_angle( angle + angle_perturbation );
+    }
+    else
+    {
+        const double angle_perturbation = gen.uniform( -Math::pi / 2, Math::pi / 2 );
+        lobe.set_azimuthal_angle( angle + angle_perturbation );
     }
 }
 
 void Simulation::compute_lobe_axes( Lobe & lobe, const Vector2 & slope ) const
 {
-    const double slope_norm = xt::linalg::norm( slope, 2 );
+    const double slope_norm = norm( slope );
 
     // Factor for the lobe eccentricity
     double aspect_ratio = std::min( input.max_aspect_ratio, 1.0 + input.aspect_ratio_coeff * slope_norm );
@@ -255,77 +504,72 @@ void Simulation::compute_lobe_axes( Lobe & lobe, const Vector2 & slope ) const
 }
 
 // Select which lobe amongst the existing lobes will be the parent for the new descendent lobe
-int Simulation::select_parent_lobe( int idx_descendant )
+template<ParentPolicy policy>
+int Simulation::select_parent_lobe( int idx_descendant, Lobe & lobe_descendent )
 {
-    Lobe & lobe_descendent = lobes[idx_descendant];
-
     int idx_parent{};
 
-    // TODO: force max length
     // Generate from the last lobe
-    if( input.lobe_exponent <= 0 )
+    auto last = [&]() { return idx_descendant - 1; };
+
+    // The power law of lobe_exponent is applied to the lobe index
+    auto power_law = [&]()
     {
-        idx_parent = idx_descendant - 1;
+        const double idx0 = gen.uniform();
+        const auto idx1   = std::pow( idx0, input.lobe_exponent );
+        return int( idx_descendant * idx1 );
+    };
+
+    if constexpr( policy == ParentPolicy::Last )
+    {
+        idx_parent = last();
+    }
+    else if constexpr( policy == ParentPolicy::PowerLaw )
+    {
+        idx_parent = power_law();
+    }
+    else if( uses_parent_sampler() )
+    {
+        // The power law is applied to the rank of the candidates (ordered by index or by distance to the vent),
+        // lobe_exponent = 0 selects the last candidate and lobe_exponent = 1 gives a uniform distribution
+        const double idx1      = std::pow( gen.uniform(), input.lobe_exponent );
+        const int n_candidates = parent_sampler.size();
+        const int rank         = std::min( int( n_candidates * idx1 ), n_candidates - 1 );
+        idx_parent             = parent_sampler.lobe_at_rank( rank );
+    }
+    else if( input.lobe_exponent <= 0 )
+    {
+        idx_parent = last();
     }
     else if( input.lobe_exponent >= 1 ) // Draw from a uniform random distribution if exponent is 1
     {
-        std::uniform_int_distribution<int> dist_int( 0, idx_descendant - 1 );
-        idx_parent = dist_int( gen );
+        idx_parent = gen.uniform_int( 0, idx_descendant - 1 );
     }
     else
     {
-        std::uniform_real_distribution<double> dist( 0, 1 );
-        const double idx0 = dist( gen );
-        const auto idx1   = std::pow( idx0, input.lobe_exponent );
-        idx_parent        = idx_descendant * idx1;
+        idx_parent = power_law();
     }
 
     // Update the lobe information
     lobe_descendent.idx_parent   = idx_parent;
-    lobe_descendent.dist_n_lobes = lobes[idx_parent].dist_n_lobes + 1;
+    lobe_descendent.dist_n_lobes = lobes.dist_n_lobes[idx_parent] + 1;
     lobe_descendent.parent_weight *= lobe_dimensions.exp_lobe_exponent;
 
     return idx_parent;
 }
 
-// Depth first search to compute cumulative descendents
-// TODO for flows with a very large number of lobes, the recursion might become a problem
-// It would be better to write a recrusion free version of this function.
-int dfs( int lobe_idx, std::vector<Lobe> & lobes, std::vector<std::vector<int>> & child_node_list )
+void Simulation::add_parent_candidate( int idx_lobe )
 {
-    int total_descendants = 0;
-    auto & child_nodes    = child_node_list[lobe_idx];
-    for( int child : child_nodes )
+    if( uses_parent_sampler() )
     {
-        total_descendants += 1 + dfs( child, lobes, child_node_list );
-    }
-    lobes[lobe_idx].n_descendents = total_descendants;
-    return total_descendants;
-}
-
-void Simulation::compute_cumulative_descendents( std::vector<Lobe> & lobes ) const
-{
-    // First we invert the parent-child relationship by recording a list of child node indices for each lobe
-    std::vector<std::vector<int>> child_node_list( lobes.size() );
-    for( size_t i_lobe = 0; i_lobe < lobes.size(); i_lobe++ )
-    {
-        const Lobe & cur_lobe = lobes[i_lobe];
-        if( cur_lobe.idx_parent.has_value() )
-        {
-            child_node_list[cur_lobe.idx_parent.value()].push_back( i_lobe );
-        }
-    }
-
-    // Then, we have to start a depth first search separately on each root
-    for( int i_root = 0; i_root < input.n_init; i_root++ )
-    {
-        dfs( i_root, lobes, child_node_list );
+        parent_sampler.add_lobe( idx_lobe, lobes.dist_n_lobes[idx_lobe] );
     }
 }
 
+template<InertiaPolicy policy>
 void Simulation::add_inertial_contribution( Lobe & lobe, const Lobe & parent, const Vector2 & slope ) const
 {
-    const double slope_norm = xt::linalg::norm( slope, 2 );
+    const double slope_norm = norm( slope );
     double cos_angle_parent = parent.get_cos_azimuthal_angle();
     double sin_angle_parent = parent.get_sin_azimuthal_angle();
     double cos_angle_lobe   = lobe.get_cos_azimuthal_angle();
@@ -334,7 +578,7 @@ void Simulation::add_inertial_contribution( Lobe & lobe, const Lobe & parent, co
     double alpha_inertial = 0.0;
 
     const double eta = input.inertial_exponent;
-    if( eta > 0 )
+    if( policy == InertiaPolicy::Inertial || eta > 0 )
     {
         alpha_inertial = std::pow( ( 1.0 - std::pow( 2.0 * std::atan( slope_norm ) / Math::pi, eta ) ), ( 1.0 / eta ) );
     }
@@ -343,20 +587,56 @@ void Simulation::add_inertial_contribution( Lobe & lobe, const Lobe & parent, co
     const double y_avg = ( 1.0 - alpha_inertial ) * sin_angle_lobe + alpha_inertial * sin_angle_parent;
 
     lobe.set_azimuthal_angle( std::atan2( y_avg, x_avg ) );
+    lobe.alpha_inertial = alpha_inertial;
 }
 
 void Simulation::compute_descendent_lobe_position( Lobe & lobe, const Lobe & parent, Vector2 final_budding_point )
 {
-    Vector2 direction_to_new_lobe
-        = ( final_budding_point - parent.center ) / xt::linalg::norm( final_budding_point - parent.center );
-    Vector2 new_lobe_center = final_budding_point + input.dist_fact * direction_to_new_lobe * lobe.semi_axes[0];
-    lobe.center             = new_lobe_center;
+    const Vector2 delta           = final_budding_point - parent.center;
+    Vector2 direction_to_new_lobe = delta / norm( delta );
+    Vector2 new_lobe_center       = final_budding_point + input.dist_fact * direction_to_new_lobe * lobe.semi_axes[0];
+    lobe.center                   = new_lobe_center;
 }
 
 bool Simulation::stop_condition( const Vector2 & point, double radius )
 {
-    return topography.is_point_near_boundary( point, radius )
-           || topography.get_height( point ) <= asc_file.no_data_value;
+    // The distance to the edges and to the no data cells of the initial topography is precomputed, so this also
+    // catches no data cells within the radius and not only below the point itself
+    return topography.is_point_near_invalid( point, radius );
+}
+
+void Simulation::write_inner_grid_files( double output_scale )
+{
+    Topography & inner         = topography.inner_grid();
+    Topography & inner_initial = topography_initial.inner_grid();
+
+    auto asc_file = inner_initial.to_asc_file();
+    write_asc_file(
+        asc_file, input.output_folder / fmt::format( "{}_DEM_inner.asc", input.run_name ), "write_DEM_inner" );
+
+    asc_file = inner.to_asc_file();
+    if( input.save_final_dem )
+    {
+        write_asc_file(
+            asc_file, input.output_folder / fmt::format( "{}_DEM_final_inner.asc", input.run_name ),
+            "write_DEM_final_inner" );
+    }
+
+    asc_file.height_data   = ( asc_file.height_data - inner_initial.height_data ) * output_scale;
+    asc_file.no_data_value = 0;
+    write_asc_file(
+        asc_file, input.output_folder / fmt::format( "{}_thickness_full_inner.asc", input.run_name ),
+        "write_thickness_full_inner" );
+
+    if( input.save_hazard_data )
+    {
+        asc_file               = inner.to_asc_file( Topography::Output::Hazard );
+        asc_file.height_data   = asc_file.height_data * output_scale;
+        asc_file.no_data_value = 0;
+        write_asc_file(
+            asc_file, input.output_folder / fmt::format( "{}_hazard_full_inner.asc", input.run_name ),
+            "write_hazard_full_inner" );
+    }
 }
 
 void Simulation::write_avg_thickness_file()
@@ -371,6 +651,8 @@ void Simulation::write_avg_thickness_file()
         throw std::runtime_error( fmt::format( "Unable to create file: '{}'", path.string() ) );
     }
 
+    Trace::Span span_totals( "avg_thickness.totals" );
+
     double total_flow   = xt::sum<double>( topography_thickness.height_data )();
     int n_flow_non_zero = xt::count_nonzero( topography_thickness.height_data )();
 
@@ -382,6 +664,16 @@ void Simulation::write_avg_thickness_file()
     file << fmt::format( "Total volume = {} m3\n", volume );
     file << fmt::format( "Total area = {} m2\n", area );
     file << fmt::format( "Average thickness full = {} m\n", avg_thickness );
+    if( output_scale() != 1.0 )
+    {
+        // The thickness was scaled up to the estimate for all flows, see run()
+        file << fmt::format(
+            "Completed flows = {} of {} (outputs scaled by {})\n", n_flows_completed, n_flows_full(),
+            output_scale() );
+    }
+    span_totals.end();
+
+    Trace::Span span_sort( "avg_thickness.sort" );
 
     // Create a flattened, sorted view of the thickness, which will be used in the bisection search later
     auto thickness_non_zero = xt::filter( topography_thickness.height_data, topography_thickness.height_data > 0 );
@@ -389,6 +681,7 @@ void Simulation::write_avg_thickness_file()
     auto flatten          = xt::flatten( thickness_non_zero );
     auto thickness_sorted = xt::eval( xt::sort( flatten ) );
     const int n_cells     = thickness_sorted.size();
+    span_sort.end();
 
     // This lambda performs bisection search to find the threshold thickness at which a
     // relative volume proportion of `thresh` is contained within cells with greater thickness than the threshold thickness
@@ -439,6 +732,8 @@ void Simulation::write_avg_thickness_file()
 
     for( auto & threshold : input.masking_threshold )
     {
+        Trace::Span span_threshold( "avg_thickness.masking_threshold" );
+
         auto const [threshold_thickness, total_flow_cur, n_flow_non_zero, ratio] = bisection_search( threshold );
 
         double volume        = topography.cell_size() * topography.cell_size() * total_flow_cur;
@@ -455,168 +750,581 @@ void Simulation::write_avg_thickness_file()
         // apply the filter mask
         xt::filter( asc_file_thick.height_data, asc_file_thick.height_data < threshold_thickness ) = 0.0;
         asc_file_thick.no_data_value                                                               = 0;
-        asc_file_thick.save(
-            input.output_folder / fmt::format( "{}_thickness_masked_{:.2f}.asc", input.run_name, threshold ) );
+
+        write_asc_file(
+            asc_file_thick,
+            input.output_folder / fmt::format( "{}_thickness_masked_{:.2f}.asc", input.run_name, threshold ),
+            "write_thickness_masked" );
 
         if( input.save_hazard_data )
         {
             auto asc_file_hazard          = topography.to_asc_file( Topography::Output::Hazard );
             asc_file_hazard.no_data_value = 0;
             xt::filter( asc_file_hazard.height_data, asc_file_thick.height_data < threshold_thickness ) = 0.0;
-            asc_file_hazard.save(
-                input.output_folder / fmt::format( "{}_hazard_masked_{:.2f}.asc", input.run_name, threshold ) );
+            write_asc_file(
+                asc_file_hazard,
+                input.output_folder / fmt::format( "{}_hazard_masked_{:.2f}.asc", input.run_name, threshold ),
+                "write_hazard_masked" );
         }
     }
     file.close();
 }
 
-void Simulation::run()
+void Simulation::write_asc_file( AscFile & asc_file, const std::filesystem::path & path, const char * trace_name )
 {
-    int n_lobes_processed = 0;
+    Trace::Span span( trace_name, "io" );
+    asc_file.save( path );
+    report.add_file_written( path );
+}
 
-    // Make a copy of the initial topography
-    auto t_run_start = std::chrono::high_resolution_clock::now();
+template<ParentPolicy parent_policy, AnglePolicy angle_policy, InertiaPolicy inertia_policy>
+void Simulation::emplace_lobes( int idx_flow, int n_lobes, FlowStats & flow_stats )
+{
+    // Calculated for each flow with n_lobes number of lobes
+    double delta_lobe_thickness
+        = 2.0 * ( lobe_dimensions.avg_lobe_thickness - lobe_dimensions.thickness_min ) / ( n_lobes - 1.0 );
 
-    // We use this matrix to comute the hazard of the local flow, which has to be done by max_reducing
-    MatrixX flow_hazard = xt::zeros_like( topography.hazard );
+    // Build initial lobes which do not propagate descendents
+    for( int idx_lobe = 0; idx_lobe < input.n_init; idx_lobe++ )
+    {
+        Lobe lobe_cur{};
+        gen.set_stream( RandomStream::key( idx_flow, idx_lobe ) );
+
+        compute_initial_lobe_position( idx_flow, lobe_cur );
+
+        // Compute the thickness of the lobe
+        lobe_cur.thickness = lobe_dimensions.thickness_min + idx_lobe * delta_lobe_thickness;
+
+        auto [height_lobe_center, slope] = topography.height_and_slope( lobe_cur.center );
+
+        // Perturb the angle (and set it)
+        perturb_lobe_angle<angle_policy>( lobe_cur, slope );
+
+        // compute lobe axes
+        compute_lobe_axes( lobe_cur, slope );
 
-    for( int idx_flow = 0; idx_flow < input.n_flows; idx_flow++ )
+        // Add rasterized lobe
+        topography.add_lobe( lobe_cur, idx_lobe );
+        count_lobe_for_slope_source();
+        lobes.push_back( lobe_cur );
+        add_parent_candidate( idx_lobe );
+    }
+
+    // Loop over the rest of the lobes (skipping the initial ones).
+    // Each lobe is a descendant of a parent lobe
+    for( int idx_lobe = input.n_init; idx_lobe < n_lobes; idx_lobe++ )
     {
-        // Determine n_lobes
-        int n_lobes{};
-        // Number of lobes in the flow is a random number between the min and max values
-        if( input.a_beta == 0 && input.b_beta == 0 )
+        Lobe lobe_cur{};
+        gen.set_stream( RandomStream::key( idx_flow, idx_lobe ) );
+
+        // Select which of the previously created lobes is the parent lobe
+        // from which the new descendent lobe will bud
+        auto idx_parent        = select_parent_lobe<parent_policy>( idx_lobe, lobe_cur );
+        const Lobe lobe_parent = lobes.lobe( idx_parent );
+
+        // stopping condition (parent lobe close the domain boundary or at a not defined z value)
+        if( stop_condition( lobe_parent.center, lobe_parent.semi_axes[0] ) )
+        {
+            flow_stats.stop_reason = StopReason::ParentLobe;
+            break;
+        }
+
+        auto [height_lobe_center, slope_parent] = topography.height_and_slope( lobe_parent.center );
+
+        // Perturb the angle and set it (not on the parent anymore)
+        perturb_lobe_angle<angle_policy>( lobe_cur, slope_parent );
+
+        // Add the inertial contribution
+        add_inertial_contribution<inertia_policy>( lobe_cur, lobe_parent, slope_parent );
+
+        // Compute the final budding point
+        // It is defined by the point on the perimeter of the parent lobe closest to the center of the new lobe
+        auto angle_diff             = lobe_parent.get_azimuthal_angle() - lobe_cur.get_azimuthal_angle();
+        Vector2 final_budding_point = lobe_parent.point_at_angle( -angle_diff );
+
+        if( stop_condition( final_budding_point, lobe_parent.semi_axes[0] ) )
         {
-            std::uniform_int_distribution<> dist_num_lobes( input.min_n_lobes, input.max_n_lobes );
-            n_lobes = dist_num_lobes( gen );
+            flow_stats.stop_reason = StopReason::BuddingPoint;
+            break;
         }
-        // Deterministic number of lobes according to a beta law
-        else
+        // Get the slope at the final budding point
+        auto [height_budding_point, slope_budding_point] = topography.height_and_slope( final_budding_point );
+
+        // compute the new lobe axes
+        compute_lobe_axes( lobe_cur, slope_budding_point );
+
+        // Get new lobe center
+        compute_descendent_lobe_position( lobe_cur, lobe_parent, final_budding_point );
+
+        if( stop_condition( lobe_cur.center, lobe_cur.semi_axes[0] ) )
         {
-            double x_beta        = ( 1.0 * idx_flow ) / ( input.n_flows - 1.0 );
-            double random_number = Math::beta_pdf( x_beta, input.a_beta, input.b_beta );
-            n_lobes              = int(
-                std::round( input.min_n_lobes + 0.5 * ( input.max_n_lobes - input.min_n_lobes ) * random_number ) );
+            flow_stats.stop_reason = StopReason::NewLobeCenter;
+            break;
         }
 
-        lobes = std::vector<Lobe>{};
-        lobes.reserve( n_lobes );
+        // Compute the thickness of the lobe
+        lobe_cur.thickness = lobe_dimensions.thickness_min + idx_lobe * delta_lobe_thickness;
 
-        // set the intersection cache
-        topography.reset_intersection_cache( n_lobes );
+        // Add rasterized lobe
+        topography.add_lobe( lobe_cur, idx_lobe );
+        count_lobe_for_slope_source();
+        lobes.push_back( lobe_cur );
+        add_parent_candidate( idx_lobe );
+    }
+}
 
-        // Calculated for each flow with n_lobes number of lobes
-        double delta_lobe_thickness
-            = 2.0 * ( lobe_dimensions.avg_lobe_thickness - lobe_dimensions.thickness_min ) / ( n_lobes - 1.0 );
+// The generic versions, which are also used by the tests and the benchmarks, and the combinations of the example
+// configurations. All other combinations use the generic Runtime policies
+template void Simulation::perturb_lobe_angle<AnglePolicy::Runtime>( Lobe & lobe, const Vector2 & slope );
+template int Simulation::select_parent_lobe<ParentPolicy::Runtime>( int idx_descendant, Lobe & lobe_descendent );
+template void Simulation::add_inertial_contribution<InertiaPolicy::Runtime>(
+    Lobe & lobe, const Lobe & parent, const Vector2 & slope ) const;
+template void Simulation::emplace_lobes<ParentPolicy::Runtime, AnglePolicy::Runtime, InertiaPolicy::Runtime>(
+    int idx_flow, int n_lobes, FlowStats & flow_stats );
+template void Simulation::emplace_lobes<ParentPolicy::Last, AnglePolicy::TruncatedNormal, InertiaPolicy::Inertial>(
+    int idx_flow, int n_lobes, FlowStats & flow_stats );
+template void
+Simulation::emplace_lobes<ParentPolicy::PowerLaw, AnglePolicy::TruncatedNormal, InertiaPolicy::Inertial>(
+    int idx_flow, int n_lobes, FlowStats & flow_stats );
+
+void Simulation::refresh_slope_source()
+{
+    Trace::Span span( "refresh_slope_source" );
+    RunReport::StageTimer timer( report, "slope_source" );
+    topography.refresh_slope_source( topography_initial, input.thickening_parameter );
+    n_lobes_since_slope_refresh = 0;
+}
 
-        // Build initial lobes which do not propagate descendents
-        for( int idx_lobe = 0; idx_lobe < input.n_init; idx_lobe++ )
+Simulation::EmplaceLobesFunction Simulation::select_emplace_lobes() const
+{
+    const bool truncated_normal = input.max_slope_prob > 0 && input.max_slope_prob < 1;
+    const bool inertial         = input.inertial_exponent > 0;
+
+    if( truncated_normal && inertial && !uses_parent_sampler() )
+    {
+        if( input.lobe_exponent <= 0 )
         {
-            lobes.emplace_back();
-            Lobe & lobe_cur = lobes.back();
+            return &Simulation::
+                emplace_lobes<ParentPolicy::Last, AnglePolicy::TruncatedNormal, InertiaPolicy::Inertial>;
+        }
+        if( input.lobe_exponent < 1 )
+        {
+            return &Simulation::
+                emplace_lobes<ParentPolicy::PowerLaw, AnglePolicy::TruncatedNormal, InertiaPolicy::Inertial>;
+        }
+    }
+
+    return &Simulation::emplace_lobes<ParentPolicy::Runtime, AnglePolicy::Runtime, InertiaPolicy::Runtime>;
+}
+
+bool Simulation::check_convergence( ConvergenceMonitor & monitor, int n_flows_completed )
+{
+    Trace::Span span( "convergence" );
+    RunReport::StageTimer timer( report, "convergence" );
+
+    // The cells touched by the lobes of the last flow
+    for( int idx_lobe = 0; idx_lobe < lobes.size(); idx_lobe++ )
+    {
+        const Lobe lobe                 = lobes.lobe( idx_lobe );
+        const auto [extent_x, extent_y] = lobe.extent_xy();
+        monitor.mark_touched( topography.bounding_box( lobe.center, extent_x, extent_y ) );
+    }
+
+    if( n_flows_completed % input.convergence_interval != 0 )
+    {
+        return false;
+    }
+
+    topography.apply_accumulated_thickness();
+    const auto & point = monitor.check(
+        n_flows_completed, topography.height_data, topography_initial.height_data, topography.hazard );
+    report.add_convergence_point( point );
+
+    return input.convergence_tolerance.has_value()
+           && monitor.is_converged( input.convergence_tolerance.value(), input.convergence_n_checks );
+}
+
+FlowStats Simulation::emplace_flow( int idx_flow, EmplaceLobesFunction emplace_lobes_function )
+{
+    // Every flow and every lobe draws from its own random stream
+    gen.set_stream( RandomStream::key( idx_flow, -1 ) );
+
+    // Determine n_lobes
+    int n_lobes{};
+    // Number of lobes in the flow is a random number between the min and max values
+    if( input.a_beta == 0 && input.b_beta == 0 )
+    {
+        n_lobes = gen.uniform_int( input.min_n_lobes, input.max_n_lobes );
+    }
+    // Deterministic number of lobes according to a beta law
+    else
+    {
+        double x_beta        = ( 1.0 * idx_flow ) / ( input.n_flows - 1.0 );
+        double random_number = Math::beta_pdf( x_beta, input.a_beta, input.b_beta );
+        n_lobes              = int(
+            std::round( input.min_n_lobes + 0.5 * ( input.max_n_lobes - input.min_n_lobes ) * random_number ) );
+    }
+
+    FlowStats flow_stats{};
+    flow_stats.idx_flow       = idx_flow;
+    flow_stats.n_lobes_target = n_lobes;
+
+    // set the intersection cache
+    std::optional<std::size_t> max_cache_bytes{};
+    if( input.max_cache_memory_mb.has_value() )
+    {
+        max_cache_bytes = input.max_cache_memory_mb.value() * 1024.0 * 1024.0 / n_cache_shares;
+    }
+    topography.reset_intersection_cache( n_lobes, max_cache_bytes );
+
+    // With a budget, the lobes are only preallocated as far as it goes, and longer flows grow them on demand
+    int n_lobes_reserved = n_lobes;
+    if( max_cache_bytes.has_value() )
+    {
+        n_lobes_reserved = std::min<std::size_t>( n_lobes, max_cache_bytes.value() / LobeStore::bytes_per_lobe );
+    }
 
-            compute_initial_lobe_position( idx_flow, lobe_cur );
+    lobes.clear();
+    lobes.reserve( n_lobes_reserved );
 
-            // Compute the thickness of the lobe
-            lobe_cur.thickness = lobe_dimensions.thickness_min + idx_lobe * delta_lobe_thickness;
+    if( uses_parent_sampler() )
+    {
+        parent_sampler.reset( n_lobes_reserved );
+    }
 
-            auto [height_lobe_center, slope] = topography.height_and_slope( lobe_cur.center );
+    ( this->*emplace_lobes_function )( idx_flow, n_lobes, flow_stats );
+    topography.flush_pending_lobes();
 
-            // Perturb the angle (and set it)
-            perturb_lobe_angle( lobe_cur, slope );
+    flow_stats.n_lobes_emplaced      = lobes.size();
+    flow_stats.n_footprints_uncached = topography.intersection_cache_n_dropped();
+    if( topography.has_inner_grid() )
+    {
+        flow_stats.n_footprints_uncached += topography.inner_grid().intersection_cache_n_dropped();
+    }
+    return flow_stats;
+}
 
-            // compute lobe axes
-            compute_lobe_axes( lobe_cur, slope );
+void Simulation::emplace_flows_concurrently(
+    int idx_flow_start, EmplaceLobesFunction emplace_lobes_function,
+    const std::function<bool( const FlowStats & flow_stats )> & finish_flow )
+{
+    const int n_threads = input.n_threads;
+
+    // The replicas only emplace lobes, so they hold none of the grids which are only needed for the outputs, and they
+    // read the slope source of this topography. Their topography records the tiles it reads and journals the
+    // increments of the lobes. The caches of the footprints share the budget, since they are swapped on every commit
+    topography.set_tile_tracking( true );
+    n_cache_shares = n_threads + 1;
+    std::vector<std::unique_ptr<Simulation>> replicas{};
+    for( int idx = 0; idx < n_threads; idx++ )
+    {
+        auto & replica = replicas.emplace_back( std::make_unique<Simulation>( *this, topography.worker_copy() ) );
+        replica->topography.set_lobe_journal( true );
+    }
+
+    ThreadPool pool( n_threads );
+    std::vector<FlowStats> flow_stats( n_threads );
 
-            // Add rasterized lobe
-            topography.add_lobe( lobe_cur, idx_lobe );
-            n_lobes_processed++;
+    int idx_flow = idx_flow_start;
+    bool stop    = false;
+    while( idx_flow < input.n_flows && !stop )
+    {
+        // A batch ends at the next refresh of the slope source, which the flows after it have to see
+        int idx_flow_end = std::min( idx_flow + n_threads, input.n_flows );
+        if( input.topo_mod_flag == 1 )
+        {
+            idx_flow_end = std::min( idx_flow_end, ( idx_flow / input.n_flows_counter + 1 ) * input.n_flows_counter );
         }
 
-        // Loop over the rest of the lobes (skipping the initial ones).
-        // Each lobe is a descendant of a parent lobe
-        for( int idx_lobe = input.n_init; idx_lobe < n_lobes; idx_lobe++ )
         {
-            lobes.emplace_back();
-            Lobe & lobe_cur = lobes.back();
+            Trace::Span span_batch( "emplace_batch", "flowy", "idx_flow", idx_flow );
+            RunReport::StageTimer timer( report, "emplacement" );
+
+            // Every replica first copies the tiles changed by the last commits, and the tiles it changed itself, so
+            // that it starts from the committed topography. The replicas without a flow in this batch are synced too
+            pool.parallel_for(
+                n_threads,
+                [&]( int idx )
+                {
+                    Simulation & replica = *replicas[idx];
+                    replica.topography.copy_tiles_from( topography, topography.tiles_changed() );
+                    replica.topography.copy_tiles_from( topography, replica.topography.tiles_changed() );
+                    replica.topography.reset_tile_tracking();
+                    replica.topography.lobe_journal().clear();
+
+                    if( idx_flow + idx < idx_flow_end )
+                    {
+                        Trace::Span span_flow( "flow", "flowy", "idx_flow", idx_flow + idx );
+                        flow_stats[idx] = replica.emplace_flow( idx_flow + idx, emplace_lobes_function );
+                    }
+                } );
+            topography.reset_tile_tracking();
+        }
 
-            // Select which of the previously created lobes is the parent lobe
-            // from which the new descendent lobe will bud
-            auto idx_parent    = select_parent_lobe( idx_lobe );
-            Lobe & lobe_parent = lobes[idx_parent];
+        // A flow is only committed if no earlier flow of the batch has changed a tile it read, since it then saw
+        // exactly the topography of a serial run. Otherwise it is emplaced again on the committed topography
+        for( int idx = 0; idx < idx_flow_end - idx_flow && !stop; idx++ )
+        {
+            Simulation & replica = *replicas[idx];
+            const auto & tiles   = replica.topography.tiles_read();
+            const bool is_conflicting
+                = std::any_of( tiles.begin(), tiles.end(), [&]( int t ) { return topography.was_tile_changed( t ); } );
 
-            // stopping condition (parent lobe close the domain boundary or at a not defined z value)
-            if( stop_condition( lobe_parent.center, lobe_parent.semi_axes[0] ) )
+            FlowStats stats{};
+            if( is_conflicting )
             {
-                lobes.pop_back();
-                break;
+                Trace::Span span_flow( "flow", "flowy", "idx_flow", idx_flow + idx );
+                RunReport::StageTimer timer( report, "emplacement" );
+                stats = emplace_flow( idx_flow + idx, emplace_lobes_function );
+                report.n_flows_rerun++;
+            }
+            else
+            {
+                Trace::Span span_commit( "commit_flow", "flowy", "idx_flow", idx_flow + idx );
+                RunReport::StageTimer timer( report, "commit" );
+                topography.apply_lobe_journal( replica.topography.lobe_journal() );
+                std::swap( lobes, replica.lobes );
+                topography.swap_intersection_cache( replica.topography );
+                stats = flow_stats[idx];
             }
 
-            // Find the preliminary budding point on the perimeter of the parent lobe (npoints is the number of raster
-            // points on the ellipse)
-            Flowy::Vector2 budding_point = topography.find_preliminary_budding_point( lobe_parent, input.npoints );
+            stop = finish_flow( stats );
+        }
+        idx_flow = idx_flow_end;
+    }
 
-            auto [height_lobe_center, slope_parent] = topography.height_and_slope( lobe_parent.center );
+    topography.set_tile_tracking( false );
+    n_cache_shares = 1;
+}
 
-            // Perturb the angle and set it (not on the parent anymore)
-            perturb_lobe_angle( lobe_cur, slope_parent );
+void Simulation::run()
+{
+    int n_lobes_processed = 0;
 
-            // Add the inertial contribution
-            add_inertial_contribution( lobe_cur, lobe_parent, slope_parent );
+    // Make a copy of the initial topography
+    auto t_run_start = std::chrono::high_resolution_clock::now();
 
-            // Compute the final budding point
-            // It is defined by the point on the perimeter of the parent lobe closest to the center of the new lobe
-            auto angle_diff             = lobe_parent.get_azimuthal_angle() - lobe_cur.get_azimuthal_angle();
-            Vector2 final_budding_point = lobe_parent.point_at_angle( -angle_diff );
+    // We use this matrix to comute the hazard of the local flow, which has to be done by max_reducing
+    MatrixX flow_hazard = xt::zeros_like( topography.hazard );
+    MatrixX inner_flow_hazard{};
+    if( topography.has_inner_grid() )
+    {
+        inner_flow_hazard = xt::zeros_like( topography.inner_grid().hazard );
+    }
 
-            // final_budding_point = budding_point;
-            if( stop_condition( final_budding_point, lobe_parent.semi_axes[0] ) )
-            {
-                lobes.pop_back();
-                break;
-            }
-            // Get the slope at the final budding point
-            auto [height_budding_point, slope_budding_point] = topography.height_and_slope( final_budding_point );
+    // The emplacement loop is specialized for the settings of this run
+    const EmplaceLobesFunction emplace_lobes_function = select_emplace_lobes();
 
-            // compute the new lobe axes
-            compute_lobe_axes( lobe_cur, slope_budding_point );
+    convergence_monitor = std::nullopt;
+    if( input.convergence_interval > 0 )
+    {
+        std::optional<double> masking_threshold{};
+        if( !input.masking_threshold.empty() )
+        {
+            masking_threshold = input.masking_threshold[0];
+        }
+        convergence_monitor = ConvergenceMonitor(
+            topography.height_data.shape()[0], topography.height_data.shape()[1], masking_threshold,
+            input.save_hazard_data );
+    }
+
+    // The threads either emplace whole flows concurrently, or work within the flows (lobe windows and row blocks)
+    const bool uses_threads_within_flows = input.lobe_window > 1 || input.parallel_lobe_min_cells > 0;
+    std::optional<ThreadPool> pool_within_flows{};
+    if( uses_threads_within_flows )
+    {
+        pool_within_flows.emplace( input.n_threads );
+        if( input.lobe_window > 1 )
+        {
+            topography.set_lobe_window( input.lobe_window, &pool_within_flows.value() );
+        }
+        if( input.parallel_lobe_min_cells > 0 )
+        {
+            topography.set_row_blocks( input.parallel_lobe_min_cells, &pool_within_flows.value() );
+        }
+    }
 
-            // Get new lobe center
-            compute_descendent_lobe_position( lobe_cur, lobe_parent, final_budding_point );
+    // The concurrent flows replay the increments of the lobes on the topography, and the threads within the flows
+    // rasterize whole lobes, both need immediate updates
+    const bool is_concurrent = input.n_threads > 1 || uses_threads_within_flows;
+    topography.set_deferred_lobe_application( input.deferred_lobe_application && !is_concurrent );
 
-            if( stop_condition( lobe_cur.center, lobe_cur.semi_axes[0] ) )
+    // The slope source is set up before resuming, so that it can be restored from the checkpoint
+    n_lobes_slope_refresh       = 0;
+    n_lobes_since_slope_refresh = 0;
+    // Without refreshes (topo_mod_flag = 0), the slope source is the initial topography
+    if( input.topo_mod_flag == 0 )
+    {
+        topography.share_slope_source( topography_initial );
+    }
+    else if( input.topo_mod_flag.has_value() )
+    {
+        topography.enable_slope_source();
+        if( input.topo_mod_flag.value() == 2 )
+        {
+            n_lobes_slope_refresh = input.n_lobes_counter;
+        }
+    }
+
+    // Without feedback of the lava on the slopes, the heights are only needed after the run (and for convergence
+    // checks and checkpoints), so the enclosed cells of the lobes can be accumulated in a difference array
+    topography.set_thickness_accumulation( input.accumulate_thickness && input.topo_mod_flag == 0 && !is_concurrent );
+
+    n_flows_completed = 0;
+    if( input.resume_checkpoint.has_value() )
+    {
+        read_checkpoint( input.resume_checkpoint.value() );
+        fmt::print(
+            "Resuming from '{}' after {} flows\n", input.resume_checkpoint.value().string(), n_flows_completed );
+    }
+    const int idx_flow_start = n_flows_completed;
+
+    // The pyramid is built after resuming, from the restored heights. The inner grid gets its own level
+    topography.set_slope_level( 0 );
+    if( topography.has_inner_grid() )
+    {
+        topography.inner_grid().set_slope_level( 0 );
+    }
+    if( input.slope_cells_per_lobe_radius.has_value() )
+    {
+        auto set_slope_level = [&]( Topography & grid, const std::string & name )
+        {
+            const double radius_cells = std::sqrt( lobe_dimensions.lobe_area / Math::pi ) / grid.cell_size();
+            int level                 = 0;
+            while( level < Topography::max_slope_level
+                   && radius_cells / ( 2 << level ) >= input.slope_cells_per_lobe_radius.value() )
             {
-                lobes.pop_back();
-                break;
+                level++;
             }
+            grid.set_slope_level( level );
+            fmt::print(
+                "Slopes are interpolated on level {} of the {} pyramid ({} m cells)\n", level, name,
+                grid.cell_size() * ( 1 << level ) );
+        };
+        set_slope_level( topography, "topography" );
+        if( topography.has_inner_grid() )
+        {
+            set_slope_level( topography.inner_grid(), "inner grid" );
+        }
+    }
 
-            // Compute the thickness of the lobe
-            lobe_cur.thickness = lobe_dimensions.thickness_min + idx_lobe * delta_lobe_thickness;
+    // Everything that happens after the emplacement of a flow, in the order of the flows. Returns true if the run
+    // stops early
+    const auto finish_flow = [&]( const FlowStats & flow_stats )
+    {
+        const int idx_flow = flow_stats.idx_flow;
+        n_lobes_processed += flow_stats.n_lobes_emplaced;
 
-            // Add rasterized lobe
-            topography.add_lobe( lobe_cur, idx_lobe );
-            n_lobes_processed++;
+        if( input.topo_mod_flag.value_or( 0 ) >= 1 && ( idx_flow + 1 ) % input.n_flows_counter == 0 )
+        {
+            refresh_slope_source();
         }
 
+        report.add_flow( flow_stats );
+
         if( input.save_hazard_data )
         {
-            compute_cumulative_descendents( lobes );
+            Trace::Span span_hazard( "hazard_flow" );
+            RunReport::StageTimer timer( report, "hazard" );
+            lobes.compute_cumulative_descendents();
             topography.compute_hazard_flow( lobes, flow_hazard );
             topography.hazard += flow_hazard;
+            if( topography.has_inner_grid() )
+            {
+                auto & inner = topography.inner_grid();
+                inner.compute_hazard_flow( lobes, inner_flow_hazard );
+                inner.hazard += inner_flow_hazard;
+            }
         }
 
         if( input.write_lobes_csv )
         {
-            write_lobe_data_to_file( lobes, input.output_folder / fmt::format( "lobes_{}.csv", idx_flow ) );
+            Trace::Span span_write( "write_lobes_csv", "io", "idx_flow", idx_flow );
+            RunReport::StageTimer timer( report, "write_lobes_csv" );
+            const auto path = input.output_folder / fmt::format( "lobes_{}.csv", idx_flow );
+            write_lobe_data_to_file( lobes, path );
+            report.add_file_written( path );
         }
 
         if( input.print_remaining_time )
         {
             auto t_cur          = std::chrono::high_resolution_clock::now();
             auto remaining_time = std::chrono::duration_cast<std::chrono::milliseconds>(
-                ( input.n_flows - idx_flow - 1 ) * ( t_cur - t_run_start ) / ( idx_flow + 1 ) );
+                ( input.n_flows - idx_flow - 1 ) * ( t_cur - t_run_start ) / ( idx_flow + 1 - idx_flow_start ) );
             fmt::print( "     remaining_time = {:%Hh %Mm %Ss}\n", remaining_time );
         }
+
+        n_flows_completed = idx_flow + 1;
+
+        std::optional<RunTermination> early_stop{};
+        if( convergence_monitor.has_value() && check_convergence( convergence_monitor.value(), n_flows_completed ) )
+        {
+            fmt::print( "Converged after {} of {} flows\n", n_flows_completed, input.n_flows );
+            early_stop = RunTermination::Converged;
+        }
+        else if( n_flows_completed < input.n_flows && StopSignal::requested() )
+        {
+            fmt::print( "Stop requested, writing the output of {} of {} flows\n", n_flows_completed, input.n_flows );
+            early_stop = RunTermination::Signal;
+        }
+        else if( n_flows_completed < input.n_flows && input.max_run_time_seconds.has_value() )
+        {
+            // Stop if the next flow would, on average, not be finished within the time budget
+            const auto t_cur     = std::chrono::high_resolution_clock::now();
+            const double elapsed = std::chrono::duration<double>( t_cur - t_run_start ).count();
+            if( elapsed + elapsed / ( n_flows_completed - idx_flow_start ) > input.max_run_time_seconds.value() )
+            {
+                fmt::print(
+                    "Time budget of {} s exhausted, writing the output of {} of {} flows\n",
+                    input.max_run_time_seconds.value(), n_flows_completed, input.n_flows );
+                early_stop = RunTermination::TimeBudget;
+            }
+        }
+
+        // A run that was interrupted (but not a converged one) also writes a checkpoint, so that it can be resumed
+        const bool interrupted = early_stop.has_value() && early_stop.value() != RunTermination::Converged;
+        if( input.checkpoint_interval > 0 && n_flows_completed < input.n_flows
+            && ( n_flows_completed % input.checkpoint_interval == 0 || interrupted ) )
+        {
+            write_checkpoint( input.output_folder / fmt::format( "{}_checkpoint.bin", input.run_name ) );
+        }
+
+        if( early_stop.has_value() )
+        {
+            report.termination = early_stop.value();
+            return true;
+        }
+        return false;
+    };
+
+    if( input.n_threads > 1 && !uses_threads_within_flows )
+    {
+        emplace_flows_concurrently( idx_flow_start, emplace_lobes_function, finish_flow );
+    }
+    else
+    {
+        for( int idx_flow = idx_flow_start; idx_flow < input.n_flows; idx_flow++ )
+        {
+            Trace::Span span_flow( "flow", "flowy", "idx_flow", idx_flow );
+            auto timer_emplacement     = std::make_optional<RunReport::StageTimer>( report, "emplacement" );
+            const FlowStats flow_stats = emplace_flow( idx_flow, emplace_lobes_function );
+            timer_emplacement.reset();
+
+            if( finish_flow( flow_stats ) )
+            {
+                break;
+            }
+        }
+    }
+
+    topography.apply_accumulated_thickness();
+    topography.set_lobe_window( 0, nullptr );
+    topography.set_row_blocks( 0, nullptr );
+    topography.set_slope_level( 0 );
+    if( topography.has_inner_grid() )
+    {
+        topography.inner_grid().apply_accumulated_thickness();
+        topography.inner_grid().set_slope_level( 0 );
     }
 
     auto t_cur      = std::chrono::high_resolution_clock::now();
@@ -625,41 +1333,134 @@ void Simulation::run()
 
     fmt::print( "Total number of processed lobes = {}\n", n_lobes_processed );
 
-    if( total_time.count() > 0 )
+    const double total_seconds = std::chrono::duration<double>( t_cur - t_run_start ).count();
+    if( total_seconds > 0 )
     {
-        auto lobes_per_ms = n_lobes_processed / total_time.count();
-        fmt::print( "n_lobes/ms = {}\n", lobes_per_ms );
+        fmt::print( "n_lobes/s = {:.1f}\n", n_lobes_processed / total_seconds );
     }
 
     fmt::print( "Used RNG seed: {}\n", rng_seed );
 
+    auto timer_output = std::make_optional<RunReport::StageTimer>( report, "write_output" );
+
     // Save initial topography to asc file
     auto asc_file = topography_initial.to_asc_file();
-    asc_file.save( input.output_folder / fmt::format( "{}_DEM.asc", input.run_name ) );
+    write_asc_file( asc_file, input.output_folder / fmt::format( "{}_DEM.asc", input.run_name ), "write_DEM" );
 
     // Save final topography to asc file
     if( input.save_final_dem )
     {
         asc_file = topography.to_asc_file();
-        asc_file.save( input.output_folder / fmt::format( "{}_DEM_final.asc", input.run_name ) );
+        write_asc_file(
+            asc_file, input.output_folder / fmt::format( "{}_DEM_final.asc", input.run_name ), "write_DEM_final" );
     }
 
+    // If the run stopped early (or is a preview), the thickness and the hazard are scaled up to the estimate for all
+    // flows
+    const double output_scale = this->output_scale();
+
     // Save full thickness to asc file
     topography_thickness = topography;
     topography_thickness.height_data -= topography_initial.height_data;
+    if( output_scale != 1.0 )
+    {
+        topography_thickness.height_data *= output_scale;
+        topography.hazard *= output_scale;
+    }
     asc_file               = topography_thickness.to_asc_file();
     asc_file.no_data_value = 0;
-    asc_file.save( input.output_folder / fmt::format( "{}_thickness_full.asc", input.run_name ) );
+    write_asc_file(
+        asc_file, input.output_folder / fmt::format( "{}_thickness_full.asc", input.run_name ),
+        "write_thickness_full" );
 
     // Save the full hazard map
     if( input.save_hazard_data )
     {
         asc_file               = topography.to_asc_file( Topography::Output::Hazard );
         asc_file.no_data_value = 0;
-        asc_file.save( input.output_folder / fmt::format( "{}_hazard_full.asc", input.run_name ) );
+        write_asc_file(
+            asc_file, input.output_folder / fmt::format( "{}_hazard_full.asc", input.run_name ), "write_hazard_full" );
+    }
+    if( topography.has_inner_grid() )
+    {
+        write_inner_grid_files( output_scale );
+    }
+    if( convergence_monitor.has_value() )
+    {
+        const auto path = input.output_folder / fmt::format( "{}_convergence.csv", input.run_name );
+        convergence_monitor->write_csv( path );
+        report.add_file_written( path );
+    }
+    timer_output.reset();
+
+    {
+        Trace::Span span( "write_avg_thickness_file" );
+        RunReport::StageTimer timer( report, "avg_thickness" );
+        write_avg_thickness_file();
     }
 
-    write_avg_thickness_file();
+    const std::size_t bytes_per_cell = sizeof( double );
+    report.add_grid( "topography", topography.height_data.size() * bytes_per_cell );
+    report.add_grid( "topography_initial", topography_initial.height_data.size() * bytes_per_cell );
+    report.add_grid( "topography_thickness", topography_thickness.height_data.size() * bytes_per_cell );
+    report.add_grid( "hazard", topography.hazard.size() * bytes_per_cell );
+    report.add_grid( "flow_hazard", flow_hazard.size() * bytes_per_cell );
+    if( topography.is_thickness_accumulated() )
+    {
+        report.add_grid(
+            "thickness_difference", topography.thickness_difference().size() * sizeof( int64_t ) );
+    }
+    if( topography.has_slope_source() && !topography.is_slope_source_shared() )
+    {
+        report.add_grid( "slope_source", topography.slope_source().size() * bytes_per_cell );
+    }
+    if( topography.has_inner_grid() )
+    {
+        const Topography & inner = topography.inner_grid();
+        report.add_grid( "inner_topography", inner.height_data.size() * bytes_per_cell );
+        report.add_grid( "inner_topography_initial", inner.height_data.size() * bytes_per_cell );
+        report.add_grid( "inner_topography_thickness", inner.height_data.size() * bytes_per_cell );
+        report.add_grid( "inner_hazard", inner.hazard.size() * bytes_per_cell );
+        report.add_grid( "inner_flow_hazard", inner_flow_hazard.size() * bytes_per_cell );
+        if( inner.is_thickness_accumulated() )
+        {
+            report.add_grid(
+                "inner_thickness_difference", inner.thickness_difference().size() * sizeof( int64_t ) );
+        }
+        if( inner.has_slope_source() && !inner.is_slope_source_shared() )
+        {
+            report.add_grid( "inner_slope_source", inner.slope_source().size() * bytes_per_cell );
+        }
+    }
+
+    if( input_full.has_value() )
+    {
+        std::size_t grid_bytes = 0;
+        for( const auto & grid : report.grids )
+        {
+            grid_bytes += grid.bytes;
+        }
+        const double output_seconds
+            = report.stage_wall_seconds( "write_output" ) + report.stage_wall_seconds( "avg_thickness" );
+        report.preview = Preview::estimate_full_run(
+            input_full.value(), input, n_flows_completed, double( n_cells_full ) / topography.height_data.size(),
+            total_seconds, output_seconds, grid_bytes );
+
+        const auto seconds_full = std::chrono::duration<double>( report.preview->seconds );
+        fmt::print(
+            "Preview: the full run is estimated to take {:%Hh %Mm %Ss} and {:.1f} MB for the grids\n",
+            std::chrono::duration_cast<std::chrono::milliseconds>( seconds_full ),
+            report.preview->grid_bytes / ( 1024.0 * 1024.0 ) );
+    }
+
+    report.write(
+        input.output_folder / fmt::format( "{}_report.json", input.run_name ), input, rng_seed, total_seconds,
+        n_lobes_processed );
+
+    if( input.write_trace )
+    {
+        Trace::flush( input.output_folder / fmt::format( "{}_trace.json", input.run_name ) );
+    }
 }
 
-} // namespace Flowy
\ No newline at end of file
+} // namespace Flowy
@@ -0,0 +1,45 @@
+#include "stop_signal.hpp"
+#include <atomic>
+#include <csignal>
+
+namespace Flowy::StopSignal
+{
+
+namespace
+{
+
+// Only lock-free atomics may be accessed from a signal handler
+std::atomic<bool> stop_requested = false;
+static_assert( std::atomic<bool>::is_always_lock_free );
+
+extern "C" void handle_signal( int signal )
+{
+    stop_requested.store( true, std::memory_order_relaxed );
+    // The next signal of the same kind gets the default behaviour, i.e. it terminates the process
+    std::signal( signal, SIG_DFL );
+}
+
+} // namespace
+
+void install()
+{
+    std::signal( SIGTERM, handle_signal );
+    std::signal( SIGINT, handle_signal );
+}
+
+bool requested()
+{
+    return stop_requested.load( std::memory_order_relaxed );
+}
+
+void request()
+{
+    stop_requested.store( true, std::memory_order_relaxed );
+}
+
+void reset()
+{
+    stop_requested.store( false, std::memory_order_relaxed );
+}
+
+} // namespace Flowy::StopSignal
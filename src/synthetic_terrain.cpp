@@ -0,0 +1,203 @@
+#include "synthetic_terrain.hpp"
+#include "xtensor/xbuilder.hpp"
+#include <fmt/format.h>
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+
+namespace Flowy
+{
+
+TerrainKind terrain_kind_from_string( const std::string & kind )
+{
+    if( kind == "constant_slope" )
+        return TerrainKind::ConstantSlope;
+    if( kind == "saddle" )
+        return TerrainKind::Saddle;
+    if( kind == "fractal" )
+        return TerrainKind::Fractal;
+    throw std::runtime_error(
+        fmt::format( "Unknown synthetic terrain kind '{}', valid are: constant_slope, saddle, fractal", kind ) );
+}
+
+std::string to_string( TerrainKind kind )
+{
+    switch( kind )
+    {
+        case TerrainKind::ConstantSlope: return "constant_slope";
+        case TerrainKind::Saddle: return "saddle";
+        case TerrainKind::Fractal: return "fractal";
+    }
+    return "unknown";
+}
+
+namespace
+{
+
+// splitmix64 finalizer, used as a stateless hash so that every lattice point can be evaluated independently
+std::uint64_t hash( std::uint64_t seed, std::int64_t a, std::int64_t b, std::uint64_t salt )
+{
+    std::uint64_t z = seed ^ ( std::uint64_t( a ) * 0x9E3779B97F4A7C15ull )
+                      ^ ( std::uint64_t( b ) * 0xC2B2AE3D27D4EB4Full ) ^ ( salt * 0x165667B19E3779F9ull );
+    z = ( z ^ ( z >> 30 ) ) * 0xBF58476D1CE4E5B9ull;
+    z = ( z ^ ( z >> 27 ) ) * 0x94D049BB133111EBull;
+    return z ^ ( z >> 31 );
+}
+
+// Uniform number in [0, 1)
+double hash_to_unit( std::uint64_t h )
+{
+    return double( h >> 11 ) * 0x1.0p-53;
+}
+
+// Value noise in [-1, 1] with a quintic interpolation between the lattice points
+double value_noise( std::uint64_t seed, int octave, double x, double y )
+{
+    const double fx = std::floor( x );
+    const double fy = std::floor( y );
+    const auto ix   = std::int64_t( fx );
+    const auto iy   = std::int64_t( fy );
+
+    auto smooth = []( double t ) { return t * t * t * ( t * ( t * 6.0 - 15.0 ) + 10.0 ); };
+    const double tx = smooth( x - fx );
+    const double ty = smooth( y - fy );
+
+    auto lattice = [&]( std::int64_t i, std::int64_t j )
+    { return 2.0 * hash_to_unit( hash( seed, i, j, octave ) ) - 1.0; };
+
+    const double v00 = lattice( ix, iy );
+    const double v10 = lattice( ix + 1, iy );
+    const double v01 = lattice( ix, iy + 1 );
+    const double v11 = lattice( ix + 1, iy + 1 );
+
+    const double v0 = v00 + tx * ( v10 - v00 );
+    const double v1 = v01 + tx * ( v11 - v01 );
+    return v0 + ty * ( v1 - v0 );
+}
+
+// Fractional Brownian motion: a sum of value noise octaves with decreasing wavelength and amplitude
+double fractal_noise( const SyntheticTerrainParams & params, double x, double y )
+{
+    double res        = 0.0;
+    double amplitude  = params.fractal_amplitude;
+    double wavelength = params.fractal_wavelength;
+    for( int octave = 0; octave < params.fractal_octaves; octave++ )
+    {
+        res += amplitude * value_noise( params.seed, octave, x / wavelength, y / wavelength );
+        amplitude *= params.fractal_roughness;
+        wavelength *= 0.5;
+    }
+    return res;
+}
+
+// Holes are placed on a coarse grid of blocks: each block contains a hole with probability `nodata_fraction`, at a
+// random position within the block
+bool is_in_nodata_hole( const SyntheticTerrainParams & params, double x, double y )
+{
+    if( params.nodata_fraction <= 0.0 )
+        return false;
+
+    const double spacing = params.nodata_hole_spacing;
+    const double r2      = params.nodata_hole_radius * params.nodata_hole_radius;
+    const auto reach     = std::int64_t( std::ceil( params.nodata_hole_radius / spacing ) );
+    const auto bx        = std::int64_t( std::floor( x / spacing ) );
+    const auto by        = std::int64_t( std::floor( y / spacing ) );
+
+    for( std::int64_t i = bx - reach; i <= bx + reach; i++ )
+    {
+        for( std::int64_t j = by - reach; j <= by + reach; j++ )
+        {
+            if( hash_to_unit( hash( params.seed, i, j, 1000 ) ) >= params.nodata_fraction )
+                continue;
+
+            const double cx = ( double( i ) + hash_to_unit( hash( params.seed, i, j, 1001 ) ) ) * spacing;
+            const double cy = ( double( j ) + hash_to_unit( hash( params.seed, i, j, 1002 ) ) ) * spacing;
+            if( ( x - cx ) * ( x - cx ) + ( y - cy ) * ( y - cy ) <= r2 )
+                return true;
+        }
+    }
+    return false;
+}
+
+} // namespace
+
+double synthetic_terrain_height( const SyntheticTerrainParams & params, std::size_t idx_x, std::size_t idx_y )
+{
+    // Coordinates relative to the center of the domain
+    const double x = ( double( idx_x ) - 0.5 * double( params.n_x ) ) * params.cell_size;
+    const double y = ( double( idx_y ) - 0.5 * double( params.n_y ) ) * params.cell_size;
+
+    switch( params.kind )
+    {
+        case TerrainKind::ConstantSlope: return params.base_height + params.slope[0] * x + params.slope[1] * y;
+        case TerrainKind::Saddle: return params.base_height + params.saddle_curvature * ( x * x - y * y );
+        case TerrainKind::Fractal:
+            return params.base_height + params.slope[0] * x + params.slope[1] * y
+                   + fractal_noise( params, double( idx_x ) * params.cell_size, double( idx_y ) * params.cell_size );
+    }
+    return params.base_height;
+}
+
+AscFile make_synthetic_terrain( const SyntheticTerrainParams & params, std::optional<AscCrop> crop )
+{
+    if( params.n_x < 2 || params.n_y < 2 || params.cell_size <= 0 )
+    {
+        throw std::runtime_error( fmt::format(
+            "Invalid synthetic terrain: n_x = {}, n_y = {}, cell_size = {}", params.n_x, params.n_y,
+            params.cell_size ) );
+    }
+
+    const double lx = params.lower_left_corner[0];
+    const double ly = params.lower_left_corner[1];
+
+    // Same index logic as the cropping of asc files
+    int idx_x_min = 0;
+    int idx_x_max = int( params.n_x ) - 1;
+    int idx_y_min = 0;
+    int idx_y_max = int( params.n_y ) - 1;
+    if( crop.has_value() )
+    {
+        idx_x_min = std::clamp<int>( ( crop->x_min - lx ) / params.cell_size, 0, params.n_x - 1 );
+        idx_x_max = std::clamp<int>( ( crop->x_max - lx ) / params.cell_size, 0, params.n_x - 1 );
+        idx_y_min = std::clamp<int>( ( crop->y_min - ly ) / params.cell_size, 0, params.n_y - 1 );
+        idx_y_max = std::clamp<int>( ( crop->y_max - ly ) / params.cell_size, 0, params.n_y - 1 );
+    }
+
+    const std::size_t n_x = idx_x_max - idx_x_min + 1;
+    const std::size_t n_y = idx_y_max - idx_y_min + 1;
+
+    AscFile asc_file{};
+    asc_file.cell_size         = params.cell_size;
+    asc_file.no_data_value     = params.no_data_value;
+    asc_file.lower_left_corner = { lx + idx_x_min * params.cell_size, ly + idx_y_min * params.cell_size };
+    asc_file.height_data       = xt::empty<double>( { n_x, n_y } );
+
+    for( std::size_t i = 0; i < n_x; i++ )
+    {
+        for( std::size_t j = 0; j < n_y; j++ )
+        {
+            const std::size_t idx_x = idx_x_min + i;
+            const std::size_t idx_y = idx_y_min + j;
+
+            if( is_in_nodata_hole( params, double( idx_x ) * params.cell_size, double( idx_y ) * params.cell_size ) )
+            {
+                asc_file.height_data( i, j ) = params.no_data_value;
+            }
+            else
+            {
+                asc_file.height_data( i, j ) = synthetic_terrain_height( params, idx_x, idx_y );
+            }
+        }
+    }
+
+    asc_file.x_data = xt::arange(
+        asc_file.lower_left_corner[0], asc_file.lower_left_corner[0] + double( n_x ) * params.cell_size,
+        params.cell_size );
+    asc_file.y_data = xt::arange(
+        asc_file.lower_left_corner[1], asc_file.lower_left_corner[1] + double( n_y ) * params.cell_size,
+        params.cell_size );
+
+    return asc_file;
+}
+
+} // namespace Flowy
@@ -0,0 +1,94 @@
+#include "thread_pool.hpp"
+#include <utility>
+
+namespace Flowy
+{
+
+ThreadPool::ThreadPool( int n_threads )
+{
+    for( int idx = 1; idx < n_threads; idx++ )
+    {
+        workers.emplace_back( [this]() { worker_loop(); } );
+    }
+}
+
+ThreadPool::~ThreadPool()
+{
+    {
+        std::lock_guard<std::mutex> lock( mutex );
+        stopping = true;
+    }
+    cv_start.notify_all();
+    for( auto & worker : workers )
+    {
+        worker.join();
+    }
+}
+
+void ThreadPool::parallel_for( int n_tasks, const std::function<void( int idx )> & task )
+{
+    std::unique_lock<std::mutex> lock( mutex );
+    this->task    = &task;
+    this->n_tasks = n_tasks;
+    idx_next      = 0;
+    n_finished    = 0;
+    exception     = nullptr;
+    generation++;
+    cv_start.notify_all();
+
+    run_tasks( lock );
+    cv_done.wait( lock, [this]() { return n_finished == this->n_tasks; } );
+    this->task = nullptr;
+
+    if( exception )
+    {
+        std::rethrow_exception( std::exchange( exception, nullptr ) );
+    }
+}
+
+void ThreadPool::run_tasks( std::unique_lock<std::mutex> & lock )
+{
+    while( idx_next < n_tasks )
+    {
+        const int idx = idx_next++;
+        lock.unlock();
+
+        std::exception_ptr task_exception{};
+        try
+        {
+            ( *task )( idx );
+        }
+        catch( ... )
+        {
+            task_exception = std::current_exception();
+        }
+
+        lock.lock();
+        if( task_exception && !exception )
+        {
+            exception = task_exception;
+        }
+        if( ++n_finished == n_tasks )
+        {
+            cv_done.notify_all();
+        }
+    }
+}
+
+void ThreadPool::worker_loop()
+{
+    std::unique_lock<std::mutex> lock( mutex );
+    uint64_t generation_seen = 0;
+    while( true )
+    {
+        cv_start.wait( lock, [&]() { return stopping || generation != generation_seen; } );
+        if( stopping )
+        {
+            return;
+        }
+        generation_seen = generation;
+        run_tasks( lock );
+    }
+}
+
+} // namespace Flowy
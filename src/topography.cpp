@@ -1,15 +1,66 @@
 #include "topography.hpp"
 #include "asc_file.hpp"
 #include "definitions.hpp"
+#include "thread_pool.hpp"
 #include "xtensor/xbuilder.hpp"
 #include <fmt/ranges.h>
 #include <algorithm>
+#include <cmath>
+#include <limits>
 #include <stdexcept>
 #include <vector>
 
 namespace Flowy
 {
 
+namespace
+{
+
+// Splits [0, n) into blocks of about the same size and runs process_block( idx_begin, idx_end ) for them on the pool.
+// The cells are sorted by rows, and the blocks only end where row( idx ) changes, so a row is processed by one thread
+template<typename RowFunction, typename BlockFunction>
+void for_each_row_block( ThreadPool & pool, std::size_t n, RowFunction row, BlockFunction process_block )
+{
+    const int n_blocks = 4 * pool.n_threads();
+
+    std::vector<std::size_t> idx_bounds{ 0 };
+    for( int idx_block = 1; idx_block < n_blocks; idx_block++ )
+    {
+        std::size_t idx = std::max( idx_bounds.back(), n * idx_block / n_blocks );
+        while( idx > 0 && idx < n && row( idx ) == row( idx - 1 ) )
+        {
+            idx++;
+        }
+        idx_bounds.push_back( idx );
+    }
+    idx_bounds.push_back( n );
+
+    pool.parallel_for(
+        n_blocks,
+        [&]( int idx_block )
+        {
+            if( idx_bounds[idx_block] < idx_bounds[idx_block + 1] )
+            {
+                process_block( idx_bounds[idx_block], idx_bounds[idx_block + 1] );
+            }
+        } );
+}
+
+} // namespace
+
+GridGeometry::GridGeometry( const VectorX & x_data, const VectorX & y_data )
+        : n_x( x_data.size() ), n_y( y_data.size() )
+{
+    if( n_x < 2 || n_y < 2 )
+    {
+        throw std::runtime_error( fmt::format( "The grid needs at least 2x2 cells, but it has {}x{}", n_x, n_y ) );
+    }
+    cell_size     = x_data[1] - x_data[0];
+    inv_cell_size = 1.0 / cell_size;
+    origin        = { x_data[0], y_data[0] };
+    upper_corner  = { x_data.periodic( -1 ) + cell_size, y_data.periodic( -1 ) + cell_size };
+}
+
 AscFile Topography::to_asc_file( Topography::Output output )
 {
     AscFile asc_file{};
@@ -18,6 +69,8 @@ AscFile Topography::to_asc_file( Topography::Output output )
 
     if( output == Topography::Output::Height )
     {
+        apply_accumulated_thickness();
+        flush_pending_lobes();
         asc_file.height_data = height_data;
     }
     else
@@ -38,19 +91,96 @@ bool Topography::is_point_near_boundary( const Vector2 & coordinates, double rad
     return near_x_boundary || near_y_boundary;
 }
 
-std::array<int, 2> Topography::locate_point( const Vector2 & coordinates )
+void Topography::compute_distance_to_invalid( std::optional<double> no_data_value )
 {
-    const bool outside_x = coordinates[0] < x_data[0] || coordinates[0] >= x_data.periodic( -1 ) + cell_size();
-    const bool outside_y = coordinates[1] < y_data[0] || coordinates[1] >= y_data.periodic( -1 ) + cell_size();
+    // Without no data cells, the distances are the distances to the edges, which are computed on the fly
+    const bool has_no_data = no_data_value.has_value()
+                             && std::any_of(
+                                 height_data.begin(), height_data.end(),
+                                 [&]( double height ) { return height <= no_data_value.value(); } );
+    if( !has_no_data )
+    {
+        distance_to_invalid_data = xt::xtensor<uint16_t, 2>{};
+        return;
+    }
+
+    const int n_x = height_data.shape()[0];
+    const int n_y = height_data.shape()[1];
+
+    auto & distance_to_invalid = distance_to_invalid_data;
+    distance_to_invalid        = xt::xtensor<uint16_t, 2>::from_shape( { std::size_t( n_x ), std::size_t( n_y ) } );
+
+    // The cells beyond the edges are invalid, so every cell starts with its distance to the closest edge
+    for( int idx_x = 0; idx_x < n_x; idx_x++ )
+    {
+        for( int idx_y = 0; idx_y < n_y; idx_y++ )
+        {
+            int d = distance_to_edge( idx_x, idx_y );
+            if( height_data( idx_x, idx_y ) <= no_data_value.value() )
+            {
+                d = 0;
+            }
+            distance_to_invalid( idx_x, idx_y ) = d;
+        }
+    }
 
-    if( outside_x || outside_y )
+    // Two pass chamfer transform with the 8-neighbourhood, which gives the exact Chebyshev distance
+    auto relax = [&]( int idx_x, int idx_y, int idx_x_neighbour, int idx_y_neighbour )
+    {
+        if( idx_x_neighbour < 0 || idx_x_neighbour >= n_x || idx_y_neighbour < 0 || idx_y_neighbour >= n_y )
+        {
+            return;
+        }
+        const int d = distance_to_invalid( idx_x_neighbour, idx_y_neighbour ) + 1;
+        if( d < distance_to_invalid( idx_x, idx_y ) )
+        {
+            distance_to_invalid( idx_x, idx_y ) = d;
+        }
+    };
+
+    for( int idx_x = 0; idx_x < n_x; idx_x++ )
+    {
+        for( int idx_y = 0; idx_y < n_y; idx_y++ )
+        {
+            relax( idx_x, idx_y, idx_x - 1, idx_y - 1 );
+            relax( idx_x, idx_y, idx_x - 1, idx_y );
+            relax( idx_x, idx_y, idx_x - 1, idx_y + 1 );
+            relax( idx_x, idx_y, idx_x, idx_y - 1 );
+        }
+    }
+
+    for( int idx_x = n_x - 1; idx_x >= 0; idx_x-- )
+    {
+        for( int idx_y = n_y - 1; idx_y >= 0; idx_y-- )
+        {
+            relax( idx_x, idx_y, idx_x + 1, idx_y + 1 );
+            relax( idx_x, idx_y, idx_x + 1, idx_y );
+            relax( idx_x, idx_y, idx_x + 1, idx_y - 1 );
+            relax( idx_x, idx_y, idx_x, idx_y + 1 );
+        }
+    }
+}
+
+bool Topography::is_point_near_invalid( const Vector2 & coordinates, double radius )
+{
+    if( grid.is_outside( coordinates ) )
+    {
+        return true;
+    }
+
+    const auto [idx_x, idx_y] = grid.cell_index( coordinates );
+    const int n               = std::ceil( radius / grid.cell_size );
+    return distance_to_invalid( idx_x, idx_y ) <= n;
+}
+
+std::array<int, 2> Topography::locate_point( const Vector2 & coordinates )
+{
+    if( grid.is_outside( coordinates ) )
     {
         throw std::runtime_error( "Cannot locate point, because coordinates are outside of grid!" );
     }
 
-    const int idx_x = int( ( coordinates[0] - x_data[0] ) / cell_size() );
-    const int idx_y = int( ( coordinates[1] - y_data[0] ) / cell_size() );
-    return { idx_x, idx_y };
+    return grid.cell_index( coordinates );
 }
 
 Topography::BoundingBox Topography::bounding_box( const Vector2 & center, double extent_x, double extent_y )
@@ -70,18 +200,11 @@ Topography::BoundingBox Topography::bounding_box( const Vector2 & center, double
 
 LobeCells Topography::get_cells_intersecting_lobe( const Lobe & lobe, std::optional<int> idx_cache )
 {
-    // Can we use the cache?
-    bool use_cache = idx_cache.has_value() && ( intersection_cache.size() > idx_cache.value() );
-
-    if( use_cache )
+    // Does the cache already contain a value?
+    if( idx_cache.has_value() && idx_cache.value() < int( intersection_cache.size() )
+        && intersection_cache[idx_cache.value()].has_value() )
     {
-        std::optional<LobeCells> cached_lobe_cells = intersection_cache[idx_cache.value()];
-
-        // Does the cache already contain a value?
-        if( cached_lobe_cells.has_value() ) // If yes, we return it
-        {
-            return cached_lobe_cells.value();
-        }
+        return intersection_cache[idx_cache.value()].value();
     }
 
     LobeCells res{};
@@ -90,6 +213,22 @@ LobeCells Topography::get_cells_intersecting_lobe( const Lobe & lobe, std::optio
 
     auto extent_xy = lobe.extent_xy();
 
+    // The scan below needs the rows above and below the lobe. Lobes which reach beyond them (only on an inner grid,
+    // since the flows stop before they reach the edges of the outer grid) are clipped to the grid
+    const double x_lower = ( lobe.center[0] - extent_xy[0] - grid.origin[0] ) / grid.cell_size;
+    const double x_upper = ( lobe.center[0] + extent_xy[0] - grid.origin[0] ) / grid.cell_size;
+    const double y_lower = ( lobe.center[1] - extent_xy[1] - grid.origin[1] ) / grid.cell_size;
+    const double y_upper = ( lobe.center[1] + extent_xy[1] - grid.origin[1] ) / grid.cell_size;
+    if( !( x_lower >= 0 && x_upper < grid.n_x && y_lower >= 0 && y_upper < grid.n_y - 1 ) )
+    {
+        res = get_cells_intersecting_clipped_lobe( lobe, { x_lower, x_upper, y_lower, y_upper } );
+        if( idx_cache.has_value() )
+        {
+            store_in_intersection_cache( idx_cache.value(), res );
+        }
+        return res;
+    }
+
     // push_back cells with x index in the interval [idx_start, idx_stop]
     auto push_back_cells = [&]( LobeCells::cellvecT & cells, int idx_start, int idx_stop, int idx_y )
     {
@@ -100,8 +239,8 @@ LobeCells Topography::get_cells_intersecting_lobe( const Lobe & lobe, std::optio
     };
 
     // The minimum and the maximum y index of the bounding box
-    int idx_y_min = ( lobe.center[1] - extent_xy[1] - y_data[0] ) / cell_size();
-    int idx_y_max = ( lobe.center[1] + extent_xy[1] - y_data[0] ) / cell_size();
+    int idx_y_min = y_lower;
+    int idx_y_max = y_upper;
 
     // We scan the bounding box of the ellipse in rows
     const int n_rows = idx_y_max - idx_y_min + 1;
@@ -133,8 +272,8 @@ LobeCells Topography::get_cells_intersecting_lobe( const Lobe & lobe, std::optio
         {
             const auto p1        = points.value()[0];
             const auto p2        = points.value()[1];
-            idx_x_left[idx_row]  = ( p1[0] - x_data[0] ) / cell_size();
-            idx_x_right[idx_row] = ( p2[0] - x_data[0] ) / cell_size();
+            idx_x_left[idx_row]  = ( p1[0] - grid.origin[0] ) / grid.cell_size;
+            idx_x_right[idx_row] = ( p2[0] - grid.origin[0] ) / grid.cell_size;
         }
 
         const int & idx_left_cur  = idx_x_left[idx_row];
@@ -175,115 +314,222 @@ LobeCells Topography::get_cells_intersecting_lobe( const Lobe & lobe, std::optio
     res.cells_enclosed     = std::move( cells_enclosed );
 
     // If the cache is used, we copy the intersection data there
-    if( use_cache )
+    if( idx_cache.has_value() )
     {
-        intersection_cache[idx_cache.value()] = res;
+        store_in_intersection_cache( idx_cache.value(), res );
     }
 
     return res;
 }
 
+LobeCells Topography::get_cells_intersecting_clipped_lobe( const Lobe & lobe, const std::array<double, 4> & box ) const
+{
+    const int idx_x_lower  = std::max( int( std::floor( box[0] ) ), 0 );
+    const int idx_x_higher = std::min( int( std::floor( box[1] ) ), grid.n_x - 1 );
+    const int idx_y_lower  = std::max( int( std::floor( box[2] ) ), 0 );
+    const int idx_y_higher = std::min( int( std::floor( box[3] ) ), grid.n_y - 1 );
+
+    // Since the lobe is convex, a cell is enclosed if its four corners are in the lobe. Cells without a corner in the
+    // lobe can still be crossed by its boundary, which the rasterization finds. The cells are sorted by rows, as in
+    // the scan
+    LobeCells res{};
+    for( int idx_y = idx_y_lower; idx_y <= idx_y_higher; idx_y++ )
+    {
+        const double y_min = y_data[idx_y];
+        const double y_max = y_min + cell_size();
+        for( int idx_x = idx_x_lower; idx_x <= idx_x_higher; idx_x++ )
+        {
+            const double x_min = x_data[idx_x];
+            const double x_max = x_min + cell_size();
+            const int n_corners_in
+                = lobe.is_point_in_lobe( { x_min, y_min } ) + lobe.is_point_in_lobe( { x_max, y_min } )
+                  + lobe.is_point_in_lobe( { x_min, y_max } ) + lobe.is_point_in_lobe( { x_max, y_max } );
+
+            if( n_corners_in == 4 )
+            {
+                res.cells_enclosed.push_back( { idx_x, idx_y } );
+            }
+            else if( n_corners_in > 0 || intersection_fraction( lobe, idx_x, idx_y, n_intersection_points ) > 0 )
+            {
+                res.cells_intersecting.push_back( { idx_x, idx_y } );
+            }
+        }
+    }
+    return res;
+}
+
 std::vector<std::pair<std::array<int, 2>, double>>
 Topography::compute_intersection( const Lobe & lobe, std::optional<int> idx_cache, int N )
 {
-    auto lobe_cells = get_cells_intersecting_lobe( lobe, idx_cache );
+    return intersection_fractions( lobe, get_cells_intersecting_lobe( lobe, idx_cache ), N, true );
+}
+
+std::vector<std::pair<std::array<int, 2>, double>>
+Topography::intersection_fractions(
+    const Lobe & lobe, const LobeCells & lobe_cells, int N, bool allow_row_blocks ) const
+{
+    const auto & cells_enclosed     = lobe_cells.cells_enclosed;
+    const auto & cells_intersecting = lobe_cells.cells_intersecting;
 
-    std::vector<std::pair<std::array<int, 2>, double>> res{};
-    res.reserve( lobe_cells.cells_intersecting.size() + lobe_cells.cells_enclosed.size() );
+    std::vector<std::pair<std::array<int, 2>, double>> res( cells_enclosed.size() + cells_intersecting.size() );
 
     // All enclosed cells are fully covered
-    for( const auto & [idx_x, idx_y] : lobe_cells.cells_enclosed )
+    for( std::size_t idx = 0; idx < cells_enclosed.size(); idx++ )
+    {
+        res[idx] = { cells_enclosed[idx], 1.0 };
+    }
+
+    // The intersecting cells get rasterized into columns
+    auto rasterize = [&]( std::size_t idx_begin, std::size_t idx_end )
+    {
+        for( std::size_t idx = idx_begin; idx < idx_end; idx++ )
+        {
+            const auto [idx_x, idx_y]        = cells_intersecting[idx];
+            res[cells_enclosed.size() + idx] = { { idx_x, idx_y }, intersection_fraction( lobe, idx_x, idx_y, N ) };
+        }
+    };
+
+    if( allow_row_blocks && uses_row_blocks( res.size() ) )
+    {
+        for_each_row_block(
+            *row_block_pool, cells_intersecting.size(), [&]( std::size_t idx ) { return cells_intersecting[idx][1]; },
+            rasterize );
+    }
+    else
     {
-        res.push_back( { { idx_x, idx_y }, 1.0 } );
+        rasterize( 0, cells_intersecting.size() );
     }
 
+    return res;
+}
+
+double Topography::intersection_fraction( const Lobe & lobe, int idx_x, int idx_y, int N ) const
+{
     const double cell_size = this->cell_size();
     const double cell_area = cell_size * cell_size;
     const double step      = cell_size / N;
 
-    // The intersecting cells get rasterized into columns
-    for( const auto & [idx_x, idx_y] : lobe_cells.cells_intersecting )
-    {
-        const double y_min = y_data[idx_y];
-        const double y_max = y_data[idx_y] + cell_size;
+    const double y_min = y_data[idx_y];
+    const double y_max = y_data[idx_y] + cell_size;
 
-        double area = 0;
-        for( int ix = 0; ix < N; ix++ )
-        {
-            const double x = x_data[idx_x] + step * ix;
+    double area = 0;
+    for( int ix = 0; ix < N; ix++ )
+    {
+        const double x = x_data[idx_x] + step * ix;
 
-            // For each column we check if the endpoints are in our outside of the lobe
-            const bool y_min_in = lobe.is_point_in_lobe( { x, y_min } );
-            const bool y_max_in = lobe.is_point_in_lobe( { x, y_max } );
+        // For each column we check if the endpoints are in our outside of the lobe
+        const bool y_min_in = lobe.is_point_in_lobe( { x, y_min } );
+        const bool y_max_in = lobe.is_point_in_lobe( { x, y_max } );
 
-            // If both endpoints are inside the lobe, the entire column is inside the lobe
-            if( y_min_in && y_max_in )
-            {
-                area += cell_size;
-                continue;
-            }
+        // If both endpoints are inside the lobe, the entire column is inside the lobe
+        if( y_min_in && y_max_in )
+        {
+            area += cell_size;
+            continue;
+        }
 
-            // If both endpoints are outside the lobe, the entire column is outside the lobe
-            if( !( y_min_in || y_max_in ) )
-            {
-                continue;
-            }
+        // If both endpoints are outside the lobe, the entire column is outside the lobe
+        if( !( y_min_in || y_max_in ) )
+        {
+            continue;
+        }
 
-            // Now we know that one endpoint is inside the lobe and one endpoint is outside of it
+        // Now we know that one endpoint is inside the lobe and one endpoint is outside of it
 
-            // {x,y_lo} should be inside the lobe
-            double y_lo        = y_min_in ? y_min : y_max;
-            const double y_end = y_lo;
+        // {x,y_lo} should be inside the lobe
+        double y_lo        = y_min_in ? y_min : y_max;
+        const double y_end = y_lo;
 
-            // {x,y_hi} should be outside the lobe
-            double y_hi = !y_min_in ? y_min : y_max;
-            double y_cur{};
+        // {x,y_hi} should be outside the lobe
+        double y_hi = !y_min_in ? y_min : y_max;
+        double y_cur{};
 
-            // Now we try to find the height at wich the ellipse passed the columns
-            // with four iterations of bisection search
-            for( int it = 0; it < 4; it++ )
-            {
-                y_cur = 0.5 * ( y_lo + y_hi );
+        // Now we try to find the height at wich the ellipse passed the columns
+        // with four iterations of bisection search
+        for( int it = 0; it < 4; it++ )
+        {
+            y_cur = 0.5 * ( y_lo + y_hi );
 
-                // If y_cur is inside the lobe, we make y_cur y_lo
-                const bool y_cur_in = lobe.is_point_in_lobe( { x, y_cur } );
-                y_lo                = y_cur_in ? y_cur : y_lo;
-                y_hi                = !y_cur_in ? y_cur : y_hi;
-            }
-            area += std::abs( y_cur - y_end );
+            // If y_cur is inside the lobe, we make y_cur y_lo
+            const bool y_cur_in = lobe.is_point_in_lobe( { x, y_cur } );
+            y_lo                = y_cur_in ? y_cur : y_lo;
+            y_hi                = !y_cur_in ? y_cur : y_hi;
         }
-        const double fraction = area * step / cell_area;
-        res.push_back( { { idx_x, idx_y }, fraction } );
+        area += std::abs( y_cur - y_end );
     }
-
-    return res;
+    return area * step / cell_area;
 }
 
-void Topography::compute_hazard_flow( const std::vector<Lobe> & lobes, MatrixX & flow_hazard )
+void Topography::compute_hazard_flow( const LobeStore & lobes, MatrixX & flow_hazard )
 {
     std::fill( flow_hazard.begin(), flow_hazard.end(), 0 );
 
     // This computes the hazard for *one* flow
     // For one flow, the hazard of a cell is the maximum of lobe.n_descendant over all lobes touching it
-    for( size_t idx = 0; idx < lobes.size(); idx++ )
+    for( int idx = 0; idx < lobes.size(); idx++ )
     {
-        const auto & lobe = lobes[idx];
-        auto lobe_cells   = get_cells_intersecting_lobe( lobe, idx );
+        const int n_descendents = lobes.n_descendents[idx];
+        auto lobe_cells         = get_cells_intersecting_lobe( lobes.lobe( idx ), idx );
 
         for( const auto & [idx_x, idx_y] : lobe_cells.cells_enclosed )
         {
-            flow_hazard( idx_x, idx_y ) = std::max<int>( lobe.n_descendents, flow_hazard( idx_x, idx_y ) );
+            flow_hazard( idx_x, idx_y ) = std::max<int>( n_descendents, flow_hazard( idx_x, idx_y ) );
         }
 
         for( const auto & [idx_x, idx_y] : lobe_cells.cells_intersecting )
         {
-            flow_hazard( idx_x, idx_y ) = std::max<int>( lobe.n_descendents, flow_hazard( idx_x, idx_y ) );
+            flow_hazard( idx_x, idx_y ) = std::max<int>( n_descendents, flow_hazard( idx_x, idx_y ) );
         }
     }
 }
 
 std::pair<double, Vector2> Topography::height_and_slope( const Vector2 & coordinates )
 {
+    if( inner_grids.empty() )
+    {
+        return interpolate_height_and_slope( coordinates );
+    }
+
+    // The distances to the edges of the inner grid (negative outside of it), in the order -x, +x, -y, +y
+    Topography & inner                    = inner_grids.front();
+    const GridGeometry & g                = inner.grid;
+    const std::array<double, 4> distances = { coordinates[0] - g.origin[0], g.upper_corner[0] - coordinates[0],
+                                              coordinates[1] - g.origin[1], g.upper_corner[1] - coordinates[1] };
+    const int idx_edge                    = std::min_element( distances.begin(), distances.end() ) - distances.begin();
+
+    // The weight of the inner grid rises linearly from 0 to 1 over two cells of this grid, starting one cell of the
+    // inner grid away from its edge (where the interpolation on the inner grid does not yet use clamped cells)
+    const double band_width = 2.0 * cell_size();
+    const double weight     = ( distances[idx_edge] - g.cell_size ) / band_width;
+
+    if( weight <= 0 )
+    {
+        return interpolate_height_and_slope( coordinates );
+    }
+    if( weight >= 1 )
+    {
+        return inner.interpolate_height_and_slope( coordinates );
+    }
+
+    const auto [height_outer, slope_outer] = interpolate_height_and_slope( coordinates );
+    const auto [height_inner, slope_inner] = inner.interpolate_height_and_slope( coordinates );
+
+    // The slope is the negative gradient, so the gradient of the weight enters with a minus sign
+    Vector2 weight_gradient       = { 0, 0 };
+    weight_gradient[idx_edge / 2] = ( idx_edge % 2 == 0 ? 1.0 : -1.0 ) / band_width;
+
+    const double height_difference = height_inner - height_outer;
+    return { height_outer + weight * height_difference,
+             slope_outer + weight * ( slope_inner - slope_outer ) - height_difference * weight_gradient };
+}
+
+std::pair<double, Vector2> Topography::interpolate_height_and_slope( const Vector2 & coordinates )
+{
+    if( pyramid_level > 0 )
+    {
+        return height_and_slope_on_level( coordinates );
+    }
+
     const auto [idx_x, idx_y] = locate_point( coordinates );
     const Vector2 cell_center = { x_data[idx_x] + 0.5 * cell_size(), y_data[idx_y] + 0.5 * cell_size() };
 
@@ -315,36 +561,799 @@ std::pair<double, Vector2> Topography::height_and_slope( const Vector2 & coordin
     const Vector2 cell_center_lower_left
         = { x_data[idx_x_lower] + 0.5 * cell_size(), y_data[idx_y_lower] + 0.5 * cell_size() };
 
-    const double Z00 = height_data( idx_x_lower, idx_y_lower );
-    const double Z10 = height_data( idx_x_higher, idx_y_lower );
-    const double Z01 = height_data( idx_x_lower, idx_y_higher );
-    const double Z11 = height_data( idx_x_higher, idx_y_higher );
+    // Lobes in the lobe window and the deferred lobes, which cover the (up to four) corner cells, are applied first
+    if( !slope_source_enabled )
+    {
+        apply_accumulated_thickness();
+    }
+    if( ( lobe_application_deferred || !lobe_window.empty() ) && !slope_source_enabled )
+    {
+        flush_pending_lobes( idx_x_lower, idx_y_lower );
+        flush_pending_lobes( idx_x_higher, idx_y_lower );
+        flush_pending_lobes( idx_x_lower, idx_y_higher );
+        flush_pending_lobes( idx_x_higher, idx_y_higher );
+    }
+
+    if( tile_tracking )
+    {
+        mark_tile_read( idx_x_lower, idx_y_lower );
+        mark_tile_read( idx_x_higher, idx_y_lower );
+        mark_tile_read( idx_x_lower, idx_y_higher );
+        mark_tile_read( idx_x_higher, idx_y_higher );
+    }
+
+    const MatrixX & heights = slope_source_enabled ? slope_source() : height_data;
+
+    const double Z00 = heights( idx_x_lower, idx_y_lower );
+    const double Z10 = heights( idx_x_higher, idx_y_lower );
+    const double Z01 = heights( idx_x_lower, idx_y_higher );
+    const double Z11 = heights( idx_x_higher, idx_y_higher );
 
     const double alpha = Z10 - Z00;
     const double beta  = Z01 - Z00;
     const double gamma = Z11 + Z00 - Z10 - Z01;
 
-    const Vector2 xp = ( coordinates - cell_center_lower_left ) / cell_size();
+    const Vector2 xp = ( coordinates - cell_center_lower_left ) / grid.cell_size;
 
     const double height = Z00 + alpha * xp[0] + beta * xp[1] + gamma * xp[0] * xp[1];
     const Vector2 slope = { alpha + gamma * xp[1], beta + gamma * xp[0] };
 
-    return { height, -slope / cell_size() };
+    return { height, -slope / grid.cell_size };
 }
 
 void Topography::add_lobe( const Lobe & lobe, std::optional<int> idx_cache )
 {
+    if( !inner_grids.empty() )
+    {
+        const GridGeometry & g = inner_grids.front().grid;
+        const auto extent_xy   = lobe.extent_xy();
+        if( lobe.center[0] + extent_xy[0] > g.origin[0] && lobe.center[0] - extent_xy[0] < g.upper_corner[0]
+            && lobe.center[1] + extent_xy[1] > g.origin[1] && lobe.center[1] - extent_xy[1] < g.upper_corner[1] )
+        {
+            inner_grids.front().add_lobe( lobe, idx_cache );
+        }
+    }
+
+    if( thickness_accumulated )
+    {
+        add_lobe_accumulated( lobe, idx_cache );
+        return;
+    }
+
+    if( lobe_window_size > 1 )
+    {
+        const auto extent_xy = lobe.extent_xy();
+        const auto box       = bounding_box( lobe.center, extent_xy[0], extent_xy[1] );
+        if( lobe_window.empty() )
+        {
+            lobe_window_box = box;
+        }
+        else
+        {
+            lobe_window_box.idx_x_lower  = std::min( lobe_window_box.idx_x_lower, box.idx_x_lower );
+            lobe_window_box.idx_x_higher = std::max( lobe_window_box.idx_x_higher, box.idx_x_higher );
+            lobe_window_box.idx_y_lower  = std::min( lobe_window_box.idx_y_lower, box.idx_y_lower );
+            lobe_window_box.idx_y_higher = std::max( lobe_window_box.idx_y_higher, box.idx_y_higher );
+        }
+        lobe_window.push_back( { lobe, idx_cache, box } );
+
+        if( int( lobe_window.size() ) >= lobe_window_size )
+        {
+            flush_lobe_window();
+        }
+        return;
+    }
+
     // In this function we simply add the thickness of the lobe to the topography
     // First, we find the intersected cells and the covered fractions
-    std::vector<std::pair<std::array<int, 2>, double>> intersection_data = compute_intersection( lobe, idx_cache );
+    add_intersection( lobe, compute_intersection( lobe, idx_cache ) );
+}
+
+void Topography::add_intersection(
+    const Lobe & lobe, const std::vector<std::pair<std::array<int, 2>, double>> & intersection_data )
+{
+    if( lobe_journal_enabled )
+    {
+        for( auto const & [indices, fraction] : intersection_data )
+        {
+            journal.push_back( { std::size_t( indices[0] ) * grid.n_y + indices[1], fraction * lobe.thickness } );
+        }
+    }
+
+    if( lobe_application_deferred )
+    {
+        // The thickness is queued on the tiles, instead of being added right away
+        const std::size_t n_y = grid.n_y;
+        for( auto const & [indices, fraction] : intersection_data )
+        {
+            const int idx_tile = tile_index( indices[0], indices[1] );
+            auto & pending     = pending_lobe_cells[idx_tile];
+            if( pending.empty() )
+            {
+                tiles_with_pending_lobes.push_back( idx_tile );
+            }
+            pending.push_back( { indices[0] * n_y + indices[1], fraction * lobe.thickness } );
+        }
+        n_pending_cells += intersection_data.size();
+    }
+    else
+    {
+        // Then we add the tickness according to the fractions
+        auto add_thickness = [&]( std::size_t idx_begin, std::size_t idx_end )
+        {
+            for( std::size_t idx = idx_begin; idx < idx_end; idx++ )
+            {
+                const auto & [indices, fraction] = intersection_data[idx];
+                height_data( indices[0], indices[1] ) += fraction * lobe.thickness;
+            }
+        };
+
+        // A cell can occur twice in a row (where the left and the right boundary of a narrow lobe meet), but never in
+        // two rows, so the row blocks never add to the same cell concurrently
+        if( uses_row_blocks( intersection_data.size() ) )
+        {
+            for_each_row_block(
+                *row_block_pool, intersection_data.size(),
+                [&]( std::size_t idx ) { return intersection_data[idx].first[1]; }, add_thickness );
+        }
+        else
+        {
+            add_thickness( 0, intersection_data.size() );
+        }
+    }
+
+    if( is_slope_source_refreshable() )
+    {
+        for( auto const & [indices, fraction] : intersection_data )
+        {
+            mark_slope_tile_dirty( tile_index( indices[0], indices[1] ) );
+        }
+    }
+    else if( !slope_source_enabled )
+    {
+        if( tile_tracking )
+        {
+            for( auto const & [indices, fraction] : intersection_data )
+            {
+                mark_tile_changed( tile_index( indices[0], indices[1] ) );
+            }
+        }
+        if( pyramid_level > 0 )
+        {
+            for( auto const & [indices, fraction] : intersection_data )
+            {
+                mark_pyramid_cell_dirty( indices[0], indices[1] );
+            }
+        }
+    }
+}
+
+void Topography::add_lobe_accumulated( const Lobe & lobe, std::optional<int> idx_cache )
+{
+    const auto lobe_cells          = get_cells_intersecting_lobe( lobe, idx_cache );
+    const auto & enclosed          = lobe_cells.cells_enclosed;
+    const int n_x                  = grid.n_x;
+    const int64_t thickness_quanta = std::llround( lobe.thickness / thickness_quantum );
+
+    // The enclosed cells come in rows of consecutive x indices
+    std::size_t idx_start = 0;
+    while( idx_start < enclosed.size() )
+    {
+        const auto [idx_x_start, idx_y] = enclosed[idx_start];
+        std::size_t idx_stop            = idx_start;
+        while( idx_stop + 1 < enclosed.size() && enclosed[idx_stop + 1][1] == idx_y
+               && enclosed[idx_stop + 1][0] == enclosed[idx_stop][0] + 1 )
+        {
+            idx_stop++;
+        }
+        const int idx_x_stop = enclosed[idx_stop][0];
+
+        thickness_difference_data( idx_x_start, idx_y ) += thickness_quanta;
+        if( idx_x_stop + 1 < n_x )
+        {
+            thickness_difference_data( idx_x_stop + 1, idx_y ) -= thickness_quanta;
+        }
+
+        if( is_slope_source_refreshable() )
+        {
+            for( int idx_tile_x = idx_x_start / tile_size; idx_tile_x <= idx_x_stop / tile_size; idx_tile_x++ )
+            {
+                mark_slope_tile_dirty( tile_index( idx_tile_x * tile_size, idx_y ) );
+            }
+        }
+        idx_start = idx_stop + 1;
+    }
+    has_accumulated_thickness = has_accumulated_thickness || !enclosed.empty();
 
-    // Then we add the tickness according to the fractions
-    for( auto const & [indices, fraction] : intersection_data )
+    for( const auto & [idx_x, idx_y] : lobe_cells.cells_intersecting )
     {
-        height_data( indices[0], indices[1] ) += fraction * lobe.thickness;
+        const double fraction = intersection_fraction( lobe, idx_x, idx_y, n_intersection_points );
+        height_data( idx_x, idx_y ) += fraction * lobe.thickness;
+        if( is_slope_source_refreshable() )
+        {
+            mark_slope_tile_dirty( tile_index( idx_x, idx_y ) );
+        }
+        else if( !slope_source_enabled )
+        {
+            mark_pyramid_cell_dirty( idx_x, idx_y );
+        }
     }
 }
 
+void Topography::set_thickness_accumulation( bool accumulate )
+{
+    for( auto & inner : inner_grids )
+    {
+        inner.set_thickness_accumulation( accumulate );
+    }
+    apply_accumulated_thickness();
+    thickness_accumulated     = accumulate;
+    if( accumulate )
+    {
+        thickness_difference_data = xt::zeros<int64_t>( height_data.shape() );
+    }
+    else
+    {
+        thickness_difference_data = xt::xtensor<int64_t, 2>{};
+    }
+}
+
+void Topography::apply_thickness_difference()
+{
+    const int n_x = height_data.shape()[0];
+    const int n_y = height_data.shape()[1];
+
+    // The running sum along x of the difference array is the accumulated thickness. The inner loop goes along the
+    // contiguous y axis
+    std::vector<int64_t> thickness_quanta( n_y, 0 );
+    for( int idx_x = 0; idx_x < n_x; idx_x++ )
+    {
+        int64_t * difference = &thickness_difference_data( idx_x, 0 );
+        double * height      = &height_data( idx_x, 0 );
+        for( int idx_y = 0; idx_y < n_y; idx_y++ )
+        {
+            thickness_quanta[idx_y] += difference[idx_y];
+            height[idx_y] += thickness_quanta[idx_y] * thickness_quantum;
+            difference[idx_y] = 0;
+        }
+    }
+    has_accumulated_thickness = false;
+    if( !slope_source_enabled )
+    {
+        mark_all_pyramid_tiles_dirty();
+    }
+}
+
+void Topography::set_deferred_lobe_application( bool deferred )
+{
+    for( auto & inner : inner_grids )
+    {
+        inner.set_deferred_lobe_application( deferred );
+    }
+    flush_pending_lobes();
+    lobe_application_deferred = deferred;
+    pending_lobe_cells.assign( deferred ? std::size_t( n_tiles_x() ) * n_tiles_y() : 0, {} );
+}
+
+void Topography::flush_pending_tile( int idx_tile )
+{
+    auto & pending = pending_lobe_cells[idx_tile];
+    double * data  = height_data.data();
+    for( const auto & [idx_cell, thickness] : pending )
+    {
+        data[idx_cell] += thickness;
+    }
+    n_pending_cells -= pending.size();
+    pending.clear(); // Keeps the capacity for the next flow
+}
+
+void Topography::set_row_blocks( int min_cells, ThreadPool * pool )
+{
+    row_block_min_cells = min_cells;
+    row_block_pool      = pool;
+}
+
+void Topography::set_lobe_window( int window_size, ThreadPool * pool )
+{
+    flush_lobe_window();
+    lobe_window_size = window_size;
+    lobe_window_pool = pool;
+}
+
+void Topography::flush_lobe_window()
+{
+    if( lobe_window.empty() )
+    {
+        return;
+    }
+
+    // Without a cache index, get_cells_intersecting_lobe only reads the grid, so the lobes can be rasterized
+    // concurrently. The cache and the heights are only updated afterwards, in the order of the lobes. A single lobe
+    // (when a query ended the window right away) can still be split into row blocks
+    if( lobe_window.size() == 1 )
+    {
+        auto & w            = lobe_window.front();
+        w.lobe_cells        = get_cells_intersecting_lobe( w.lobe );
+        w.intersection_data = intersection_fractions( w.lobe, w.lobe_cells, n_intersection_points, true );
+    }
+    else
+    {
+        lobe_window_pool->parallel_for(
+            lobe_window.size(),
+            [&]( int idx )
+            {
+                auto & w            = lobe_window[idx];
+                w.lobe_cells        = get_cells_intersecting_lobe( w.lobe );
+                w.intersection_data = intersection_fractions( w.lobe, w.lobe_cells, n_intersection_points, false );
+            } );
+    }
+
+    for( const auto & w : lobe_window )
+    {
+        if( w.idx_cache.has_value() )
+        {
+            store_in_intersection_cache( w.idx_cache.value(), w.lobe_cells );
+        }
+        add_intersection( w.lobe, w.intersection_data );
+    }
+    lobe_window.clear();
+}
+
+void Topography::flush_pending_lobes()
+{
+    for( auto & inner : inner_grids )
+    {
+        inner.flush_pending_lobes();
+    }
+    flush_lobe_window();
+
+    if( n_pending_cells == 0 )
+    {
+        tiles_with_pending_lobes.clear();
+        return;
+    }
+
+    // Tiles which were flushed by a query are already empty. Going through the tiles in order keeps the writes local
+    std::sort( tiles_with_pending_lobes.begin(), tiles_with_pending_lobes.end() );
+    for( int idx_tile : tiles_with_pending_lobes )
+    {
+        if( !pending_lobe_cells[idx_tile].empty() )
+        {
+            flush_pending_tile( idx_tile );
+        }
+    }
+    tiles_with_pending_lobes.clear();
+}
+
+void Topography::set_lobe_journal( bool enabled )
+{
+    lobe_journal_enabled = enabled;
+    journal.clear();
+}
+
+void Topography::apply_lobe_journal( const std::vector<CellIncrement> & increments )
+{
+    apply_accumulated_thickness();
+    flush_pending_lobes();
+
+    double * data = height_data.data();
+    for( const auto & [idx_cell, thickness] : increments )
+    {
+        data[idx_cell] += thickness;
+
+        const int idx_x    = idx_cell / grid.n_y;
+        const int idx_y    = idx_cell % grid.n_y;
+        const int idx_tile = tile_index( idx_x, idx_y );
+        if( is_slope_source_refreshable() )
+        {
+            mark_slope_tile_dirty( idx_tile );
+        }
+        else if( !slope_source_enabled )
+        {
+            if( tile_tracking )
+            {
+                mark_tile_changed( idx_tile );
+            }
+            mark_pyramid_cell_dirty( idx_x, idx_y );
+        }
+    }
+}
+
+void Topography::set_tile_tracking( bool enabled )
+{
+    tile_tracking             = enabled;
+    const std::size_t n_tiles = enabled ? std::size_t( n_tiles_x() ) * n_tiles_y() : 0;
+    is_tile_read.assign( n_tiles, 0 );
+    is_tile_changed.assign( n_tiles, 0 );
+    tiles_read_list.clear();
+    tiles_changed_list.clear();
+}
+
+void Topography::reset_tile_tracking()
+{
+    for( int idx_tile : tiles_read_list )
+    {
+        is_tile_read[idx_tile] = 0;
+    }
+    for( int idx_tile : tiles_changed_list )
+    {
+        is_tile_changed[idx_tile] = 0;
+    }
+    tiles_read_list.clear();
+    tiles_changed_list.clear();
+}
+
+std::array<int, 4> Topography::tile_extent( int idx_tile ) const
+{
+    const int idx_x_lower = ( idx_tile / n_tiles_y() ) * tile_size;
+    const int idx_y_lower = ( idx_tile % n_tiles_y() ) * tile_size;
+    return { idx_x_lower, std::min( idx_x_lower + tile_size, grid.n_x ), idx_y_lower,
+             std::min( idx_y_lower + tile_size, grid.n_y ) };
+}
+
+void Topography::copy_tiles_from( const Topography & source, const std::vector<int> & tiles )
+{
+    if( is_slope_source_shared() )
+    {
+        for( int idx_tile : tiles )
+        {
+            mark_pyramid_tile_dirty( idx_tile );
+        }
+        return;
+    }
+
+    MatrixX & heights             = slope_source_enabled ? slope_height_data : height_data;
+    const MatrixX & heights_source = source.slope_source_enabled ? source.slope_height_data : source.height_data;
+    if( heights.shape() != heights_source.shape() )
+    {
+        throw std::runtime_error( "The shape of the source topography does not match" );
+    }
+
+    // The rows of a tile are contiguous in y
+    for( int idx_tile : tiles )
+    {
+        const auto [idx_x_lower, idx_x_higher, idx_y_lower, idx_y_higher] = tile_extent( idx_tile );
+        for( int idx_x = idx_x_lower; idx_x < idx_x_higher; idx_x++ )
+        {
+            const double * row_source = &heights_source( idx_x, idx_y_lower );
+            std::copy( row_source, row_source + ( idx_y_higher - idx_y_lower ), &heights( idx_x, idx_y_lower ) );
+        }
+        mark_pyramid_tile_dirty( idx_tile );
+    }
+}
+
+Topography Topography::worker_copy()
+{
+    MatrixX hazard_kept                              = std::move( hazard );
+    std::vector<std::optional<LobeCells>> cache_kept = std::move( intersection_cache );
+    MatrixX slope_height_data_kept                   = std::move( slope_height_data );
+
+    hazard             = MatrixX{};
+    intersection_cache = {};
+    slope_height_data  = MatrixX{};
+
+    Topography worker = *this;
+
+    hazard             = std::move( hazard_kept );
+    intersection_cache = std::move( cache_kept );
+    slope_height_data  = std::move( slope_height_data_kept );
+
+    worker.cache_n_lobes   = 0;
+    worker.cache_bytes     = 0;
+    worker.cache_n_dropped = 0;
+    if( is_slope_source_refreshable() )
+    {
+        worker.shared_slope_height_data = &slope_height_data;
+        worker.is_slope_tile_dirty.clear();
+        worker.dirty_slope_tiles.clear();
+    }
+    return worker;
+}
+
+void Topography::swap_intersection_cache( Topography & other )
+{
+    std::swap( intersection_cache, other.intersection_cache );
+    std::swap( cache_n_lobes, other.cache_n_lobes );
+    std::swap( cache_max_bytes, other.cache_max_bytes );
+    std::swap( cache_bytes, other.cache_bytes );
+    std::swap( cache_n_dropped, other.cache_n_dropped );
+}
+
+void Topography::enable_slope_source()
+{
+    for( auto & inner : inner_grids )
+    {
+        inner.enable_slope_source();
+    }
+    slope_source_enabled     = true;
+    slope_height_data        = height_data;
+    shared_slope_height_data = nullptr;
+    is_slope_tile_dirty.assign( std::size_t( n_tiles_x() ) * n_tiles_y(), 0 );
+    dirty_slope_tiles.clear();
+    mark_all_pyramid_tiles_dirty();
+}
+
+void Topography::share_slope_source( const Topography & initial )
+{
+    if( initial.height_data.shape() != height_data.shape() || initial.inner_grids.size() != inner_grids.size() )
+    {
+        throw std::runtime_error( "The grids of the shared slope source do not match the topography" );
+    }
+    for( std::size_t idx = 0; idx < inner_grids.size(); idx++ )
+    {
+        inner_grids[idx].share_slope_source( initial.inner_grids[idx] );
+    }
+    slope_source_enabled     = true;
+    slope_height_data        = MatrixX{};
+    shared_slope_height_data = &initial.height_data;
+    is_slope_tile_dirty.clear();
+    dirty_slope_tiles.clear();
+    mark_all_pyramid_tiles_dirty();
+}
+
+void Topography::set_slope_source( const MatrixX & heights )
+{
+    if( is_slope_source_shared() )
+    {
+        throw std::runtime_error( "A shared slope source cannot be replaced" );
+    }
+    if( heights.shape() != height_data.shape() )
+    {
+        throw std::runtime_error( "The shape of the slope source does not match the topography" );
+    }
+    slope_height_data = heights;
+
+    dirty_slope_tiles.clear();
+    for( std::size_t idx_tile = 0; idx_tile < is_slope_tile_dirty.size(); idx_tile++ )
+    {
+        is_slope_tile_dirty[idx_tile] = 1;
+        dirty_slope_tiles.push_back( idx_tile );
+    }
+    mark_all_pyramid_tiles_dirty();
+}
+
+void Topography::refresh_slope_source( const MatrixX & height_initial, double thickening_parameter )
+{
+    apply_accumulated_thickness();
+    flush_pending_lobes();
+
+    const double flow_factor = 1.0 - thickening_parameter;
+
+    for( int idx_tile : dirty_slope_tiles )
+    {
+        const auto [idx_x_lower, idx_x_higher, idx_y_lower, idx_y_higher] = tile_extent( idx_tile );
+
+        for( int idx_x = idx_x_lower; idx_x < idx_x_higher; idx_x++ )
+        {
+            for( int idx_y = idx_y_lower; idx_y < idx_y_higher; idx_y++ )
+            {
+                const double h0                   = height_initial( idx_x, idx_y );
+                slope_height_data( idx_x, idx_y ) = h0 + flow_factor * ( height_data( idx_x, idx_y ) - h0 );
+            }
+        }
+        is_slope_tile_dirty[idx_tile] = 0;
+        if( tile_tracking )
+        {
+            mark_tile_changed( idx_tile );
+        }
+        mark_pyramid_tile_dirty( idx_tile );
+    }
+    dirty_slope_tiles.clear();
+}
+
+void Topography::refresh_slope_source( const Topography & initial, double thickening_parameter )
+{
+    for( std::size_t idx = 0; idx < inner_grids.size(); idx++ )
+    {
+        inner_grids[idx].refresh_slope_source( initial.inner_grids[idx], thickening_parameter );
+    }
+    refresh_slope_source( initial.height_data, thickening_parameter );
+}
+
+void Topography::set_inner_grid( const AscFile & asc_file )
+{
+    if( !inner_grids.empty() )
+    {
+        throw std::runtime_error( "The topography already has an inner grid" );
+    }
+
+    auto inner = Topography( asc_file );
+    if( !( inner.cell_size() < cell_size() ) )
+    {
+        throw std::runtime_error( fmt::format(
+            "The cells of the inner grid ({} m) have to be smaller than the cells of the outer grid ({} m)",
+            inner.cell_size(), cell_size() ) );
+    }
+    if( inner.grid.origin[0] < grid.origin[0] || inner.grid.origin[1] < grid.origin[1]
+        || inner.grid.upper_corner[0] > grid.upper_corner[0] || inner.grid.upper_corner[1] > grid.upper_corner[1] )
+    {
+        throw std::runtime_error( "The inner grid has to lie within the outer grid" );
+    }
+
+    // The no data cells get the heights of this grid, so that the blending never reads them
+    bool has_no_data = false;
+    for( int idx_x = 0; idx_x < inner.grid.n_x; idx_x++ )
+    {
+        for( int idx_y = 0; idx_y < inner.grid.n_y; idx_y++ )
+        {
+            if( inner.height_data( idx_x, idx_y ) <= asc_file.no_data_value )
+            {
+                const Vector2 cell_center         = { inner.x_data[idx_x] + 0.5 * inner.cell_size(),
+                                                      inner.y_data[idx_y] + 0.5 * inner.cell_size() };
+                inner.height_data( idx_x, idx_y ) = interpolate_height_and_slope( cell_center ).first;
+                has_no_data                       = true;
+            }
+        }
+    }
+    if( has_no_data )
+    {
+        inner.compute_distance_to_invalid();
+    }
+
+    // The inner grid starts with the settings of this grid
+    if( lobe_application_deferred )
+    {
+        inner.set_deferred_lobe_application( true );
+    }
+    if( thickness_accumulated )
+    {
+        inner.set_thickness_accumulation( true );
+    }
+    if( slope_source_enabled )
+    {
+        inner.enable_slope_source();
+    }
+
+    inner_grids.push_back( std::move( inner ) );
+
+    // Splits the budget of the cache with the inner grid
+    reset_intersection_cache( cache_n_lobes, cache_max_bytes );
+}
+
+void Topography::set_slope_level( int level )
+{
+    if( level < 0 || level > max_slope_level )
+    {
+        throw std::runtime_error(
+            fmt::format( "The slope level has to be between 0 and {}, but it is {}", max_slope_level, level ) );
+    }
+
+    pyramid_level = level;
+    pyramid.clear();
+    for( int idx_level = 1; idx_level <= level; idx_level++ )
+    {
+        // Cells at the upper edges can cover less than 2^l x 2^l cells of the grid
+        const int n_cells = 1 << idx_level;
+        const std::size_t n_x = ( grid.n_x + n_cells - 1 ) / n_cells;
+        const std::size_t n_y = ( grid.n_y + n_cells - 1 ) / n_cells;
+        pyramid.push_back( xt::zeros<double>( { n_x, n_y } ) );
+    }
+    pyramid_dirty_boxes.resize( level > 0 ? std::size_t( n_tiles_x() ) * n_tiles_y() : 0 );
+    mark_all_pyramid_tiles_dirty();
+}
+
+void Topography::update_pyramid_tile( int idx_tile )
+{
+    const auto [idx_x_lower, idx_x_higher, idx_y_lower, idx_y_higher] = tile_extent( idx_tile );
+
+    if( !slope_source_enabled )
+    {
+        apply_accumulated_thickness();
+        if( !lobe_window.empty() && lobe_window_box.idx_x_lower < idx_x_higher
+            && lobe_window_box.idx_x_higher >= idx_x_lower && lobe_window_box.idx_y_lower < idx_y_higher
+            && lobe_window_box.idx_y_higher >= idx_y_lower )
+        {
+            flush_lobe_window();
+        }
+        if( lobe_application_deferred && !pending_lobe_cells[idx_tile].empty() )
+        {
+            flush_pending_tile( idx_tile );
+        }
+    }
+
+    const auto [idx_x_changed_lower, idx_x_changed_higher, idx_y_changed_lower, idx_y_changed_higher]
+        = pyramid_dirty_boxes[idx_tile];
+    if( idx_x_changed_lower >= idx_x_changed_higher )
+    {
+        return;
+    }
+
+    // Every level is the mean of the 2 x 2 cells of the level below, which are inside the grid. Since the tile size is
+    // 2^max_slope_level, the cells of all levels on the tile only depend on the cells of the tile
+    const MatrixX * finer = slope_source_enabled ? &slope_source() : &height_data;
+    for( int level = 1; level <= pyramid_level; level++ )
+    {
+        MatrixX & coarser   = pyramid[level - 1];
+        const int n_x_finer = finer->shape()[0];
+        const int n_y_finer = finer->shape()[1];
+
+        for( int idx_x = idx_x_changed_lower >> level; idx_x <= ( idx_x_changed_higher - 1 ) >> level; idx_x++ )
+        {
+            for( int idx_y = idx_y_changed_lower >> level; idx_y <= ( idx_y_changed_higher - 1 ) >> level; idx_y++ )
+            {
+                double sum  = 0;
+                int n_cells = 0;
+                for( int idx_x_finer = 2 * idx_x; idx_x_finer < std::min( 2 * idx_x + 2, n_x_finer ); idx_x_finer++ )
+                {
+                    for( int idx_y_finer = 2 * idx_y; idx_y_finer < std::min( 2 * idx_y + 2, n_y_finer );
+                         idx_y_finer++ )
+                    {
+                        sum += ( *finer )( idx_x_finer, idx_y_finer );
+                        n_cells++;
+                    }
+                }
+                coarser( idx_x, idx_y ) = sum / n_cells;
+            }
+        }
+        finer = &coarser;
+    }
+    pyramid_dirty_boxes[idx_tile] = empty_box;
+}
+
+const MatrixX & Topography::pyramid_heights( int level )
+{
+    if( level < 1 || level > pyramid_level )
+    {
+        throw std::runtime_error( fmt::format( "The pyramid has no level {}", level ) );
+    }
+    for( std::size_t idx_tile = 0; idx_tile < pyramid_dirty_boxes.size(); idx_tile++ )
+    {
+        update_pyramid_tile( idx_tile );
+    }
+    return pyramid[level - 1];
+}
+
+std::pair<double, Vector2> Topography::height_and_slope_on_level( const Vector2 & coordinates )
+{
+    const MatrixX & heights    = pyramid[pyramid_level - 1];
+    const int n_x              = heights.shape()[0];
+    const int n_y              = heights.shape()[1];
+    const double inv_cell_size = grid.inv_cell_size / ( 1 << pyramid_level );
+
+    // The position in units of the coarse cells, relative to the center of the coarse cell (0, 0). Outside of the
+    // outermost cell centers, the height is constant along the edge
+    const double u = ( coordinates[0] - grid.origin[0] ) * inv_cell_size - 0.5;
+    const double v = ( coordinates[1] - grid.origin[1] ) * inv_cell_size - 0.5;
+
+    const int idx_x_floor  = int( std::floor( u ) );
+    const int idx_y_floor  = int( std::floor( v ) );
+    const int idx_x_lower  = std::clamp( idx_x_floor, 0, n_x - 1 );
+    const int idx_x_higher = std::clamp( idx_x_floor + 1, 0, n_x - 1 );
+    const int idx_y_lower  = std::clamp( idx_y_floor, 0, n_y - 1 );
+    const int idx_y_higher = std::clamp( idx_y_floor + 1, 0, n_y - 1 );
+
+    // The corner cells of the coarse cells, in the grid
+    const std::array<int, 2> corners_x = { idx_x_lower << pyramid_level, idx_x_higher << pyramid_level };
+    const std::array<int, 2> corners_y = { idx_y_lower << pyramid_level, idx_y_higher << pyramid_level };
+    for( int idx_x : corners_x )
+    {
+        for( int idx_y : corners_y )
+        {
+            update_pyramid_tile( tile_index( idx_x, idx_y ) );
+            if( tile_tracking )
+            {
+                mark_tile_read( idx_x, idx_y );
+            }
+        }
+    }
+
+    const double Z00 = heights( idx_x_lower, idx_y_lower );
+    const double Z10 = heights( idx_x_higher, idx_y_lower );
+    const double Z01 = heights( idx_x_lower, idx_y_higher );
+    const double Z11 = heights( idx_x_higher, idx_y_higher );
+
+    const double alpha = Z10 - Z00;
+    const double beta  = Z01 - Z00;
+    const double gamma = Z11 + Z00 - Z10 - Z01;
+
+    const Vector2 xp = { u - idx_x_lower, v - idx_y_lower };
+
+    const double height = Z00 + alpha * xp[0] + beta * xp[1] + gamma * xp[0] * xp[1];
+    const Vector2 slope = { alpha + gamma * xp[1], beta + gamma * xp[0] };
+
+    return { height, -slope * inv_cell_size };
+}
+
 Vector2 Topography::find_preliminary_budding_point( const Lobe & lobe, int npoints )
 {
     // First, we rasterize the perimeter of the ellipse
@@ -358,9 +1367,69 @@ Vector2 Topography::find_preliminary_budding_point( const Lobe & lobe, int npoin
     return *min_elevation_point_it;
 }
 
-void Topography::reset_intersection_cache( int N )
+void Topography::reset_intersection_cache( int N, std::optional<std::size_t> max_bytes )
 {
-    intersection_cache = std::vector<std::optional<LobeCells>>( N, std::nullopt );
+    // The grids share the budget. A lobe inside of the inner grid covers (cell_size / inner cell_size)^2 times as many
+    // cells there, so the budget is split in this ratio
+    std::optional<std::size_t> max_bytes_inner = max_bytes;
+    if( max_bytes.has_value() && !inner_grids.empty() )
+    {
+        const double ratio = std::pow( cell_size() / inner_grids.front().cell_size(), 2 );
+        max_bytes_inner    = std::size_t( max_bytes.value() * ratio / ( 1.0 + ratio ) );
+        max_bytes          = max_bytes.value() - max_bytes_inner.value();
+    }
+
+    // The slots are allocated lazily, so that a flow which stops early (or a small budget) does not pay for N slots.
+    // The slots of the previous flow are kept, unless they alone exceed the budget
+    intersection_cache.clear();
+    if( max_bytes.has_value() && intersection_cache.capacity() * cache_slot_bytes > max_bytes.value() )
+    {
+        intersection_cache.shrink_to_fit();
+    }
+    cache_n_lobes   = N;
+    cache_max_bytes = max_bytes;
+    cache_bytes     = intersection_cache.capacity() * cache_slot_bytes;
+    cache_n_dropped = 0;
+
+    for( auto & inner : inner_grids )
+    {
+        inner.reset_intersection_cache( N, max_bytes_inner );
+    }
+}
+
+void Topography::store_in_intersection_cache( int idx_cache, const LobeCells & lobe_cells )
+{
+    if( idx_cache < 0 || idx_cache >= cache_n_lobes )
+    {
+        return;
+    }
+
+    constexpr std::size_t cell_bytes = sizeof( LobeCells::cellvecT::value_type );
+
+    // The slots grow geometrically, but never beyond cache_n_lobes. A copy of a vector allocates exactly its size
+    const std::size_t n_slots_allocated = intersection_cache.capacity();
+    std::size_t n_slots                 = n_slots_allocated;
+    if( idx_cache >= int( n_slots ) )
+    {
+        n_slots = std::min<std::size_t>( std::max<std::size_t>( 2 * n_slots, idx_cache + 1 ), cache_n_lobes );
+    }
+    const std::size_t n_cells = lobe_cells.cells_intersecting.size() + lobe_cells.cells_enclosed.size();
+    const std::size_t bytes   = ( n_slots - n_slots_allocated ) * cache_slot_bytes + n_cells * cell_bytes;
+
+    if( cache_max_bytes.has_value() && cache_bytes + bytes > cache_max_bytes.value() )
+    {
+        cache_n_dropped++;
+        return;
+    }
+
+    intersection_cache.reserve( n_slots );
+    if( idx_cache >= int( intersection_cache.size() ) )
+    {
+        intersection_cache.resize( idx_cache + 1 );
+    }
+    const auto & cached = intersection_cache[idx_cache].emplace( lobe_cells );
+    cache_bytes += ( intersection_cache.capacity() - n_slots_allocated ) * cache_slot_bytes
+                   + ( cached.cells_intersecting.capacity() + cached.cells_enclosed.capacity() ) * cell_bytes;
 }
 
 } // namespace Flowy
\ No newline at end of file
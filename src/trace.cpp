@@ -0,0 +1,141 @@
+#include "trace.hpp"
+#include <fmt/format.h>
+#include <fmt/os.h>
+#include <algorithm>
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace Flowy::Trace
+{
+
+namespace
+{
+
+// Single producer (the owning thread), single consumer (flush) ring buffer
+struct ThreadBuffer
+{
+    explicit ThreadBuffer( std::size_t capacity, int tid ) : events( capacity ), tid( tid ) {}
+
+    std::vector<Event> events;
+    std::atomic<std::size_t> head{ 0 }; // Total number of events written by the producer
+    std::atomic<std::size_t> tail{ 0 }; // Total number of events consumed by flush
+    std::atomic<std::size_t> dropped{ 0 };
+    int tid = 0;
+
+    void push( const Event & event )
+    {
+        const std::size_t h = head.load( std::memory_order_relaxed );
+        if( h - tail.load( std::memory_order_acquire ) >= events.size() )
+        {
+            dropped.fetch_add( 1, std::memory_order_relaxed );
+            return;
+        }
+        events[h % events.size()] = event;
+        head.store( h + 1, std::memory_order_release );
+    }
+};
+
+// The registry is only locked when a thread records its very first event
+struct Registry
+{
+    std::mutex mutex{};
+    std::vector<std::shared_ptr<ThreadBuffer>> buffers{};
+    std::size_t events_per_thread = 1 << 18;
+    clock::time_point epoch       = clock::now();
+};
+
+Registry & registry()
+{
+    static Registry reg{};
+    return reg;
+}
+
+ThreadBuffer & thread_buffer()
+{
+    thread_local std::shared_ptr<ThreadBuffer> buffer = []()
+    {
+        auto & reg = registry();
+        std::lock_guard lock( reg.mutex );
+        auto buf = std::make_shared<ThreadBuffer>( reg.events_per_thread, int( reg.buffers.size() ) );
+        reg.buffers.push_back( buf );
+        return buf;
+    }();
+    return *buffer;
+}
+
+} // namespace
+
+void enable( std::size_t events_per_thread )
+{
+    auto & reg = registry();
+    {
+        std::lock_guard lock( reg.mutex );
+        reg.events_per_thread = std::max<std::size_t>( events_per_thread, 1 );
+        reg.epoch             = clock::now();
+    }
+    Detail::enabled.store( true, std::memory_order_relaxed );
+}
+
+int64_t Detail::now_ns()
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>( clock::now() - registry().epoch ).count();
+}
+
+void Detail::record( const Event & event )
+{
+    thread_buffer().push( event );
+}
+
+void flush( const std::filesystem::path & path )
+{
+    auto & reg = registry();
+    std::lock_guard lock( reg.mutex );
+
+    auto file = fmt::output_file( path.string() );
+    file.print( "{{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n" );
+
+    bool first     = true;
+    auto separator = [&]()
+    {
+        const char * sep = first ? "" : ",\n";
+        first            = false;
+        return sep;
+    };
+
+    for( auto & buf : reg.buffers )
+    {
+        file.print(
+            "{}{{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":{},\"args\":{{\"name\":\"{}\"}}}}",
+            separator(), buf->tid, buf->tid == 0 ? "main" : fmt::format( "worker {}", buf->tid ) );
+
+        const std::size_t head = buf->head.load( std::memory_order_acquire );
+        for( std::size_t i = buf->tail.load( std::memory_order_relaxed ); i < head; i++ )
+        {
+            const Event & e = buf->events[i % buf->events.size()];
+            // Chrome trace events use microseconds
+            file.print(
+                "{}{{\"name\":\"{}\",\"cat\":\"{}\",\"ph\":\"X\",\"ts\":{:.3f},\"dur\":{:.3f},\"pid\":1,\"tid\":{}",
+                separator(), e.name, e.category, 1e-3 * e.ts_ns, 1e-3 * e.dur_ns, buf->tid );
+            if( e.arg_name != nullptr )
+            {
+                file.print( ",\"args\":{{\"{}\":{}}}", e.arg_name, e.arg );
+            }
+            file.print( "}}" );
+        }
+        buf->tail.store( head, std::memory_order_release );
+
+        const std::size_t dropped = buf->dropped.exchange( 0 );
+        if( dropped > 0 )
+        {
+            file.print(
+                "{}{{\"name\":\"dropped_events\",\"ph\":\"C\",\"ts\":0,\"pid\":1,\"tid\":{},\"args\":{{\"count\":{}}}}}",
+                separator(), buf->tid, dropped );
+        }
+    }
+
+    file.print( "\n]}}\n" );
+}
+
+} // namespace Flowy::Trace
@@ -0,0 +1,206 @@
+#include "vent_sampler.hpp"
+#include <fmt/format.h>
+#include <algorithm>
+#include <cmath>
+#include <numeric>
+#include <stdexcept>
+
+namespace Flowy
+{
+
+AliasTable::AliasTable( const std::vector<double> & weights )
+{
+    const int n        = weights.size();
+    const double total = std::accumulate( weights.begin(), weights.end(), 0.0 );
+    if( n == 0 || !( total > 0 ) )
+    {
+        throw std::runtime_error( "AliasTable: the weights must have a positive sum" );
+    }
+
+    probability.resize( n );
+    alias.resize( n );
+
+    std::vector<double> scaled( n );
+    std::vector<int> small{};
+    std::vector<int> large{};
+    for( int i = 0; i < n; i++ )
+    {
+        if( weights[i] < 0 )
+        {
+            throw std::runtime_error( fmt::format( "AliasTable: negative weight {} at index {}", weights[i], i ) );
+        }
+        scaled[i] = weights[i] * n / total;
+        ( scaled[i] < 1.0 ? small : large ).push_back( i );
+    }
+
+    while( !small.empty() && !large.empty() )
+    {
+        const int s = small.back();
+        const int l = large.back();
+        small.pop_back();
+        probability[s] = scaled[s];
+        alias[s]       = l;
+
+        scaled[l] -= 1.0 - scaled[s];
+        if( scaled[l] < 1.0 )
+        {
+            large.pop_back();
+            small.push_back( l );
+        }
+    }
+
+    // The remaining entries are 1 up to rounding errors
+    for( int i : large )
+    {
+        probability[i] = 1.0;
+        alias[i]       = i;
+    }
+    for( int i : small )
+    {
+        probability[i] = 1.0;
+        alias[i]       = i;
+    }
+}
+
+int AliasTable::sample( RandomStream & gen ) const
+{
+    const double u   = gen.uniform( 0.0, double( size() ) );
+    const int column = std::min( int( u ), size() - 1 );
+    return ( u - column ) < probability[column] ? column : alias[column];
+}
+
+VentSampler::VentSampler( const Config::InputParams & input ) : vent_flag( input.vent_flag ), n_flows( input.n_flows )
+{
+    const int n_vents = input.n_vents();
+    segment_start     = input.vent_coordinates;
+
+    const bool is_polyline = vent_flag == 2 || vent_flag == 3 || vent_flag == 6;
+    const bool is_fissure  = vent_flag == 4 || vent_flag == 5 || vent_flag == 7;
+
+    if( is_polyline )
+    {
+        if( n_vents < 2 )
+        {
+            throw std::runtime_error(
+                fmt::format( "You must have more than one vent to use vent_flag={}", input.vent_flag ) );
+        }
+        // The segments of the polyline connect consecutive vents
+        segment_end = std::vector<Vector2>( segment_start.begin() + 1, segment_start.end() );
+        segment_start.pop_back();
+    }
+    else if( is_fissure )
+    {
+        if( int( input.vent_end_coordinates.size() ) != n_vents )
+        {
+            throw std::runtime_error( fmt::format(
+                "vent_flag={} needs one end point (x_vent_end, y_vent_end) per vent, but there are {} vents and {} "
+                "end points",
+                input.vent_flag, n_vents, input.vent_end_coordinates.size() ) );
+        }
+        segment_end = input.vent_end_coordinates;
+    }
+    else if( vent_flag != 0 && vent_flag != 1 && vent_flag != 8 )
+    {
+        throw std::runtime_error( fmt::format( "Not implemented vent_flag={}", input.vent_flag ) );
+    }
+
+    // Uniform distribution along the segments
+    if( vent_flag == 2 || vent_flag == 4 )
+    {
+        cumulative_length = { 0.0 };
+        for( std::size_t i = 0; i < segment_start.size(); i++ )
+        {
+            const Vector2 delta = segment_end[i] - segment_start[i];
+            cumulative_length.push_back(
+                cumulative_length.back() + std::sqrt( delta[0] * delta[0] + delta[1] * delta[1] ) );
+        }
+
+        const double total_length = cumulative_length.back();
+        if( !( total_length > 0 ) )
+        {
+            throw std::runtime_error( fmt::format(
+                "The total length of the fissures is zero, which is invalid for vent_flag={}", vent_flag ) );
+        }
+        for( auto & l : cumulative_length )
+        {
+            l /= total_length;
+        }
+    }
+
+    // Prescribed probabilities of the segments or the vents
+    if( vent_flag == 6 || vent_flag == 7 || vent_flag == 8 )
+    {
+        const std::size_t n_expected = segment_start.size();
+        if( input.fissure_probabilities.size() != n_expected )
+        {
+            throw std::runtime_error( fmt::format(
+                "vent_flag={} needs {} fissure_probabilities, but {} were given", vent_flag, n_expected,
+                input.fissure_probabilities.size() ) );
+        }
+        alias_table = AliasTable( input.fissure_probabilities );
+    }
+}
+
+Vector2 VentSampler::point_on_segment( int idx_segment, double alpha ) const
+{
+    return alpha * segment_end[idx_segment] + ( 1.0 - alpha ) * segment_start[idx_segment];
+}
+
+Vector2 VentSampler::sample( int idx_flow, RandomStream & gen ) const
+{
+    const int n_segments = segment_start.size();
+    if( n_segments == 0 )
+    {
+        throw std::runtime_error( "At least one vent has to be specified (x_vent and y_vent)" );
+    }
+
+    switch( vent_flag )
+    {
+        case 0:
+        {
+            // The flows start from the first vent, then from the second and so on
+            const int idx_vent = std::floor( idx_flow * n_segments / n_flows );
+            return segment_start[std::min( idx_vent, n_segments - 1 )];
+        }
+        case 1:
+        {
+            return segment_start[gen.uniform_int( 0, n_segments - 1 )];
+        }
+        case 2:
+        case 4:
+        {
+            // Find a random point on the segments, with the same probability for every point
+            const double cum_dist = gen.uniform();
+
+            // cumulative_length is sorted, the segment is the first one that ends beyond cum_dist
+            auto it
+                = std::upper_bound( cumulative_length.begin() + 1, cumulative_length.end() - 1, cum_dist );
+            const int idx_segment = ( it - cumulative_length.begin() ) - 1;
+
+            const double alpha = ( cum_dist - cumulative_length[idx_segment] )
+                                 / ( cumulative_length[idx_segment + 1] - cumulative_length[idx_segment] );
+            return point_on_segment( idx_segment, alpha );
+        }
+        case 3:
+        case 5:
+        {
+            // Every segment has the same probability
+            const int idx_segment = gen.uniform_int( 0, n_segments - 1 );
+            return point_on_segment( idx_segment, gen.uniform() );
+        }
+        case 6:
+        case 7:
+        {
+            const int idx_segment = alias_table.sample( gen );
+            return point_on_segment( idx_segment, gen.uniform() );
+        }
+        case 8:
+        {
+            return segment_start[alias_table.sample( gen )];
+        }
+    }
+
+    throw std::runtime_error( fmt::format( "Not implemented vent_flag={}", vent_flag ) );
+}
+
+} // namespace Flowy
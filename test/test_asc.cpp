@@ -6,6 +6,7 @@
 #include <catch2/matchers/catch_matchers_floating_point.hpp>
 #include <catch2/matchers/catch_matchers_range_equals.hpp>
 #include <filesystem>
+#include <vector>
 #include <xtensor/xio.hpp>
 
 TEST_CASE( "asc_file_test", "[asc]" )
@@ -41,6 +42,33 @@ TEST_CASE( "asc_file_test", "[asc]" )
     REQUIRE( y_data_expected == asc_file.y_data );
 }
 
+TEST_CASE( "asc_row_reader", "[asc]" )
+{
+    namespace fs = std::filesystem;
+
+    auto asc_file_path = fs::current_path() / fs::path( "test/res/asc/file.asc" );
+    auto asc_file      = Flowy::AscFile( asc_file_path );
+    auto reader        = Flowy::AscRowReader( asc_file_path );
+
+    REQUIRE( reader.header().n_cols == 3 );
+    REQUIRE( reader.header().n_rows == 2 );
+    REQUIRE( reader.header().cell_size == asc_file.cell_size );
+
+    // The rows are returned from top to bottom, together with their y index
+    std::vector<double> row{};
+    for( int idx_y_expected : { 1, 0 } )
+    {
+        auto idx_y = reader.next_row( row );
+        REQUIRE( idx_y.has_value() );
+        REQUIRE( idx_y.value() == idx_y_expected );
+        for( int idx_x = 0; idx_x < 3; idx_x++ )
+        {
+            REQUIRE( row[idx_x] == asc_file.height_data( idx_x, idx_y_expected ) );
+        }
+    }
+    REQUIRE( !reader.next_row( row ).has_value() );
+}
+
 TEST_CASE( "asc_file_test_with_crop", "[asc_crop]" )
 {
     namespace fs = std::filesystem;
@@ -60,4 +88,35 @@ TEST_CASE( "asc_file_test_with_crop", "[asc_crop]" )
     fmt::print( "data = {}\n", fmt::streamed( asc_file.height_data ) );
     fmt::print( "x_data = {}\n", fmt::streamed( asc_file.x_data ) );
     fmt::print( "y_data = {}\n", fmt::streamed( asc_file.y_data ) );
-}
\ No newline at end of file
+}
+
+TEST_CASE( "asc_file_resample", "[asc_resample]" )
+{
+    Flowy::AscFile asc_file{};
+    asc_file.lower_left_corner = { 10.0, 20.0 };
+    asc_file.cell_size         = 2.0;
+    asc_file.no_data_value     = -9999;
+    asc_file.height_data       = { { 1, 2, 3, 4, 5 }, { 3, 4, 5, 6, 7 }, { 0, 0, -9999, 1, 1 }, { 0, 0, 1, 1, 1 },
+                                   { 9, 9, 9, 9, 9 } };
+
+    // The blocks average the cells with data. The last row and column form partial blocks
+    auto resampled = asc_file.resample( 2 );
+
+    Flowy::MatrixX height_data_expected = { { 2.5, 4.5, 6 }, { 0, 1, 1 }, { 9, 9, 9 } };
+    REQUIRE( resampled.height_data == height_data_expected );
+    REQUIRE( resampled.cell_size == 4.0 );
+    REQUIRE( resampled.lower_left_corner[0] == asc_file.lower_left_corner[0] );
+    REQUIRE( resampled.lower_left_corner[1] == asc_file.lower_left_corner[1] );
+    REQUIRE( resampled.x_data == Flowy::VectorX{ 10.0, 14.0, 18.0 } );
+    REQUIRE( resampled.y_data == Flowy::VectorX{ 20.0, 24.0, 28.0 } );
+
+    // Only a block without any data is no data
+    asc_file.height_data( 2, 3 ) = -9999;
+    asc_file.height_data( 3, 2 ) = -9999;
+    asc_file.height_data( 3, 3 ) = -9999;
+    REQUIRE( asc_file.resample( 2 ).height_data( 1, 1 ) == -9999 );
+
+    REQUIRE( asc_file.resample( 1 ).height_data == asc_file.height_data );
+    REQUIRE( asc_file.resample( 6 ).height_data.size() == 1 );
+    REQUIRE_THROWS( asc_file.resample( 0 ) );
+}
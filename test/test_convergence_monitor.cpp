@@ -0,0 +1,74 @@
+#include "convergence_monitor.hpp"
+#include "definitions.hpp"
+#include <catch2/catch_test_macros.hpp>
+#include <catch2/matchers/catch_matchers_floating_point.hpp>
+#include <filesystem>
+#include <fstream>
+#include <string>
+
+TEST_CASE( "convergence_monitor", "[convergence_monitor]" )
+{
+    using namespace Flowy;
+
+    const int n_x          = 8;
+    const int n_y          = 6;
+    MatrixX height_initial = xt::ones<double>( { n_x, n_y } );
+    MatrixX height         = height_initial;
+    MatrixX hazard         = xt::zeros<double>( { n_x, n_y } );
+    auto monitor           = ConvergenceMonitor( n_x, n_y, 0.9, true );
+
+    // Overlapping boxes are only counted once
+    monitor.mark_touched( { 1, 3, 2, 3 } );
+    monitor.mark_touched( { 3, 4, 3, 3 } );
+    REQUIRE( monitor.n_touched() == 7 );
+
+    // Two cells, one with 3/4 of the volume
+    height( 1, 2 ) += 3.0;
+    height( 2, 3 ) += 1.0;
+
+    hazard( 1, 2 ) = 2.0;
+    hazard( 2, 3 ) = 2.0;
+
+    // The first check compares with an empty grid
+    auto point = monitor.check( 1, height, height_initial, hazard );
+    REQUIRE( point.n_flows == 1 );
+    REQUIRE( point.n_touched == 7 );
+    REQUIRE_THAT( point.thickness_change, Catch::Matchers::WithinAbs( 1.0, 1e-12 ) );
+    REQUIRE_THAT( point.hazard_change, Catch::Matchers::WithinAbs( 1.0, 1e-12 ) );
+    REQUIRE_THAT( point.footprint_change, Catch::Matchers::WithinAbs( 1.0, 1e-12 ) );
+
+    // Doubling all fields does not change their shape
+    height = 2.0 * height - height_initial;
+    hazard *= 2.0;
+    point = monitor.check( 2, height, height_initial, hazard );
+    REQUIRE_THAT( point.thickness_change, Catch::Matchers::WithinAbs( 0.0, 1e-12 ) );
+    REQUIRE_THAT( point.hazard_change, Catch::Matchers::WithinAbs( 0.0, 1e-12 ) );
+    REQUIRE_THAT( point.footprint_change, Catch::Matchers::WithinAbs( 0.0, 1e-12 ) );
+    REQUIRE( !monitor.is_converged( 0.1, 2 ) );
+    REQUIRE( monitor.is_converged( 0.1, 1 ) );
+
+    // Moving all the volume to a newly touched cell changes everything
+    monitor.mark_touched( { 6, 6, 0, 0 } );
+    height         = height_initial;
+    height( 6, 0 ) = 5.0;
+    hazard         = xt::zeros<double>( { n_x, n_y } );
+    hazard( 6, 0 ) = 1.0;
+    point          = monitor.check( 3, height, height_initial, hazard );
+    REQUIRE_THAT( point.thickness_change, Catch::Matchers::WithinAbs( 2.0, 1e-12 ) );
+    REQUIRE_THAT( point.hazard_change, Catch::Matchers::WithinAbs( 2.0, 1e-12 ) );
+    REQUIRE_THAT( point.footprint_change, Catch::Matchers::WithinAbs( 1.0, 1e-12 ) );
+    REQUIRE( !monitor.is_converged( 0.1, 1 ) );
+    REQUIRE( monitor.curve().size() == 3 );
+
+    auto path = std::filesystem::temp_directory_path() / "flowy_test_convergence.csv";
+    monitor.write_csv( path );
+    std::ifstream file( path );
+    std::string line{};
+    int n_lines = 0;
+    while( std::getline( file, line ) )
+    {
+        n_lines++;
+    }
+    REQUIRE( n_lines == 4 );
+    std::filesystem::remove( path );
+}
@@ -0,0 +1,88 @@
+#include "lobe.hpp"
+#include "lobe_store.hpp"
+#include <catch2/catch_test_macros.hpp>
+#include <functional>
+#include <random>
+#include <vector>
+
+TEST_CASE( "lobe_store_round_trip", "[lobe_store]" )
+{
+    using namespace Flowy;
+
+    Lobe lobe{};
+    lobe.center    = { 512345.25, 4178901.75 };
+    lobe.semi_axes = { 12.5, 3.25 };
+    lobe.set_azimuthal_angle( 0.7 );
+    lobe.dist_n_lobes   = 4;
+    lobe.idx_parent     = 2;
+    lobe.alpha_inertial = 0.25;
+    lobe.thickness      = 1.5;
+
+    auto lobes = LobeStore();
+    lobes.resize( 3 );
+    lobes.push_back( lobe );
+    REQUIRE( lobes.size() == 4 );
+
+    // The initial lobes have no parent
+    REQUIRE( !lobes.lobe( 0 ).idx_parent.has_value() );
+
+    // The geometry is stored exactly, including sine and cosine
+    const Lobe res = lobes.lobe( 3 );
+    REQUIRE( res.center[0] == lobe.center[0] );
+    REQUIRE( res.center[1] == lobe.center[1] );
+    REQUIRE( res.semi_axes[0] == lobe.semi_axes[0] );
+    REQUIRE( res.semi_axes[1] == lobe.semi_axes[1] );
+    REQUIRE( res.get_azimuthal_angle() == lobe.get_azimuthal_angle() );
+    REQUIRE( res.get_sin_azimuthal_angle() == lobe.get_sin_azimuthal_angle() );
+    REQUIRE( res.get_cos_azimuthal_angle() == lobe.get_cos_azimuthal_angle() );
+    REQUIRE( res.idx_parent == lobe.idx_parent );
+    REQUIRE( res.dist_n_lobes == lobe.dist_n_lobes );
+    REQUIRE( res.alpha_inertial == lobe.alpha_inertial );
+    REQUIRE( res.thickness == lobe.thickness );
+
+    lobes.clear();
+    REQUIRE( lobes.size() == 0 );
+}
+
+TEST_CASE( "lobe_store_cumulative_descendents", "[lobe_store]" )
+{
+    using namespace Flowy;
+
+    auto gen          = std::mt19937( 0 );
+    const int n_init  = 3;
+    const int n_lobes = 5000;
+
+    // Build a random tree, with the initial lobes as roots
+    auto lobes = LobeStore();
+    lobes.resize( n_init );
+    std::vector<std::vector<int>> children( n_lobes );
+    for( int idx_lobe = n_init; idx_lobe < n_lobes; idx_lobe++ )
+    {
+        std::uniform_int_distribution<int> dist_parent( 0, idx_lobe - 1 );
+        Lobe lobe{};
+        lobe.idx_parent = dist_parent( gen );
+        children[lobe.idx_parent.value()].push_back( idx_lobe );
+        lobes.push_back( lobe );
+    }
+
+    lobes.compute_cumulative_descendents();
+
+    // Reference: count the descendents by a depth first search
+    std::function<int( int )> count_descendents = [&]( int idx_lobe )
+    {
+        int res = 0;
+        for( int child : children[idx_lobe] )
+        {
+            res += 1 + count_descendents( child );
+        }
+        return res;
+    };
+
+    int n_total = 0;
+    for( int idx_lobe = 0; idx_lobe < n_lobes; idx_lobe++ )
+    {
+        REQUIRE( lobes.n_descendents[idx_lobe] == count_descendents( idx_lobe ) );
+        n_total += idx_lobe < n_init ? 1 + lobes.n_descendents[idx_lobe] : 0;
+    }
+    REQUIRE( n_total == n_lobes );
+}
@@ -0,0 +1,74 @@
+#include "parent_sampler.hpp"
+#include <catch2/catch_test_macros.hpp>
+#include <algorithm>
+#include <numeric>
+#include <random>
+#include <vector>
+
+TEST_CASE( "parent_sampler_by_index", "[parent_sampler]" )
+{
+    using namespace Flowy;
+
+    auto sampler = ParentSampler( false, 3.0 );
+    sampler.reset( 6 );
+
+    const std::vector<int> distances = { 0, 1, 3, 2, 4, 1 };
+    for( int i = 0; i < int( distances.size() ); i++ )
+    {
+        sampler.add_lobe( i, distances[i] );
+    }
+
+    // Lobes 2 and 4 are at or beyond max_length
+    REQUIRE( sampler.size() == 4 );
+    REQUIRE( sampler.lobe_at_rank( 0 ) == 0 );
+    REQUIRE( sampler.lobe_at_rank( 1 ) == 1 );
+    REQUIRE( sampler.lobe_at_rank( 2 ) == 3 );
+    REQUIRE( sampler.lobe_at_rank( 3 ) == 5 );
+
+    sampler.reset( 6 );
+    REQUIRE( sampler.size() == 0 );
+}
+
+TEST_CASE( "parent_sampler_by_distance", "[parent_sampler]" )
+{
+    using namespace Flowy;
+
+    auto gen                = std::mt19937( 0 );
+    const int n_lobes       = 2000;
+    const double max_length = 40;
+    auto sampler            = ParentSampler( true, max_length );
+
+    for( int repetition = 0; repetition < 3; repetition++ )
+    {
+        // The first repetition grows the sampler beyond the number of lobes it was reset for
+        sampler.reset( repetition == 0 ? 1 : n_lobes );
+
+        // Build a random tree of lobes, like a flow does
+        std::vector<int> distances = { 0 };
+        sampler.add_lobe( 0, 0 );
+        for( int i = 1; i < n_lobes; i++ )
+        {
+            std::uniform_int_distribution<int> dist_parent( 0, i - 1 );
+            distances.push_back( distances[dist_parent( gen )] + 1 );
+            sampler.add_lobe( i, distances.back() );
+        }
+
+        // Reference: the lobes below max_length, stably sorted by distance
+        std::vector<int> expected{};
+        for( int i = 0; i < n_lobes; i++ )
+        {
+            if( distances[i] < max_length )
+            {
+                expected.push_back( i );
+            }
+        }
+        std::stable_sort(
+            expected.begin(), expected.end(), [&]( int a, int b ) { return distances[a] < distances[b]; } );
+
+        REQUIRE( sampler.size() == int( expected.size() ) );
+        for( int rank = 0; rank < sampler.size(); rank++ )
+        {
+            REQUIRE( sampler.lobe_at_rank( rank ) == expected[rank] );
+        }
+    }
+}
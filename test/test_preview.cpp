@@ -0,0 +1,126 @@
+#include "asc_file.hpp"
+#include "config.hpp"
+#include "preview.hpp"
+#include "run_report.hpp"
+#include "simulation.hpp"
+#include "synthetic_terrain.hpp"
+#include "xtensor/xmath.hpp"
+#include <catch2/catch_test_macros.hpp>
+#include <catch2/matchers/catch_matchers_floating_point.hpp>
+#include <filesystem>
+#include <stdexcept>
+
+namespace
+{
+Flowy::Config::InputParams make_input()
+{
+    auto synthetic      = Flowy::SyntheticTerrainParams{};
+    synthetic.kind      = Flowy::TerrainKind::ConstantSlope;
+    synthetic.cell_size = 10.0;
+    synthetic.n_x       = 100;
+    synthetic.n_y       = 100;
+    synthetic.slope     = { 0.0, -0.05 };
+
+    auto input                 = Flowy::Config::InputParams();
+    input.synthetic_terrain    = synthetic;
+    input.output_folder        = std::filesystem::temp_directory_path() / "flowy_test_preview";
+    input.run_name             = "test";
+    input.vent_coordinates     = { { 500.0, 700.0 } };
+    input.n_flows              = 16;
+    input.min_n_lobes          = 40;
+    input.max_n_lobes          = 60;
+    input.fixed_dimension_flag = 1;
+    input.prescribed_lobe_area = 400;
+    input.total_volume         = 400 * 0.5 * 50 * input.n_flows;
+    input.thickness_ratio      = 1.0;
+    input.max_slope_prob       = 0.5;
+    input.n_init               = 1;
+    input.max_aspect_ratio     = 2.5;
+    input.aspect_ratio_coeff   = 2.0;
+    input.preview_factor       = 2;
+    return input;
+}
+} // namespace
+
+TEST_CASE( "preview_scale_input", "[preview]" )
+{
+    using namespace Flowy;
+
+    auto asc_file      = AscFile();
+    asc_file.cell_size = 10.0;
+
+    for( int fixed_dimension_flag : { 1, 2 } )
+    {
+        auto input                          = make_input();
+        input.fixed_dimension_flag          = fixed_dimension_flag;
+        input.prescribed_avg_lobe_thickness = 0.5;
+
+        const auto preview = Preview::scale_input( input );
+        REQUIRE( preview.run_name == "test_preview" );
+        REQUIRE( preview.n_flows == 4 );
+        REQUIRE( preview.min_n_lobes == 20 );
+        REQUIRE( preview.max_n_lobes == 30 );
+
+        // The lobes are twice as large in each direction and half as thick, with the same volume per flow
+        const auto dimensions         = CommonLobeDimensions( input, asc_file );
+        const auto dimensions_preview = CommonLobeDimensions( preview, asc_file );
+        REQUIRE_THAT( dimensions_preview.lobe_area, Catch::Matchers::WithinRel( 4.0 * dimensions.lobe_area, 1e-12 ) );
+        REQUIRE_THAT(
+            dimensions_preview.avg_lobe_thickness,
+            Catch::Matchers::WithinRel( 0.5 * dimensions.avg_lobe_thickness, 1e-12 ) );
+        REQUIRE_THAT(
+            preview.total_volume.value() / preview.n_flows,
+            Catch::Matchers::WithinRel( input.total_volume.value() / input.n_flows, 1e-12 ) );
+    }
+
+    // The beta law of the number of lobes divides by n_flows - 1
+    auto input_beta    = make_input();
+    input_beta.n_flows = 3;
+    input_beta.a_beta  = 2.0;
+    input_beta.b_beta  = 2.0;
+    REQUIRE( Preview::scale_input( input_beta ).n_flows == 2 );
+
+    auto input              = make_input();
+    input.resume_checkpoint = "checkpoint.bin";
+    REQUIRE_THROWS_AS( Preview::scale_input( input ), std::runtime_error );
+}
+
+TEST_CASE( "run_preview", "[preview]" )
+{
+    using namespace Flowy;
+    namespace fs = std::filesystem;
+
+    const auto input = make_input();
+    fs::create_directories( input.output_folder );
+
+    auto simulation = Simulation( input, 0 );
+    REQUIRE( simulation.input_full.has_value() );
+    REQUIRE( simulation.n_cells_full == 100 * 100 );
+    REQUIRE( simulation.topography.cell_size() == 20.0 );
+    REQUIRE( simulation.topography.height_data.shape()[0] == 50 );
+
+    simulation.run();
+    REQUIRE( simulation.n_flows_completed == 4 );
+    REQUIRE( fs::exists( input.output_folder / "test_preview_thickness_full.asc" ) );
+
+    // The thickness is scaled up to the 16 flows of the full run
+    const double volume_emplaced = xt::sum( simulation.topography.height_data )()
+                                   - xt::sum( simulation.topography_initial.height_data )();
+    const double volume_output = xt::sum( simulation.topography_thickness.height_data )();
+    REQUIRE_THAT( volume_output, Catch::Matchers::WithinRel( 4.0 * volume_emplaced, 1e-9 ) );
+
+    REQUIRE( simulation.report.preview.has_value() );
+    REQUIRE( simulation.report.preview->preview_factor == 2 );
+    REQUIRE( simulation.report.preview->n_flows_full == 16 );
+    REQUIRE( simulation.report.preview->seconds > 0 );
+
+    // The grids of the full run have four times as many cells
+    std::size_t grid_bytes = 0;
+    for( const auto & grid : simulation.report.grids )
+    {
+        grid_bytes += grid.bytes;
+    }
+    REQUIRE( simulation.report.preview->grid_bytes == 4 * grid_bytes );
+
+    fs::remove_all( input.output_folder );
+}
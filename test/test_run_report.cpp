@@ -0,0 +1,56 @@
+#include "config.hpp"
+#include "run_report.hpp"
+#include <catch2/catch_test_macros.hpp>
+#include <catch2/matchers/catch_matchers_floating_point.hpp>
+#include <filesystem>
+#include <fstream>
+#include <limits>
+#include <sstream>
+#include <string>
+
+TEST_CASE( "run_report", "[run_report]" )
+{
+    namespace fs = std::filesystem;
+    using namespace Flowy;
+
+    RunReport report{};
+    report.add_stage_time( "emplacement", 1.0, 0.5 );
+    report.add_stage_time( "hazard", 0.25, 0.25 );
+    report.add_stage_time( "emplacement", 2.0, 1.5 );
+
+    // Times of the same stage are accumulated
+    REQUIRE( report.stages.size() == 2 );
+    REQUIRE( report.stages[0].calls == 2 );
+    REQUIRE_THAT( report.stages[0].wall_seconds, Catch::Matchers::WithinRel( 3.0 ) );
+    REQUIRE_THAT( report.stages[0].cpu_seconds, Catch::Matchers::WithinRel( 2.0 ) );
+
+    report.add_flow( { 0, 10, 7, StopReason::BuddingPoint } );
+    report.add_grid( "topography", 800 );
+
+    {
+        RunReport::StageTimer timer( report, "write_output" );
+    }
+    REQUIRE( report.stages.size() == 3 );
+
+    // Non-finite values are not valid JSON
+    auto input                 = Config::InputParams();
+    input.run_name             = "test \"run\"";
+    input.thickening_parameter = std::numeric_limits<double>::quiet_NaN();
+
+    auto path = fs::temp_directory_path() / "flowy_test_report.json";
+    report.write( path, input, 42, 2.0, 1000 );
+
+    std::ifstream file( path );
+    std::stringstream buffer;
+    buffer << file.rdbuf();
+    const std::string json = buffer.str();
+
+    REQUIRE( json.find( "\"lobes_per_second\": 500" ) != std::string::npos );
+    REQUIRE( json.find( "\"stop_reason\": \"budding_point\"" ) != std::string::npos );
+    REQUIRE( json.find( "\"run_name\": \"test \\\"run\\\"\"" ) != std::string::npos );
+    REQUIRE( json.find( "\"rng_seed\": 42" ) != std::string::npos );
+    REQUIRE( json.find( "\"thickening_parameter\": null" ) != std::string::npos );
+    REQUIRE( json.find( "nan" ) == std::string::npos );
+
+    fs::remove( path );
+}
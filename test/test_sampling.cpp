@@ -0,0 +1,143 @@
+#include "math.hpp"
+#include "sampling.hpp"
+#include <catch2/catch_test_macros.hpp>
+#include <catch2/matchers/catch_matchers_floating_point.hpp>
+#include <array>
+#include <cmath>
+#include <utility>
+#include <vector>
+
+namespace
+{
+
+// The mean and the variance of the samples
+std::pair<double, double> mean_and_variance( const std::vector<double> & samples )
+{
+    double mean = 0;
+    for( double x : samples )
+    {
+        mean += x;
+    }
+    mean /= samples.size();
+
+    double variance = 0;
+    for( double x : samples )
+    {
+        variance += ( x - mean ) * ( x - mean );
+    }
+    variance /= samples.size() - 1;
+
+    return { mean, variance };
+}
+
+double normal_pdf( double x )
+{
+    return std::exp( -0.5 * x * x ) / std::sqrt( 2.0 * Flowy::Math::pi );
+}
+
+} // namespace
+
+TEST_CASE( "random_stream", "[sampling]" )
+{
+    using namespace Flowy;
+
+    auto gen = RandomStream( 42, RandomStream::key( 3, 7 ) );
+
+    const int n_samples = 200000;
+    std::vector<double> samples( n_samples );
+    for( auto & x : samples )
+    {
+        x = gen.uniform();
+        REQUIRE( ( x >= 0.0 && x < 1.0 ) );
+    }
+    auto [mean, variance] = mean_and_variance( samples );
+    REQUIRE_THAT( mean, Catch::Matchers::WithinAbs( 0.5, 0.005 ) );
+    REQUIRE_THAT( variance, Catch::Matchers::WithinAbs( 1.0 / 12.0, 0.002 ) );
+
+    // Restarting the stream repeats the numbers, also when they are drawn in batches
+    gen.set_stream( RandomStream::key( 3, 7 ) );
+    std::vector<double> batch( 37 );
+    gen.uniform();
+    gen.fill_uniform( batch.data(), batch.size() );
+    for( std::size_t i = 0; i < batch.size(); i++ )
+    {
+        REQUIRE( batch[i] == samples[i + 1] );
+    }
+    REQUIRE( gen.uniform() == samples[batch.size() + 1] );
+
+    // Different lobes and different seeds give different streams
+    auto gen_other_lobe = RandomStream( 42, RandomStream::key( 3, 8 ) );
+    auto gen_other_seed = RandomStream( 43, RandomStream::key( 3, 7 ) );
+    REQUIRE( gen_other_lobe.uniform() != samples[0] );
+    REQUIRE( gen_other_seed.uniform() != samples[0] );
+
+    // Integers are uniform in the closed interval
+    std::vector<int> counts( 5, 0 );
+    for( int i = 0; i < n_samples; i++ )
+    {
+        const int k = gen.uniform_int( 10, 14 );
+        REQUIRE( ( k >= 10 && k <= 14 ) );
+        counts[k - 10]++;
+    }
+    for( int c : counts )
+    {
+        REQUIRE_THAT( double( c ) / n_samples, Catch::Matchers::WithinAbs( 0.2, 0.005 ) );
+    }
+}
+
+TEST_CASE( "inverse_normal_cdf", "[sampling]" )
+{
+    using namespace Flowy;
+
+    for( double p : { 1e-300, 1e-20, 1e-8, 0.01, 0.07, 0.3, 0.5, 0.6, 0.9, 0.999, 1.0 - 1e-12 } )
+    {
+        const double x = inverse_normal_cdf( p );
+        REQUIRE_THAT( normal_cdf( x ), Catch::Matchers::WithinRel( p, 1e-12 ) );
+    }
+
+    REQUIRE( inverse_normal_cdf( 0.5 ) == 0.0 );
+    REQUIRE_THAT( inverse_normal_cdf( 0.975 ), Catch::Matchers::WithinAbs( 1.959963984540054, 1e-14 ) );
+}
+
+TEST_CASE( "truncated_normal", "[sampling]" )
+{
+    using namespace Flowy;
+
+    auto gen            = RandomStream( 0 );
+    const int n_samples = 200000;
+
+    // The moments of the normal distribution truncated to [a, b] are known in closed form
+    for( auto [mu, sigma, a, b] : std::vector<std::array<double, 4>>{
+             { 0.0, 1.0, -Math::pi, Math::pi }, { 0.5, 2.0, -1.0, 3.0 }, { 0.0, 0.01, -Math::pi, Math::pi } } )
+    {
+        std::vector<double> samples( n_samples );
+        for( auto & x : samples )
+        {
+            x = truncated_normal( gen, mu, sigma, a, b );
+            REQUIRE( ( x >= a && x <= b ) );
+        }
+
+        const double alpha = ( a - mu ) / sigma;
+        const double beta  = ( b - mu ) / sigma;
+        const double z     = normal_cdf( beta ) - normal_cdf( alpha );
+        const double d     = ( normal_pdf( alpha ) - normal_pdf( beta ) ) / z;
+        const double e     = ( alpha * normal_pdf( alpha ) - beta * normal_pdf( beta ) ) / z;
+
+        const double mean_expected     = mu + sigma * d;
+        const double variance_expected = sigma * sigma * ( 1.0 + e - d * d );
+
+        auto [mean, variance] = mean_and_variance( samples );
+        REQUIRE_THAT( mean, Catch::Matchers::WithinAbs( mean_expected, 0.01 * sigma ) );
+        REQUIRE_THAT( variance, Catch::Matchers::WithinRel( variance_expected, 0.02 ) );
+    }
+
+    // For a very wide gaussian (small max_slope_prob), the truncated distribution is uniform, and no sample is rejected
+    std::vector<double> samples( n_samples );
+    for( auto & x : samples )
+    {
+        x = truncated_normal( gen, 0.0, 1e6, -Math::pi, Math::pi );
+    }
+    auto [mean, variance] = mean_and_variance( samples );
+    REQUIRE_THAT( mean, Catch::Matchers::WithinAbs( 0.0, 0.02 ) );
+    REQUIRE_THAT( variance, Catch::Matchers::WithinRel( 4.0 * Math::pi * Math::pi / 12.0, 0.02 ) );
+}
@@ -1,8 +1,12 @@
+#include "asc_file.hpp"
 #include "config.hpp"
 #include "definitions.hpp"
 #include "lobe.hpp"
 #include "math.hpp"
+#include "run_report.hpp"
 #include "simulation.hpp"
+#include "stop_signal.hpp"
+#include "synthetic_terrain.hpp"
 #include <fmt/format.h>
 #include <fmt/ostream.h>
 #include <catch2/catch_test_macros.hpp>
@@ -10,6 +14,10 @@
 #include <catch2/matchers/catch_matchers_range_equals.hpp>
 #include <cstddef>
 #include <filesystem>
+#include <fstream>
+#include <optional>
+#include <sstream>
+#include <string>
 
 TEST_CASE( "perturb_angle", "[perturb_angle]" )
 {
@@ -36,7 +44,7 @@ TEST_CASE( "perturb_angle", "[perturb_angle]" )
     Vector2 slope              = { 1.5, 0 };
     const double mean_expected = 0.0;
 
-    const double slope_norm = xt::linalg::norm( slope, 2 ); // Similar to np.linalg.norm
+    const double slope_norm = norm( slope );
     const double slope_deg  = std::atan( slope_norm );
 
     // NOTE: this is not the sigma we expect from the samples, but the sigma of the gaussian *before* truncation
@@ -91,5 +99,568 @@ TEST_CASE( "budding_point", "[budding_point]" )
 
     Vector2 lobe_center_expected = { 0.5, -0.5 };
 
-    REQUIRE( xt::isclose( lobe_cur.center, lobe_center_expected )() );
-}
\ No newline at end of file
+    REQUIRE( xt::isclose( to_xtensor( lobe_cur.center ), to_xtensor( lobe_center_expected ) )() );
+}
+
+TEST_CASE( "select_parent_lobe_max_length", "[select_parent_lobe]" )
+{
+    using namespace Flowy;
+    namespace fs = std::filesystem;
+
+    auto proj_root_path = fs::current_path();
+    auto asc_file_path  = proj_root_path / fs::path( "test/res/asc/file.asc" );
+
+    for( int start_from_dist_flag : { 0, 1 } )
+    {
+        Config::InputParams input_params;
+        input_params.source                        = asc_file_path;
+        input_params.total_volume                  = 1;
+        input_params.prescribed_avg_lobe_thickness = 1;
+        input_params.lobe_exponent                 = 0.5;
+        input_params.start_from_dist_flag          = start_from_dist_flag;
+        input_params.force_max_length              = 1;
+        input_params.max_length                    = 5;
+
+        auto simulation = Simulation( input_params, 0 );
+        REQUIRE( simulation.uses_parent_sampler() );
+
+        const int n_lobes = 1000;
+        simulation.lobes.resize( 1 );
+        simulation.lobes.reserve( n_lobes );
+        simulation.parent_sampler.reset( n_lobes );
+        simulation.add_parent_candidate( 0 );
+
+        for( int idx_lobe = 1; idx_lobe < n_lobes; idx_lobe++ )
+        {
+            Lobe lobe{};
+            const int idx_parent = simulation.select_parent_lobe( idx_lobe, lobe );
+
+            REQUIRE( idx_parent < idx_lobe );
+            REQUIRE( simulation.lobes.dist_n_lobes[idx_parent] < input_params.max_length );
+            REQUIRE( lobe.dist_n_lobes == simulation.lobes.dist_n_lobes[idx_parent] + 1 );
+
+            simulation.lobes.push_back( lobe );
+            simulation.add_parent_candidate( idx_lobe );
+        }
+    }
+}
+
+TEST_CASE( "emplace_lobes_policies", "[emplace_lobes]" )
+{
+    using namespace Flowy;
+
+    auto synthetic      = SyntheticTerrainParams{};
+    synthetic.kind      = TerrainKind::ConstantSlope;
+    synthetic.cell_size = 10.0;
+    synthetic.n_x       = 200;
+    synthetic.n_y       = 200;
+    synthetic.slope     = { 0.0, -0.05 };
+
+    const int n_lobes = 500;
+
+    auto input                 = Config::InputParams();
+    input.synthetic_terrain    = synthetic;
+    input.vent_coordinates     = { { 1000.0, 1500.0 } };
+    input.n_flows              = 1;
+    input.min_n_lobes          = n_lobes;
+    input.max_n_lobes          = n_lobes;
+    input.fixed_dimension_flag = 1;
+    input.prescribed_lobe_area = 400;
+    input.total_volume         = 400 * 0.5 * n_lobes;
+    input.thickness_ratio      = 1.0;
+    input.max_slope_prob       = 0.5;
+    input.inertial_exponent    = 0.125;
+    input.n_init               = 1;
+    input.max_aspect_ratio     = 2.5;
+    input.aspect_ratio_coeff   = 2.0;
+
+    // The specialized emplacement loops give the same flows as the generic one
+    const auto emplace_generic
+        = &Simulation::emplace_lobes<ParentPolicy::Runtime, AnglePolicy::Runtime, InertiaPolicy::Runtime>;
+
+    for( double lobe_exponent : { 0.0, 0.3 } )
+    {
+        input.lobe_exponent = lobe_exponent;
+
+        auto simulation_generic     = Simulation( input, 0 );
+        auto simulation_specialized = Simulation( input, 0 );
+
+        const auto emplace_specialized = simulation_specialized.select_emplace_lobes();
+        REQUIRE( emplace_specialized != emplace_generic );
+
+        FlowStats flow_stats_generic{};
+        FlowStats flow_stats_specialized{};
+        ( simulation_generic.*emplace_generic )( 0, n_lobes, flow_stats_generic );
+        ( simulation_specialized.*emplace_specialized )( 0, n_lobes, flow_stats_specialized );
+
+        REQUIRE( simulation_generic.lobes.size() > 10 );
+        REQUIRE( simulation_generic.lobes.size() == simulation_specialized.lobes.size() );
+        REQUIRE( simulation_generic.lobes.center_x == simulation_specialized.lobes.center_x );
+        REQUIRE( simulation_generic.lobes.center_y == simulation_specialized.lobes.center_y );
+        REQUIRE( simulation_generic.lobes.idx_parent == simulation_specialized.lobes.idx_parent );
+        REQUIRE( simulation_generic.topography.height_data == simulation_specialized.topography.height_data );
+        REQUIRE( flow_stats_generic.stop_reason == flow_stats_specialized.stop_reason );
+    }
+}
+
+TEST_CASE( "run_stops_early", "[run]" )
+{
+    using namespace Flowy;
+    namespace fs = std::filesystem;
+
+    auto synthetic      = SyntheticTerrainParams{};
+    synthetic.kind      = TerrainKind::ConstantSlope;
+    synthetic.cell_size = 10.0;
+    synthetic.n_x       = 100;
+    synthetic.n_y       = 100;
+    synthetic.slope     = { 0.0, -0.05 };
+
+    const int n_lobes = 50;
+
+    auto input                 = Config::InputParams();
+    input.synthetic_terrain    = synthetic;
+    input.output_folder        = fs::temp_directory_path() / "flowy_test_run_stops_early";
+    input.run_name             = "test";
+    input.vent_coordinates     = { { 500.0, 700.0 } };
+    input.n_flows              = 4;
+    input.min_n_lobes          = n_lobes;
+    input.max_n_lobes          = n_lobes;
+    input.fixed_dimension_flag = 1;
+    input.prescribed_lobe_area = 400;
+    input.total_volume         = 400 * 0.5 * n_lobes * input.n_flows;
+    input.thickness_ratio      = 1.0;
+    input.max_slope_prob       = 0.5;
+    input.n_init               = 1;
+    input.max_aspect_ratio     = 2.5;
+    input.aspect_ratio_coeff   = 2.0;
+    fs::create_directories( input.output_folder );
+
+    auto avg_thick_file = [&]()
+    {
+        std::ifstream file( input.output_folder / "test_avg_thick.txt" );
+        std::stringstream buffer;
+        buffer << file.rdbuf();
+        return buffer.str();
+    };
+
+    SECTION( "signal" )
+    {
+        // A stop requested during the first flow ends the run after it
+        StopSignal::request();
+        auto simulation = Simulation( input, 0 );
+        simulation.run();
+        StopSignal::reset();
+
+        REQUIRE( simulation.n_flows_completed == 1 );
+        REQUIRE( simulation.report.termination == RunTermination::Signal );
+        REQUIRE( simulation.report.flows.size() == 1 );
+        REQUIRE( avg_thick_file().find( "Completed flows = 1 of 4" ) != std::string::npos );
+
+        // The thickness is scaled up to the estimate for all flows
+        const double volume_emplaced = xt::sum( simulation.topography.height_data )()
+                                       - xt::sum( simulation.topography_initial.height_data )();
+        const double volume_output = xt::sum( simulation.topography_thickness.height_data )();
+        REQUIRE_THAT( volume_output, Catch::Matchers::WithinRel( 4.0 * volume_emplaced, 1e-9 ) );
+    }
+
+    SECTION( "time_budget" )
+    {
+        input.max_run_time_seconds = 1e-9;
+        auto simulation            = Simulation( input, 0 );
+        simulation.run();
+
+        REQUIRE( simulation.n_flows_completed == 1 );
+        REQUIRE( simulation.report.termination == RunTermination::TimeBudget );
+    }
+
+    SECTION( "completed" )
+    {
+        auto simulation = Simulation( input, 0 );
+        simulation.run();
+
+        REQUIRE( simulation.n_flows_completed == 4 );
+        REQUIRE( simulation.report.termination == RunTermination::Completed );
+        REQUIRE( avg_thick_file().find( "Completed flows" ) == std::string::npos );
+    }
+
+    fs::remove_all( input.output_folder );
+}
+
+TEST_CASE( "run_resume", "[run]" )
+{
+    using namespace Flowy;
+    namespace fs = std::filesystem;
+
+    auto synthetic      = SyntheticTerrainParams{};
+    synthetic.kind      = TerrainKind::ConstantSlope;
+    synthetic.cell_size = 10.0;
+    synthetic.n_x       = 60;
+    synthetic.n_y       = 100;
+    synthetic.slope     = { 0.0, -0.05 };
+
+    const int n_lobes = 30;
+
+    auto input                 = Config::InputParams();
+    input.synthetic_terrain    = synthetic;
+    input.output_folder        = fs::temp_directory_path() / "flowy_test_run_resume";
+    input.run_name             = "test";
+    input.vent_coordinates     = { { 300.0, 700.0 } };
+    input.n_flows              = 3;
+    input.min_n_lobes          = n_lobes;
+    input.max_n_lobes          = n_lobes;
+    input.fixed_dimension_flag = 1;
+    input.prescribed_lobe_area = 400;
+    input.total_volume         = 400 * 0.5 * n_lobes * input.n_flows;
+    input.thickness_ratio      = 1.0;
+    input.max_slope_prob       = 0.5;
+    input.n_init               = 1;
+    input.max_aspect_ratio     = 2.5;
+    input.aspect_ratio_coeff   = 2.0;
+    input.save_hazard_data     = true;
+    input.convergence_interval = 1;
+    input.topo_mod_flag        = 2;
+    input.n_lobes_counter      = 7;
+    input.thickening_parameter = 0.3;
+    fs::create_directories( input.output_folder );
+
+    auto simulation_uninterrupted = Simulation( input, 0 );
+    simulation_uninterrupted.run();
+
+    // Interrupt a run after the first flow, which writes a checkpoint
+    input.checkpoint_interval = 2;
+    StopSignal::request();
+    auto simulation_interrupted = Simulation( input, 0 );
+    simulation_interrupted.run();
+    StopSignal::reset();
+    const auto checkpoint_path = input.output_folder / "test_checkpoint.bin";
+    REQUIRE( simulation_interrupted.n_flows_completed == 1 );
+    REQUIRE( fs::is_regular_file( checkpoint_path ) );
+
+    // Resuming with a different seed continues with the seed of the checkpoint and gives the same outputs as the
+    // uninterrupted run
+    input.resume_checkpoint = checkpoint_path;
+    auto simulation_resumed = Simulation( input, 1 );
+    simulation_resumed.run();
+
+    REQUIRE( simulation_resumed.n_flows_completed == 3 );
+    REQUIRE( simulation_resumed.report.flows.size() == 3 );
+    REQUIRE( simulation_resumed.report.termination == RunTermination::Completed );
+    REQUIRE(
+        simulation_resumed.topography_thickness.height_data
+        == simulation_uninterrupted.topography_thickness.height_data );
+    REQUIRE( simulation_resumed.topography.hazard == simulation_uninterrupted.topography.hazard );
+    REQUIRE( simulation_resumed.report.convergence.size() == simulation_uninterrupted.report.convergence.size() );
+    REQUIRE(
+        simulation_resumed.report.convergence.back().thickness_change
+        == simulation_uninterrupted.report.convergence.back().thickness_change );
+
+    // A checkpoint of a different run is rejected
+    input.n_flows            = 4;
+    auto simulation_mismatch = Simulation( input, 0 );
+    REQUIRE_THROWS( simulation_mismatch.run() );
+
+    fs::remove_all( input.output_folder );
+}
+
+TEST_CASE( "restart_files", "[run]" )
+{
+    using namespace Flowy;
+    namespace fs = std::filesystem;
+
+    auto synthetic      = SyntheticTerrainParams{};
+    synthetic.kind      = TerrainKind::ConstantSlope;
+    synthetic.cell_size = 10.0;
+    synthetic.n_x       = 20;
+    synthetic.n_y       = 20;
+    synthetic.slope     = { 0.0, -0.05 };
+
+    auto input                 = Config::InputParams();
+    input.synthetic_terrain    = synthetic;
+    input.vent_coordinates     = { { 100.0, 100.0 } };
+    input.n_flows              = 1;
+    input.min_n_lobes          = 1;
+    input.max_n_lobes          = 1;
+    input.fixed_dimension_flag = 1;
+    input.prescribed_lobe_area = 400;
+    input.total_volume         = 200;
+    input.thickness_ratio      = 1.0;
+
+    const auto topography_without_restart = Simulation( input, 0 ).topography_initial;
+    const Vector2 origin                  = topography_without_restart.geometry().origin;
+
+    // A 3x2 restart file, which starts at the cell (18, 5) and therefore sticks out of the grid by one column
+    const auto restart_path = fs::temp_directory_path() / "flowy_test_restart.asc";
+    {
+        std::ofstream file( restart_path );
+        file << "ncols 3\nnrows 2\n";
+        file << fmt::format( "xllcorner {}\nyllcorner {}\n", origin[0] + 180.0, origin[1] + 50.0 );
+        file << "cellsize 10\nNODATA_value -9999\n";
+        file << "1.0 -9999 7.0\n";
+        file << "2.0 3.0 7.0\n";
+    }
+
+    input.restart_files              = std::vector<fs::path>{ restart_path };
+    input.restart_filling_parameters = std::vector<double>{ 0.5 };
+    auto simulation                  = Simulation( input, 0 );
+
+    MatrixX thickness_expected  = xt::zeros<double>( { 20, 20 } );
+    thickness_expected( 18, 6 ) = 0.5;
+    thickness_expected( 18, 5 ) = 1.0;
+    thickness_expected( 19, 5 ) = 1.5;
+
+    for( int idx_x = 0; idx_x < 20; idx_x++ )
+    {
+        for( int idx_y = 0; idx_y < 20; idx_y++ )
+        {
+            const double thickness = simulation.topography_initial.height_data( idx_x, idx_y )
+                                     - topography_without_restart.height_data( idx_x, idx_y );
+            REQUIRE_THAT( thickness, Catch::Matchers::WithinAbs( thickness_expected( idx_x, idx_y ), 1e-12 ) );
+        }
+    }
+    REQUIRE( simulation.topography.height_data == simulation.topography_initial.height_data );
+
+    // A restart file, which is not aligned with the grid, is rejected
+    {
+        std::ofstream file( restart_path );
+        file << "ncols 1\nnrows 1\n";
+        file << fmt::format( "xllcorner {}\nyllcorner {}\n", origin[0] + 5.0, origin[1] );
+        file << "cellsize 10\nNODATA_value -9999\n1.0\n";
+    }
+    REQUIRE_THROWS( Simulation( input, 0 ) );
+
+    fs::remove( restart_path );
+}
+
+TEST_CASE( "topo_mod_flag", "[run]" )
+{
+    using namespace Flowy;
+    namespace fs = std::filesystem;
+
+    auto synthetic      = SyntheticTerrainParams{};
+    synthetic.kind      = TerrainKind::ConstantSlope;
+    synthetic.cell_size = 10.0;
+    synthetic.n_x       = 60;
+    synthetic.n_y       = 100;
+    synthetic.slope     = { 0.0, -0.02 };
+
+    const int n_lobes = 40;
+
+    auto input                 = Config::InputParams();
+    input.synthetic_terrain    = synthetic;
+    input.output_folder        = fs::temp_directory_path() / "flowy_test_topo_mod_flag";
+    input.run_name             = "test";
+    input.vent_coordinates     = { { 300.0, 700.0 } };
+    input.n_flows              = 3;
+    input.min_n_lobes          = n_lobes;
+    input.max_n_lobes          = n_lobes;
+    input.fixed_dimension_flag = 1;
+    input.prescribed_lobe_area = 400;
+    input.total_volume         = 400 * 2.0 * n_lobes * input.n_flows;
+    input.thickness_ratio      = 1.0;
+    input.max_slope_prob       = 0.5;
+    input.n_init               = 1;
+    input.max_aspect_ratio     = 2.5;
+    input.aspect_ratio_coeff   = 2.0;
+    fs::create_directories( input.output_folder );
+
+    auto run = [&]()
+    {
+        auto simulation = Simulation( input, 0 );
+        simulation.run();
+        return simulation.topography_thickness.height_data;
+    };
+
+    const MatrixX thickness_live = run();
+
+    // Refreshing after every lobe without thickening is the same as reading the live topography
+    input.topo_mod_flag        = 2;
+    input.n_lobes_counter      = 1;
+    input.thickening_parameter = 0.0;
+    REQUIRE( run() == thickness_live );
+
+    // With the slopes of the initial topography, the lobes do not see each other
+    input.topo_mod_flag = 0;
+    REQUIRE( run() != thickness_live );
+
+    fs::remove_all( input.output_folder );
+}
+
+TEST_CASE( "concurrent_flows", "[run]" )
+{
+    using namespace Flowy;
+    namespace fs = std::filesystem;
+
+    auto synthetic      = SyntheticTerrainParams{};
+    synthetic.kind      = TerrainKind::ConstantSlope;
+    synthetic.cell_size = 10.0;
+    synthetic.n_x       = 300;
+    synthetic.n_y       = 200;
+    synthetic.slope     = { 0.0, -0.02 };
+
+    const int n_lobes = 30;
+
+    auto input                 = Config::InputParams();
+    input.synthetic_terrain    = synthetic;
+    input.output_folder        = fs::temp_directory_path() / "flowy_test_concurrent_flows";
+    input.run_name             = "test";
+    input.vent_flag            = 1;
+    input.vent_coordinates     = { { 300.0, 1700.0 }, { 1500.0, 1700.0 }, { 2700.0, 1700.0 } };
+    input.n_flows              = 12;
+    input.min_n_lobes          = n_lobes;
+    input.max_n_lobes          = n_lobes;
+    input.fixed_dimension_flag = 1;
+    input.prescribed_lobe_area = 400;
+    input.total_volume         = 400 * 2.0 * n_lobes * input.n_flows;
+    input.thickness_ratio      = 1.0;
+    input.max_slope_prob       = 0.5;
+    input.n_init               = 1;
+    input.max_aspect_ratio     = 2.5;
+    input.aspect_ratio_coeff   = 2.0;
+    input.save_hazard_data     = true;
+    fs::create_directories( input.output_folder );
+
+    struct Result
+    {
+        MatrixX thickness;
+        MatrixX hazard;
+        int n_flows_rerun;
+    };
+
+    auto run = [&]( int n_threads )
+    {
+        input.n_threads = n_threads;
+        auto simulation = Simulation( input, 0 );
+        simulation.run();
+        return Result{ simulation.topography_thickness.height_data, simulation.topography.hazard,
+                       simulation.report.n_flows_rerun };
+    };
+
+    // The flows are committed in their order and conflicting flows are emplaced again, so the results are exactly the
+    // ones of the serial run, for the live topography and for a slope source refreshed between the flows
+    for( std::optional<int> topo_mod_flag : { std::optional<int>{}, std::optional<int>{ 1 } } )
+    {
+        input.topo_mod_flag   = topo_mod_flag;
+        input.n_flows_counter = 2;
+        const Result serial   = run( 1 );
+        for( int n_threads : { 2, 5 } )
+        {
+            const Result concurrent = run( n_threads );
+            REQUIRE( concurrent.thickness == serial.thickness );
+            REQUIRE( concurrent.hazard == serial.hazard );
+            if( topo_mod_flag.has_value() )
+            {
+                // The slope source only changes between the batches
+                REQUIRE( concurrent.n_flows_rerun == 0 );
+            }
+        }
+    }
+
+    // Without feedback, no flow conflicts with another one
+    input.topo_mod_flag     = 0;
+    const Result serial     = run( 1 );
+    const Result concurrent = run( 4 );
+    REQUIRE( concurrent.n_flows_rerun == 0 );
+    REQUIRE( concurrent.thickness == serial.thickness );
+    REQUIRE( concurrent.hazard == serial.hazard );
+
+    // With a budget for the footprints, which is split between the replicas, the dropped footprints are recomputed
+    input.max_cache_memory_mb      = 0.01;
+    const Result concurrent_budget = run( 4 );
+    input.max_cache_memory_mb      = std::nullopt;
+    REQUIRE( concurrent_budget.thickness == serial.thickness );
+    REQUIRE( concurrent_budget.hazard == serial.hazard );
+
+    // The serial run accumulates the enclosed cells in a difference array, so it only agrees up to the thickness
+    // quantum
+    input.accumulate_thickness      = true;
+    const Result serial_accumulated = run( 1 );
+    input.accumulate_thickness      = false;
+    REQUIRE( serial_accumulated.hazard == serial.hazard );
+    for( std::size_t idx = 0; idx < serial.thickness.size(); idx++ )
+    {
+        REQUIRE_THAT(
+            serial_accumulated.thickness.data()[idx],
+            Catch::Matchers::WithinAbs( serial.thickness.data()[idx], n_lobes * input.n_flows * 1e-12 ) );
+    }
+
+    fs::remove_all( input.output_folder );
+}
+
+TEST_CASE( "run_inner_grid", "[run]" )
+{
+    using namespace Flowy;
+    namespace fs = std::filesystem;
+
+    auto synthetic      = SyntheticTerrainParams{};
+    synthetic.kind      = TerrainKind::ConstantSlope;
+    synthetic.cell_size = 10.0;
+    synthetic.n_x       = 60;
+    synthetic.n_y       = 100;
+    synthetic.slope     = { 0.0, -0.02 };
+
+    const int n_lobes = 40;
+
+    auto input                 = Config::InputParams();
+    input.synthetic_terrain    = synthetic;
+    input.output_folder        = fs::temp_directory_path() / "flowy_test_inner_grid";
+    input.run_name             = "test";
+    input.vent_coordinates     = { { 300.0, 700.0 } };
+    input.n_flows              = 3;
+    input.min_n_lobes          = n_lobes;
+    input.max_n_lobes          = n_lobes;
+    input.fixed_dimension_flag = 1;
+    input.prescribed_lobe_area = 400;
+    input.total_volume         = 400 * 2.0 * n_lobes * input.n_flows;
+    input.thickness_ratio      = 1.0;
+    input.max_slope_prob       = 0.5;
+    input.n_init               = 1;
+    input.max_aspect_ratio     = 2.5;
+    input.aspect_ratio_coeff   = 2.0;
+    input.save_hazard_data     = true;
+    fs::create_directories( input.output_folder );
+
+    // The inner grid covers [200, 400] x [600, 760] around the vent with 2.5 m cells, interpolated from the DEM, so
+    // the flows run out of it
+    auto dem                    = Topography( make_synthetic_terrain( synthetic ) );
+    auto inner_asc              = AscFile{};
+    inner_asc.lower_left_corner = { 200.0, 600.0 };
+    inner_asc.cell_size         = 2.5;
+    inner_asc.height_data       = xt::zeros<double>( { 80, 64 } );
+    for( int idx_x = 0; idx_x < 80; idx_x++ )
+    {
+        for( int idx_y = 0; idx_y < 64; idx_y++ )
+        {
+            inner_asc.height_data( idx_x, idx_y )
+                = dem.height_and_slope( { 200.0 + 2.5 * ( idx_x + 0.5 ), 600.0 + 2.5 * ( idx_y + 0.5 ) } ).first;
+        }
+    }
+    input.inner_source = input.output_folder / "inner.asc";
+    inner_asc.save( input.inner_source.value() );
+
+    auto simulation = Simulation( input, 0 );
+    REQUIRE( simulation.topography.has_inner_grid() );
+    simulation.run();
+
+    for( const auto * name : { "test_DEM_inner.asc", "test_thickness_full_inner.asc", "test_hazard_full_inner.asc" } )
+    {
+        REQUIRE( fs::exists( input.output_folder / name ) );
+    }
+
+    // Both grids get the same volume on the extent of the inner grid, whose cells are aligned with the outer cells
+    const auto & inner         = simulation.topography.inner_grid();
+    const auto & inner_initial = simulation.topography_initial.inner_grid();
+    const double volume_inner  = xt::sum( inner.height_data - inner_initial.height_data )() * 2.5 * 2.5;
+
+    const MatrixX & thickness = simulation.topography_thickness.height_data;
+    const auto [idx_x, idx_y] = simulation.topography.locate_point( { 205.0, 605.0 } );
+    const auto thickness_inside
+        = xt::view( thickness, xt::range( idx_x, idx_x + 20 ), xt::range( idx_y, idx_y + 16 ) );
+    const double volume_outer = xt::sum( thickness_inside )() * 10.0 * 10.0;
+
+    REQUIRE( volume_inner > 0 );
+    REQUIRE( volume_outer < xt::sum( thickness )() * 10.0 * 10.0 );
+    REQUIRE_THAT( volume_inner, Catch::Matchers::WithinRel( volume_outer, 0.02 ) );
+    REQUIRE( xt::sum( inner.hazard )() > 0 );
+
+    fs::remove_all( input.output_folder );
+}
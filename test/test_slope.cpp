@@ -15,8 +15,7 @@ TEST_CASE( "height_and_slope_test", "[topography]" )
     // (top to down)
     topography.height_data = { { 4.0, 1.0 }, { 4.0, 1.0 } };
 
-    topography.x_data = { 1.0, 2.0 };
-    topography.y_data = { 2.0, 3.0 };
+    topography.set_coordinates( { 1.0, 2.0 }, { 2.0, 3.0 } );
 
     topography.set_height( 0, 0, 4 ); // Bottom row to 4
     topography.set_height( 1, 0, 4 ); // Bottom row to 4
@@ -0,0 +1,134 @@
+#include "asc_file.hpp"
+#include "synthetic_terrain.hpp"
+#include <catch2/catch_test_macros.hpp>
+#include <catch2/matchers/catch_matchers_floating_point.hpp>
+#include <cstddef>
+
+TEST_CASE( "synthetic_terrain_constant_slope", "[synthetic_terrain]" )
+{
+    using namespace Flowy;
+
+    auto params              = SyntheticTerrainParams{};
+    params.kind              = TerrainKind::ConstantSlope;
+    params.n_x               = 20;
+    params.n_y               = 10;
+    params.cell_size         = 5.0;
+    params.lower_left_corner = { 100, 200 };
+    params.slope             = { 0.5, -0.25 };
+
+    auto asc_file = make_synthetic_terrain( params );
+
+    REQUIRE( asc_file.height_data.shape()[0] == 20 );
+    REQUIRE( asc_file.height_data.shape()[1] == 10 );
+    REQUIRE( asc_file.x_data.size() == 20 );
+    REQUIRE( asc_file.y_data.size() == 10 );
+    REQUIRE( asc_file.lower_left_corner[0] == 100 );
+    REQUIRE( asc_file.lower_left_corner[1] == 200 );
+
+    // The height at the center of the domain is the base height
+    REQUIRE_THAT( asc_file.height_data( 10, 5 ), Catch::Matchers::WithinAbs( params.base_height, 1e-12 ) );
+
+    for( std::size_t i = 0; i + 1 < params.n_x; i++ )
+    {
+        for( std::size_t j = 0; j + 1 < params.n_y; j++ )
+        {
+            const double dzdx = ( asc_file.height_data( i + 1, j ) - asc_file.height_data( i, j ) ) / params.cell_size;
+            const double dzdy = ( asc_file.height_data( i, j + 1 ) - asc_file.height_data( i, j ) ) / params.cell_size;
+            REQUIRE_THAT( dzdx, Catch::Matchers::WithinAbs( params.slope[0], 1e-10 ) );
+            REQUIRE_THAT( dzdy, Catch::Matchers::WithinAbs( params.slope[1], 1e-10 ) );
+        }
+    }
+}
+
+TEST_CASE( "synthetic_terrain_saddle", "[synthetic_terrain]" )
+{
+    using namespace Flowy;
+
+    auto params             = SyntheticTerrainParams{};
+    params.kind             = TerrainKind::Saddle;
+    params.n_x              = 21;
+    params.n_y              = 21;
+    params.cell_size        = 1.0;
+    params.saddle_curvature = 0.1;
+
+    auto asc_file = make_synthetic_terrain( params );
+
+    // Rises in x direction and falls in y direction, relative to the center
+    const double center = asc_file.height_data( 10, 10 );
+    REQUIRE( asc_file.height_data( 0, 10 ) > center );
+    REQUIRE( asc_file.height_data( 20, 10 ) > center );
+    REQUIRE( asc_file.height_data( 10, 0 ) < center );
+    REQUIRE( asc_file.height_data( 10, 20 ) < center );
+}
+
+TEST_CASE( "synthetic_terrain_crop", "[synthetic_terrain]" )
+{
+    using namespace Flowy;
+
+    auto params                = SyntheticTerrainParams{};
+    params.kind                = TerrainKind::Fractal;
+    params.n_x                 = 200;
+    params.n_y                 = 150;
+    params.cell_size           = 10.0;
+    params.lower_left_corner   = { 1000, 2000 };
+    params.nodata_fraction     = 0.5;
+    params.nodata_hole_radius  = 30.0;
+    params.nodata_hole_spacing = 200.0;
+    params.seed                = 42;
+
+    auto full = make_synthetic_terrain( params );
+
+    const auto crop = AscCrop{ 1500, 2200, 2300, 2800 };
+    auto cropped    = make_synthetic_terrain( params, crop );
+
+    const std::size_t offset_x = 50;
+    const std::size_t offset_y = 30;
+    REQUIRE( cropped.lower_left_corner[0] == full.x_data[offset_x] );
+    REQUIRE( cropped.lower_left_corner[1] == full.y_data[offset_y] );
+    REQUIRE( cropped.height_data.shape()[0] == 71 );
+    REQUIRE( cropped.height_data.shape()[1] == 51 );
+
+    // The cropped window is identical to the corresponding part of the full raster
+    for( std::size_t i = 0; i < cropped.height_data.shape()[0]; i++ )
+    {
+        for( std::size_t j = 0; j < cropped.height_data.shape()[1]; j++ )
+        {
+            REQUIRE( cropped.height_data( i, j ) == full.height_data( i + offset_x, j + offset_y ) );
+        }
+    }
+}
+
+TEST_CASE( "synthetic_terrain_nodata_holes", "[synthetic_terrain]" )
+{
+    using namespace Flowy;
+
+    auto params      = SyntheticTerrainParams{};
+    params.kind      = TerrainKind::Fractal;
+    params.n_x       = 100;
+    params.n_y       = 100;
+    params.cell_size = 10.0;
+
+    auto count_nodata = [&]()
+    {
+        auto asc_file   = make_synthetic_terrain( params );
+        std::size_t res = 0;
+        for( double h : asc_file.height_data )
+        {
+            res += ( h == asc_file.no_data_value );
+        }
+        return res;
+    };
+
+    params.nodata_fraction = 0.0;
+    REQUIRE( count_nodata() == 0 );
+
+    params.nodata_fraction     = 1.0;
+    params.nodata_hole_radius  = 20.0;
+    params.nodata_hole_spacing = 100.0;
+    const std::size_t n_nodata = count_nodata();
+    REQUIRE( n_nodata > 0 );
+    REQUIRE( n_nodata < params.n_x * params.n_y );
+
+    // The holes are deterministic
+    REQUIRE( count_nodata() == n_nodata );
+}
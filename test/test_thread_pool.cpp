@@ -0,0 +1,45 @@
+#include "thread_pool.hpp"
+#include <catch2/catch_test_macros.hpp>
+#include <atomic>
+#include <stdexcept>
+#include <vector>
+
+TEST_CASE( "thread_pool", "[thread_pool]" )
+{
+    using namespace Flowy;
+
+    for( int n_threads : { 1, 4 } )
+    {
+        auto pool = ThreadPool( n_threads );
+        REQUIRE( pool.n_threads() == n_threads );
+
+        // Every task runs exactly once, also when the pool is reused
+        for( int n_tasks : { 0, 1, 3, 100 } )
+        {
+            std::vector<std::atomic<int>> n_runs( n_tasks );
+            pool.parallel_for( n_tasks, [&]( int idx ) { n_runs[idx]++; } );
+            for( const auto & n : n_runs )
+            {
+                REQUIRE( n == 1 );
+            }
+        }
+
+        // An exception is rethrown on the calling thread, after all other tasks have finished
+        std::atomic<int> n_finished = 0;
+        auto throwing_task          = [&]( int idx )
+        {
+            if( idx == 5 )
+            {
+                throw std::runtime_error( "task failed" );
+            }
+            n_finished++;
+        };
+        REQUIRE_THROWS_AS( pool.parallel_for( 20, throwing_task ), std::runtime_error );
+        REQUIRE( n_finished == 19 );
+
+        // The pool is still usable afterwards
+        n_finished = 0;
+        pool.parallel_for( 8, [&]( int ) { n_finished++; } );
+        REQUIRE( n_finished == 8 );
+    }
+}
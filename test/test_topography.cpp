@@ -2,7 +2,9 @@
 #include "definitions.hpp"
 #include "fmt/core.h"
 #include "lobe.hpp"
+#include "lobe_store.hpp"
 #include "math.hpp"
+#include "thread_pool.hpp"
 #include "topography.hpp"
 #include "xtensor/xbuilder.hpp"
 #include "xtensor/xio.hpp"
@@ -12,7 +14,13 @@
 #include <catch2/catch_test_macros.hpp>
 #include <catch2/matchers/catch_matchers_floating_point.hpp>
 #include <catch2/matchers/catch_matchers_range_equals.hpp>
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstdlib>
 #include <optional>
+#include <random>
+#include <stdexcept>
 #include <vector>
 
 TEST_CASE( "bounding_box", "[bounding_box]" )
@@ -149,4 +157,663 @@ TEST_CASE( "find_preliminary_budding_point", "[budding_point]" )
 
     // The budding point should be on the diagonal
     REQUIRE_THAT( budding_point[0], Catch::Matchers::WithinRel( budding_point[1] ) );
-}
\ No newline at end of file
+}
+
+TEST_CASE( "distance_to_invalid", "[distance_to_invalid]" )
+{
+    const int n_x = 23;
+    const int n_y = 17;
+
+    Flowy::AscFile asc_file{};
+    asc_file.x_data        = xt::arange<double>( 0.0, n_x, 1.0 );
+    asc_file.y_data        = xt::arange<double>( 0.0, n_y, 1.0 );
+    asc_file.height_data   = xt::zeros<double>( { n_x, n_y } );
+    asc_file.no_data_value = -9999;
+
+    // Scatter a few no data cells
+    auto gen = std::mt19937( 0 );
+    std::uniform_int_distribution<int> dist_x( 0, n_x - 1 );
+    std::uniform_int_distribution<int> dist_y( 0, n_y - 1 );
+    for( int i = 0; i < 6; i++ )
+    {
+        asc_file.height_data( dist_x( gen ), dist_y( gen ) ) = asc_file.no_data_value;
+    }
+
+    auto topography = Flowy::Topography( asc_file );
+
+    // Brute force reference: the Chebyshev distance to the edges and to every no data cell
+    for( int idx_x = 0; idx_x < n_x; idx_x++ )
+    {
+        for( int idx_y = 0; idx_y < n_y; idx_y++ )
+        {
+            int expected = std::min( { idx_x + 1, n_x - 1 - idx_x, idx_y + 1, n_y - 1 - idx_y } );
+            for( int i = 0; i < n_x; i++ )
+            {
+                for( int j = 0; j < n_y; j++ )
+                {
+                    if( asc_file.height_data( i, j ) <= asc_file.no_data_value )
+                    {
+                        expected = std::min( expected, std::max( std::abs( i - idx_x ), std::abs( j - idx_y ) ) );
+                    }
+                }
+            }
+            REQUIRE( topography.distance_to_invalid( idx_x, idx_y ) == expected );
+        }
+    }
+}
+
+TEST_CASE( "is_point_near_invalid", "[distance_to_invalid]" )
+{
+    Flowy::VectorX x_data      = xt::arange<double>( 0.0, 30.0, 1.0 );
+    Flowy::VectorX y_data      = xt::arange<double>( 0.0, 20.0, 1.0 );
+    Flowy::MatrixX height_data = xt::zeros<double>( { x_data.size(), y_data.size() } );
+
+    auto topography = Flowy::Topography( height_data, x_data, y_data );
+
+    // Without no data cells, the result is the same as is_point_near_boundary
+    auto gen = std::mt19937( 0 );
+    std::uniform_real_distribution<double> dist_x( 0.0, 30.0 );
+    std::uniform_real_distribution<double> dist_y( 0.0, 20.0 );
+    std::uniform_real_distribution<double> dist_radius( 0.1, 8.0 );
+    for( int i = 0; i < 10000; i++ )
+    {
+        const Flowy::Vector2 point = { dist_x( gen ), dist_y( gen ) };
+        const double radius        = dist_radius( gen );
+        const bool near_boundary   = topography.is_point_near_boundary( point, radius );
+        REQUIRE( topography.is_point_near_invalid( point, radius ) == near_boundary );
+    }
+
+    // Points outside of the grid are always invalid
+    REQUIRE( topography.is_point_near_invalid( { -0.5, 10.0 }, 0.1 ) );
+    REQUIRE( topography.is_point_near_invalid( { 15.0, 20.5 }, 0.1 ) );
+
+    // A no data cell within the radius
+    topography.height_data( 15, 10 ) = -9999;
+    topography.compute_distance_to_invalid( -9999 );
+    REQUIRE( topography.is_point_near_invalid( { 12.5, 10.5 }, 2.5 ) );
+    REQUIRE( !topography.is_point_near_invalid( { 12.5, 10.5 }, 1.5 ) );
+}
+
+TEST_CASE( "grid_geometry", "[grid_geometry]" )
+{
+    Flowy::VectorX x_data      = xt::arange<double>( 0.0, 30.0, 1.0 ) * 0.3 + 512345.1;
+    Flowy::VectorX y_data      = xt::arange<double>( 0.0, 20.0, 1.0 ) * 0.3 + 4178901.7;
+    Flowy::MatrixX height_data = xt::zeros<double>( { x_data.size(), y_data.size() } );
+
+    auto topography        = Flowy::Topography( height_data, x_data, y_data );
+    const auto & geometry  = topography.geometry();
+    const double cell_size = x_data[1] - x_data[0];
+
+    REQUIRE( geometry.n_x == 30 );
+    REQUIRE( geometry.n_y == 20 );
+    REQUIRE( topography.cell_size() == cell_size );
+    REQUIRE( geometry.upper_corner[0] == x_data.periodic( -1 ) + cell_size );
+    REQUIRE( geometry.upper_corner[1] == y_data.periodic( -1 ) + cell_size );
+
+    // The cached inverse cell size gives the same cells as the division, up to points within rounding distance of a
+    // cell edge
+    auto gen = std::mt19937( 0 );
+    std::uniform_real_distribution<double> dist_x( x_data[0], geometry.upper_corner[0] );
+    std::uniform_real_distribution<double> dist_y( y_data[0], geometry.upper_corner[1] );
+    for( int i = 0; i < 10000; i++ )
+    {
+        const Flowy::Vector2 point = { dist_x( gen ), dist_y( gen ) };
+        const double fx            = ( point[0] - x_data[0] ) / cell_size;
+        const double fy            = ( point[1] - y_data[0] ) / cell_size;
+        const auto [idx_x, idx_y]  = topography.locate_point( point );
+        REQUIRE( ( idx_x == int( fx ) || std::abs( fx - std::round( fx ) ) < 1e-9 ) );
+        REQUIRE( ( idx_y == int( fy ) || std::abs( fy - std::round( fy ) ) < 1e-9 ) );
+        REQUIRE( ( idx_x >= 0 && idx_x < geometry.n_x && idx_y >= 0 && idx_y < geometry.n_y ) );
+    }
+
+    // A point right below the upper corner is in the last cell
+    const Flowy::Vector2 corner
+        = { std::nextafter( geometry.upper_corner[0], 0.0 ), std::nextafter( geometry.upper_corner[1], 0.0 ) };
+    REQUIRE( topography.locate_point( corner ) == std::array<int, 2>{ 29, 19 } );
+    REQUIRE_THROWS_AS( topography.locate_point( geometry.upper_corner ), std::runtime_error );
+}
+
+TEST_CASE( "intersection_cache_budget", "[intersection_cache]" )
+{
+    Flowy::VectorX x_data      = xt::arange<double>( 0.0, 40.0, 1.0 );
+    Flowy::VectorX y_data      = xt::arange<double>( 0.0, 40.0, 1.0 );
+    Flowy::MatrixX height_data = xt::zeros<double>( { x_data.size(), y_data.size() } );
+
+    // A flow of lobes along a line, every lobe descends from the previous one
+    const int n_lobes = 30;
+    Flowy::LobeStore lobes{};
+    for( int idx_lobe = 0; idx_lobe < n_lobes; idx_lobe++ )
+    {
+        Flowy::Lobe lobe{};
+        lobe.center    = { 5.3 + idx_lobe, 20.1 + 0.2 * idx_lobe };
+        lobe.semi_axes = { 3.1, 1.7 };
+        lobe.set_azimuthal_angle( 0.1 * idx_lobe );
+        if( idx_lobe > 0 )
+        {
+            lobe.idx_parent = idx_lobe - 1;
+        }
+        lobes.push_back( lobe );
+    }
+    lobes.compute_cumulative_descendents();
+
+    // Emplaces the lobes and computes the hazard of the flow with the given budget
+    auto compute_hazard = [&]( std::optional<std::size_t> max_bytes, Flowy::Topography & topography )
+    {
+        topography.reset_intersection_cache( n_lobes, max_bytes );
+        for( int idx_lobe = 0; idx_lobe < n_lobes; idx_lobe++ )
+        {
+            topography.add_lobe( lobes.lobe( idx_lobe ), idx_lobe );
+        }
+        Flowy::MatrixX flow_hazard = xt::zeros_like( height_data );
+        topography.compute_hazard_flow( lobes, flow_hazard );
+        return flow_hazard;
+    };
+
+    auto topography_unbounded      = Flowy::Topography( height_data, x_data, y_data );
+    Flowy::MatrixX hazard_expected = compute_hazard( std::nullopt, topography_unbounded );
+    REQUIRE( topography_unbounded.intersection_cache_n_dropped() == 0 );
+    const std::size_t bytes_unbounded = topography_unbounded.intersection_cache_bytes();
+
+    // With a smaller budget, some footprints are recomputed, but the results do not change
+    for( std::size_t max_bytes : { std::size_t( 0 ), bytes_unbounded / 3 } )
+    {
+        auto topography       = Flowy::Topography( height_data, x_data, y_data );
+        Flowy::MatrixX hazard = compute_hazard( max_bytes, topography );
+
+        REQUIRE( topography.intersection_cache_bytes() <= max_bytes );
+        REQUIRE( topography.intersection_cache_n_dropped() > 0 );
+        REQUIRE( hazard == hazard_expected );
+        REQUIRE( topography.height_data == topography_unbounded.height_data );
+    }
+
+    // The slots of the previous flow are kept and charged to the budget, unless they exceed it
+    topography_unbounded.reset_intersection_cache( n_lobes );
+    REQUIRE( topography_unbounded.intersection_cache_bytes() > 0 );
+    topography_unbounded.reset_intersection_cache( n_lobes, 0 );
+    REQUIRE( topography_unbounded.intersection_cache_bytes() == 0 );
+}
+
+TEST_CASE( "slope_source", "[slope_source]" )
+{
+    // 150x100 cells, i.e. 3x2 tiles
+    Flowy::VectorX x_data              = xt::arange<double>( 0.0, 150.0, 1.0 );
+    Flowy::VectorX y_data              = xt::arange<double>( 0.0, 100.0, 1.0 );
+    Flowy::MatrixX height_data_initial = xt::zeros<double>( { x_data.size(), y_data.size() } );
+    for( std::size_t idx_x = 0; idx_x < x_data.size(); idx_x++ )
+    {
+        for( std::size_t idx_y = 0; idx_y < y_data.size(); idx_y++ )
+        {
+            height_data_initial( idx_x, idx_y ) = -0.1 * idx_x;
+        }
+    }
+
+    auto topography = Flowy::Topography( height_data_initial, x_data, y_data );
+    topography.enable_slope_source();
+
+    Flowy::Lobe lobe{};
+    lobe.center    = { 10.2, 10.7 };
+    lobe.semi_axes = { 3.0, 2.0 };
+    lobe.thickness = 2.0;
+    lobe.set_azimuthal_angle( 0.3 );
+
+    const auto [height_before, slope_before] = topography.height_and_slope( lobe.center );
+    topography.add_lobe( lobe );
+    REQUIRE( topography.n_dirty_slope_tiles() == 1 );
+
+    // Until the refresh, the slope does not see the lobe
+    const auto [height_stale, slope_stale] = topography.height_and_slope( lobe.center );
+    REQUIRE( height_stale == height_before );
+    REQUIRE( slope_stale == slope_before );
+    REQUIRE( topography.height_data( 10, 10 ) > height_data_initial( 10, 10 ) );
+
+    // Only 3/4 of the lobe thickness is seen by the slopes
+    const double thickening_parameter = 0.25;
+    topography.refresh_slope_source( height_data_initial, thickening_parameter );
+    REQUIRE( topography.n_dirty_slope_tiles() == 0 );
+    for( std::size_t idx_x = 0; idx_x < x_data.size(); idx_x++ )
+    {
+        for( std::size_t idx_y = 0; idx_y < y_data.size(); idx_y++ )
+        {
+            const double thickness = topography.height_data( idx_x, idx_y ) - height_data_initial( idx_x, idx_y );
+            REQUIRE_THAT(
+                topography.slope_source()( idx_x, idx_y ),
+                Catch::Matchers::WithinAbs( height_data_initial( idx_x, idx_y ) + 0.75 * thickness, 1e-12 ) );
+        }
+    }
+    REQUIRE( topography.height_and_slope( lobe.center ).first > height_before );
+
+    // A lobe on the edge of two tiles dirties both of them
+    lobe.center = { 64.0, 30.0 };
+    topography.add_lobe( lobe );
+    REQUIRE( topography.n_dirty_slope_tiles() == 2 );
+
+    // Replacing the slope source marks all tiles as dirty
+    topography.set_slope_source( height_data_initial );
+    REQUIRE( topography.n_dirty_slope_tiles() == 6 );
+    REQUIRE_THROWS( topography.set_slope_source( xt::zeros<double>( { 3, 3 } ) ) );
+}
+
+TEST_CASE( "shared_slope_source", "[slope_source]" )
+{
+    Flowy::VectorX x_data      = xt::arange<double>( 0.0, 150.0, 1.0 );
+    Flowy::VectorX y_data      = xt::arange<double>( 0.0, 100.0, 1.0 );
+    Flowy::MatrixX height_data = xt::zeros<double>( { x_data.size(), y_data.size() } );
+    for( std::size_t idx_x = 0; idx_x < x_data.size(); idx_x++ )
+    {
+        for( std::size_t idx_y = 0; idx_y < y_data.size(); idx_y++ )
+        {
+            height_data( idx_x, idx_y ) = -0.1 * idx_x;
+        }
+    }
+
+    const auto initial   = Flowy::Topography( height_data, x_data, y_data );
+    auto topography      = initial;
+    auto topography_copy = initial;
+    topography.share_slope_source( initial );
+    topography_copy.enable_slope_source();
+    REQUIRE( topography.is_slope_source_shared() );
+    REQUIRE( &topography.slope_source() == &initial.height_data );
+
+    Flowy::Lobe lobe{};
+    lobe.center    = { 10.2, 10.7 };
+    lobe.semi_axes = { 3.0, 2.0 };
+    lobe.thickness = 2.0;
+    lobe.set_azimuthal_angle( 0.3 );
+
+    // The slopes are the ones of a slope source which is never refreshed, but no tiles are tracked for a refresh
+    const auto [height_before, slope_before] = topography.height_and_slope( lobe.center );
+    topography.add_lobe( lobe );
+    topography_copy.add_lobe( lobe );
+    REQUIRE( topography.n_dirty_slope_tiles() == 0 );
+    REQUIRE( topography.height_data == topography_copy.height_data );
+    const auto [height_after, slope_after] = topography.height_and_slope( lobe.center );
+    REQUIRE( height_after == height_before );
+    REQUIRE( slope_after == slope_before );
+    REQUIRE( topography_copy.height_and_slope( lobe.center ).first == height_after );
+
+    topography.refresh_slope_source( initial, 0.0 );
+    REQUIRE( topography.slope_source() == height_data );
+    REQUIRE_THROWS( topography.set_slope_source( height_data ) );
+}
+
+TEST_CASE( "deferred_lobe_application", "[deferred_lobes]" )
+{
+    Flowy::VectorX x_data      = xt::arange<double>( 0.0, 200.0, 1.0 );
+    Flowy::VectorX y_data      = xt::arange<double>( 0.0, 150.0, 1.0 );
+    Flowy::MatrixX height_data = xt::zeros<double>( { x_data.size(), y_data.size() } );
+
+    auto topography_eager    = Flowy::Topography( height_data, x_data, y_data );
+    auto topography_deferred = Flowy::Topography( height_data, x_data, y_data );
+    topography_deferred.set_deferred_lobe_application( true );
+    REQUIRE( topography_deferred.is_lobe_application_deferred() );
+
+    // Overlapping lobes across several tiles, with queries in between, which flush some of the tiles
+    auto gen = std::mt19937( 1 );
+    std::uniform_real_distribution<double> dist( 0.0, 1.0 );
+    for( int idx_lobe = 0; idx_lobe < 200; idx_lobe++ )
+    {
+        Flowy::Lobe lobe{};
+        lobe.center    = { 20.0 + 160.0 * dist( gen ), 20.0 + 110.0 * dist( gen ) };
+        lobe.semi_axes = { 2.0 + 8.0 * dist( gen ), 1.0 + 3.0 * dist( gen ) };
+        lobe.thickness = 0.1 + dist( gen );
+        lobe.set_azimuthal_angle( 6.0 * dist( gen ) );
+
+        topography_eager.add_lobe( lobe );
+        topography_deferred.add_lobe( lobe );
+
+        const Flowy::Vector2 query = { 10.0 + 180.0 * dist( gen ), 10.0 + 130.0 * dist( gen ) };
+        REQUIRE( topography_deferred.height_and_slope( query ) == topography_eager.height_and_slope( query ) );
+        REQUIRE( topography_deferred.get_height( lobe.center ) == topography_eager.get_height( lobe.center ) );
+    }
+    REQUIRE( topography_deferred.n_pending_lobe_cells() > 0 );
+
+    topography_deferred.flush_pending_lobes();
+    REQUIRE( topography_deferred.n_pending_lobe_cells() == 0 );
+    REQUIRE( topography_deferred.height_data == topography_eager.height_data );
+}
+
+TEST_CASE( "lobe_window", "[lobe_window]" )
+{
+    Flowy::VectorX x_data      = xt::arange<double>( 0.0, 200.0, 1.0 );
+    Flowy::VectorX y_data      = xt::arange<double>( 0.0, 150.0, 1.0 );
+    Flowy::MatrixX height_data = xt::zeros<double>( { x_data.size(), y_data.size() } );
+
+    const int n_lobes = 200;
+    auto pool         = Flowy::ThreadPool( 3 );
+
+    auto topography_eager    = Flowy::Topography( height_data, x_data, y_data );
+    auto topography_windowed = Flowy::Topography( height_data, x_data, y_data );
+    topography_eager.reset_intersection_cache( n_lobes );
+    topography_windowed.reset_intersection_cache( n_lobes );
+    topography_windowed.set_lobe_window( 8, &pool );
+
+    // Queries in the bounding box of a lobe in the window flush it, all other queries do not
+    auto gen = std::mt19937( 3 );
+    std::uniform_real_distribution<double> dist( 0.0, 1.0 );
+    int max_n_lobes_in_window = 0;
+    for( int idx_lobe = 0; idx_lobe < n_lobes; idx_lobe++ )
+    {
+        Flowy::Lobe lobe{};
+        lobe.center    = { 20.0 + 160.0 * dist( gen ), 20.0 + 110.0 * dist( gen ) };
+        lobe.semi_axes = { 2.0 + 8.0 * dist( gen ), 1.0 + 3.0 * dist( gen ) };
+        lobe.thickness = 0.1 + dist( gen );
+        lobe.set_azimuthal_angle( 6.0 * dist( gen ) );
+
+        topography_eager.add_lobe( lobe, idx_lobe );
+        topography_windowed.add_lobe( lobe, idx_lobe );
+        max_n_lobes_in_window = std::max( max_n_lobes_in_window, topography_windowed.n_lobes_in_window() );
+
+        const Flowy::Vector2 query = { 10.0 + 180.0 * dist( gen ), 10.0 + 130.0 * dist( gen ) };
+        REQUIRE( topography_windowed.height_and_slope( query ) == topography_eager.height_and_slope( query ) );
+    }
+    REQUIRE( max_n_lobes_in_window > 1 );
+    REQUIRE( max_n_lobes_in_window < 8 );
+
+    topography_windowed.flush_pending_lobes();
+    REQUIRE( topography_windowed.n_lobes_in_window() == 0 );
+    REQUIRE( topography_windowed.height_data == topography_eager.height_data );
+    REQUIRE( topography_windowed.intersection_cache_bytes() == topography_eager.intersection_cache_bytes() );
+}
+
+TEST_CASE( "row_blocks", "[row_blocks]" )
+{
+    Flowy::VectorX x_data      = xt::arange<double>( 0.0, 200.0, 1.0 );
+    Flowy::VectorX y_data      = xt::arange<double>( 0.0, 150.0, 1.0 );
+    Flowy::MatrixX height_data = xt::zeros<double>( { x_data.size(), y_data.size() } );
+
+    auto pool = Flowy::ThreadPool( 3 );
+
+    auto topography_serial = Flowy::Topography( height_data, x_data, y_data );
+    auto topography_blocks = Flowy::Topography( height_data, x_data, y_data );
+    topography_blocks.set_row_blocks( 50, &pool );
+
+    // Large and small lobes, and very narrow ones, in which the left and the right boundary cells of a row overlap
+    auto gen = std::mt19937( 4 );
+    std::uniform_real_distribution<double> dist( 0.0, 1.0 );
+    for( int idx_lobe = 0; idx_lobe < 100; idx_lobe++ )
+    {
+        Flowy::Lobe lobe{};
+        lobe.center    = { 50.0 + 100.0 * dist( gen ), 50.0 + 50.0 * dist( gen ) };
+        lobe.semi_axes = { 1.0 + 40.0 * dist( gen ), idx_lobe % 3 == 0 ? 0.3 : 1.0 + 20.0 * dist( gen ) };
+        lobe.thickness = 0.1 + dist( gen );
+        lobe.set_azimuthal_angle( 6.0 * dist( gen ) );
+
+        REQUIRE( topography_blocks.compute_intersection( lobe ) == topography_serial.compute_intersection( lobe ) );
+        topography_serial.add_lobe( lobe );
+        topography_blocks.add_lobe( lobe );
+    }
+    REQUIRE( topography_blocks.height_data == topography_serial.height_data );
+}
+
+TEST_CASE( "slope_level", "[slope_level]" )
+{
+    Flowy::VectorX x_data      = xt::arange<double>( 0.0, 200.0, 1.0 );
+    Flowy::VectorX y_data      = xt::arange<double>( 0.0, 150.0, 1.0 );
+    Flowy::MatrixX height_data = xt::zeros<double>( { x_data.size(), y_data.size() } );
+    for( std::size_t idx_x = 0; idx_x < x_data.size(); idx_x++ )
+    {
+        for( std::size_t idx_y = 0; idx_y < y_data.size(); idx_y++ )
+        {
+            height_data( idx_x, idx_y ) = 5.0 + 0.3 * ( x_data[idx_x] + 0.5 ) - 0.2 * ( y_data[idx_y] + 0.5 );
+        }
+    }
+
+    auto topography = Flowy::Topography( height_data, x_data, y_data );
+    REQUIRE_THROWS_AS( topography.set_slope_level( Flowy::Topography::max_slope_level + 1 ), std::runtime_error );
+
+    // The block means of a plane are the plane at the centers of the blocks, so every level reproduces it away from
+    // the edges (and the partial blocks at the upper edges)
+    const Flowy::Vector2 point = { 77.3, 61.9 };
+    for( int level = 1; level <= Flowy::Topography::max_slope_level; level++ )
+    {
+        topography.set_slope_level( level );
+        const std::size_t n_x_level = ( x_data.size() + ( 1 << level ) - 1 ) >> level;
+        REQUIRE( topography.pyramid_heights( level ).shape()[0] == n_x_level );
+
+        const auto [height, slope] = topography.height_and_slope( point );
+        REQUIRE_THAT( height, Catch::Matchers::WithinAbs( 5.0 + 0.3 * point[0] - 0.2 * point[1], 1e-10 ) );
+        REQUIRE_THAT( slope[0], Catch::Matchers::WithinAbs( -0.3, 1e-10 ) );
+        REQUIRE_THAT( slope[1], Catch::Matchers::WithinAbs( 0.2, 1e-10 ) );
+    }
+
+    topography.set_slope_level( 0 );
+    auto topography_plain = Flowy::Topography( height_data, x_data, y_data );
+    REQUIRE( topography.height_and_slope( point ) == topography_plain.height_and_slope( point ) );
+
+    // The lazily updated levels are the same as levels built from scratch, also if the lobes are deferred
+    const int level          = 3;
+    auto topography_eager    = Flowy::Topography( height_data, x_data, y_data );
+    auto topography_deferred = Flowy::Topography( height_data, x_data, y_data );
+    topography_eager.set_slope_level( level );
+    topography_deferred.set_slope_level( level );
+    topography_deferred.set_deferred_lobe_application( true );
+
+    auto gen = std::mt19937( 5 );
+    std::uniform_real_distribution<double> dist( 0.0, 1.0 );
+    for( int idx_lobe = 0; idx_lobe < 100; idx_lobe++ )
+    {
+        Flowy::Lobe lobe{};
+        lobe.center    = { 20.0 + 160.0 * dist( gen ), 20.0 + 110.0 * dist( gen ) };
+        lobe.semi_axes = { 2.0 + 8.0 * dist( gen ), 1.0 + 3.0 * dist( gen ) };
+        lobe.thickness = 0.1 + dist( gen );
+        lobe.set_azimuthal_angle( 6.0 * dist( gen ) );
+
+        topography_eager.add_lobe( lobe );
+        topography_deferred.add_lobe( lobe );
+
+        const Flowy::Vector2 query  = { 10.0 + 180.0 * dist( gen ), 10.0 + 130.0 * dist( gen ) };
+        const auto height_and_slope = topography_eager.height_and_slope( query );
+        REQUIRE( topography_deferred.height_and_slope( query ) == height_and_slope );
+
+        if( idx_lobe % 10 == 0 )
+        {
+            auto topography_rebuilt = Flowy::Topography( topography_eager.height_data, x_data, y_data );
+            topography_rebuilt.set_slope_level( level );
+            REQUIRE( topography_rebuilt.height_and_slope( query ) == height_and_slope );
+            REQUIRE( topography_rebuilt.pyramid_heights( level ) == topography_eager.pyramid_heights( level ) );
+        }
+    }
+}
+
+TEST_CASE( "thickness_accumulation", "[thickness_accumulation]" )
+{
+    Flowy::VectorX x_data      = xt::arange<double>( 0.0, 200.0, 1.0 );
+    Flowy::VectorX y_data      = xt::arange<double>( 0.0, 150.0, 1.0 );
+    Flowy::MatrixX height_data = xt::zeros<double>( { x_data.size(), y_data.size() } );
+
+    auto topography_eager       = Flowy::Topography( height_data, x_data, y_data );
+    auto topography_accumulated = Flowy::Topography( height_data, x_data, y_data );
+    topography_accumulated.enable_slope_source();
+    topography_accumulated.set_thickness_accumulation( true );
+    REQUIRE( topography_accumulated.is_thickness_accumulated() );
+
+    // Lobes of all sizes, some of which reach the upper x edge of the grid
+    auto gen = std::mt19937( 2 );
+    std::uniform_real_distribution<double> dist( 0.0, 1.0 );
+    const int n_lobes = 100;
+    for( int idx_lobe = 0; idx_lobe < n_lobes; idx_lobe++ )
+    {
+        Flowy::Lobe lobe{};
+        lobe.center    = { 40.0 + 159.0 * dist( gen ), 40.0 + 70.0 * dist( gen ) };
+        lobe.semi_axes = { 1.0 + 30.0 * dist( gen ), 0.5 + 10.0 * dist( gen ) };
+        lobe.thickness = 0.1 + dist( gen );
+        lobe.set_azimuthal_angle( 6.0 * dist( gen ) );
+        if( topography_eager.is_point_near_invalid( lobe.center, lobe.semi_axes[0] + 1.0 ) )
+        {
+            lobe.center[0] = 100.0;
+        }
+
+        topography_eager.add_lobe( lobe );
+        topography_accumulated.add_lobe( lobe );
+    }
+
+    // The slopes are not affected, but all touched tiles are marked for the refresh of the slope source
+    REQUIRE( topography_accumulated.slope_source() == height_data );
+    REQUIRE( topography_accumulated.n_dirty_slope_tiles() > 0 );
+
+    // Until the thickness is applied, only the boundary cells of the lobes are in height_data
+    REQUIRE( xt::sum( topography_accumulated.height_data )() < xt::sum( topography_eager.height_data )() );
+
+    // The enclosed cells differ by at most half a quantum per lobe, and cells without lobes stay exactly zero
+    topography_accumulated.apply_accumulated_thickness();
+    const double tolerance = 0.5 * n_lobes * Flowy::Topography::thickness_quantum;
+    for( std::size_t idx_x = 0; idx_x < x_data.size(); idx_x++ )
+    {
+        for( std::size_t idx_y = 0; idx_y < y_data.size(); idx_y++ )
+        {
+            const double height_expected = topography_eager.height_data( idx_x, idx_y );
+            REQUIRE_THAT(
+                topography_accumulated.height_data( idx_x, idx_y ),
+                Catch::Matchers::WithinAbs( height_expected, tolerance ) );
+            REQUIRE( ( height_expected != 0 || topography_accumulated.height_data( idx_x, idx_y ) == 0 ) );
+            REQUIRE( topography_accumulated.thickness_difference()( idx_x, idx_y ) == 0 );
+        }
+    }
+
+    // The refresh of the slope source sees all lobes
+    topography_accumulated.refresh_slope_source( height_data, 0.0 );
+    REQUIRE( topography_accumulated.slope_source() == topography_accumulated.height_data );
+}
+
+TEST_CASE( "inner_grid", "[inner_grid]" )
+{
+    // The outer grid is a plane with 4 m cells, the inner grid covers [40, 80] x [20, 60] with 1 m cells and adds bumps
+    auto plane = []( double x, double y ) { return 2.0 + 0.1 * x - 0.05 * y; };
+    auto bumps = [&]( double x, double y ) { return plane( x, y ) + 0.3 * std::sin( x / 3.0 ) * std::cos( y / 5.0 ); };
+
+    Flowy::VectorX x_data      = xt::arange<double>( 0.0, 400.0, 4.0 );
+    Flowy::VectorX y_data      = xt::arange<double>( 0.0, 320.0, 4.0 );
+    Flowy::MatrixX height_data = xt::zeros<double>( { x_data.size(), y_data.size() } );
+    for( std::size_t idx_x = 0; idx_x < x_data.size(); idx_x++ )
+    {
+        for( std::size_t idx_y = 0; idx_y < y_data.size(); idx_y++ )
+        {
+            height_data( idx_x, idx_y ) = plane( x_data[idx_x] + 2.0, y_data[idx_y] + 2.0 );
+        }
+    }
+
+    // The inner grid is built on a larger extent too, which serves as the reference for the lobes
+    auto make_grid = [&]( double x_min, double x_max, double y_min, double y_max, double cell_size )
+    {
+        Flowy::AscFile asc_file{};
+        asc_file.lower_left_corner = { x_min, y_min };
+        asc_file.cell_size         = cell_size;
+        asc_file.x_data            = xt::arange<double>( x_min, x_max, cell_size );
+        asc_file.y_data            = xt::arange<double>( y_min, y_max, cell_size );
+        asc_file.height_data       = xt::zeros<double>( { asc_file.x_data.size(), asc_file.y_data.size() } );
+        for( std::size_t idx_x = 0; idx_x < asc_file.x_data.size(); idx_x++ )
+        {
+            for( std::size_t idx_y = 0; idx_y < asc_file.y_data.size(); idx_y++ )
+            {
+                asc_file.height_data( idx_x, idx_y )
+                    = bumps( asc_file.x_data[idx_x] + 0.5 * cell_size, asc_file.y_data[idx_y] + 0.5 * cell_size );
+            }
+        }
+        return asc_file;
+    };
+
+    auto inner_asc                = make_grid( 40.0, 80.0, 20.0, 60.0, 1.0 );
+    inner_asc.height_data( 0, 0 ) = inner_asc.no_data_value;
+
+    auto topography = Flowy::Topography( height_data, x_data, y_data );
+    REQUIRE_THROWS_AS( topography.set_inner_grid( make_grid( 40.0, 80.0, 20.0, 60.0, 8.0 ) ), std::runtime_error );
+    REQUIRE_THROWS_AS( topography.set_inner_grid( make_grid( 380.0, 420.0, 20.0, 60.0, 1.0 ) ), std::runtime_error );
+    REQUIRE( !topography.has_inner_grid() );
+
+    topography.set_inner_grid( inner_asc );
+    REQUIRE( topography.has_inner_grid() );
+    auto & inner = topography.inner_grid();
+
+    // The no data cell gets the height of the outer grid
+    REQUIRE_THAT( inner.height_data( 0, 0 ), Catch::Matchers::WithinAbs( plane( 40.5, 20.5 ), 1e-12 ) );
+
+    // Deep inside the inner grid and outside of it, one of the grids is used alone
+    auto topography_plain = Flowy::Topography( height_data, x_data, y_data );
+    REQUIRE( topography.height_and_slope( { 60.3, 40.3 } ) == inner.height_and_slope( { 60.3, 40.3 } ) );
+    REQUIRE( topography.height_and_slope( { 30.3, 40.3 } ) == topography_plain.height_and_slope( { 30.3, 40.3 } ) );
+
+    // The band at the left edge starts one inner cell into the inner grid and is two outer cells wide. The heights are
+    // continuous at its edges, and within it the slope is the negative gradient of the blended heights. Along x, the
+    // blended heights are quadratic within a cell, so the central differences are exact
+    auto height_at = [&]( double x ) { return topography.height_and_slope( { x, 40.3 } ).first; };
+    for( double x_edge : { 41.0, 49.0 } )
+    {
+        REQUIRE_THAT( height_at( x_edge - 1e-9 ), Catch::Matchers::WithinAbs( height_at( x_edge + 1e-9 ), 1e-8 ) );
+    }
+
+    const double eps = 1e-4;
+    for( double x = 39.37; x < 52.0; x += 0.6 )
+    {
+        const double gradient_x = ( height_at( x + eps ) - height_at( x - eps ) ) / ( 2 * eps );
+        REQUIRE_THAT(
+            topography.height_and_slope( { x, 40.3 } ).second[0], Catch::Matchers::WithinAbs( -gradient_x, 1e-6 ) );
+    }
+
+    // The lobes are added to both grids. Lobes inside of the inner grid give the same thickness as on a larger grid
+    // with the same cells
+    const Flowy::MatrixX inner_initial     = inner.height_data;
+    auto reference                         = Flowy::Topography( make_grid( 30.0, 90.0, 10.0, 70.0, 1.0 ) );
+    const Flowy::MatrixX reference_initial = reference.height_data;
+    auto gen                               = std::mt19937( 3 );
+    std::uniform_real_distribution<double> dist( 0.0, 1.0 );
+    for( int idx_lobe = 0; idx_lobe < 50; idx_lobe++ )
+    {
+        Flowy::Lobe lobe{};
+        lobe.center    = { 48.0 + 24.0 * dist( gen ), 28.0 + 24.0 * dist( gen ) };
+        lobe.semi_axes = { 1.0 + 6.0 * dist( gen ), 0.5 + 3.0 * dist( gen ) };
+        lobe.thickness = 0.1 + dist( gen );
+        lobe.set_azimuthal_angle( 6.0 * dist( gen ) );
+
+        topography.add_lobe( lobe );
+        topography_plain.add_lobe( lobe );
+        reference.add_lobe( lobe );
+    }
+
+    auto inner_thickness = [&]() { return Flowy::MatrixX( inner.height_data - inner_initial ); };
+    auto thickness       = inner_thickness();
+    for( int idx_x = 0; idx_x < 40; idx_x++ )
+    {
+        for( int idx_y = 0; idx_y < 40; idx_y++ )
+        {
+            const double thickness_reference
+                = reference.height_data( idx_x + 10, idx_y + 10 ) - reference_initial( idx_x + 10, idx_y + 10 );
+            REQUIRE_THAT( thickness( idx_x, idx_y ), Catch::Matchers::WithinAbs( thickness_reference, 1e-12 ) );
+        }
+    }
+
+    // A lobe across the left edge is clipped, and half of its volume is added to the inner grid
+    Flowy::Lobe lobe_edge{};
+    lobe_edge.center    = { 40.0, 40.3 };
+    lobe_edge.semi_axes = { 6.0, 3.0 };
+    lobe_edge.thickness = 1.0;
+    topography.add_lobe( lobe_edge );
+    topography_plain.add_lobe( lobe_edge );
+
+    const double volume_inside = xt::sum( inner_thickness() - thickness )();
+    REQUIRE_THAT( volume_inside, Catch::Matchers::WithinRel( 0.5 * Flowy::Math::pi * 6.0 * 3.0, 0.01 ) );
+
+    // A lobe far away from the inner grid only changes the outer grid
+    Flowy::Lobe lobe_far{};
+    lobe_far.center    = { 200.0, 200.0 };
+    lobe_far.semi_axes = { 10.0, 5.0 };
+    lobe_far.thickness = 1.0;
+    thickness          = inner_thickness();
+    topography.add_lobe( lobe_far );
+    topography_plain.add_lobe( lobe_far );
+    REQUIRE( inner_thickness() == thickness );
+
+    REQUIRE( topography.height_data == topography_plain.height_data );
+
+    // Both grids together stay within the budget of the intersection cache
+    const std::size_t max_bytes = 2000;
+    topography.reset_intersection_cache( 10, max_bytes );
+    for( int idx_lobe = 0; idx_lobe < 10; idx_lobe++ )
+    {
+        Flowy::Lobe lobe{};
+        lobe.center    = { 50.0 + 2.0 * idx_lobe, 40.0 };
+        lobe.semi_axes = { 6.0, 3.0 };
+        topography.add_lobe( lobe, idx_lobe );
+    }
+    REQUIRE( topography.intersection_cache_bytes() + inner.intersection_cache_bytes() <= max_bytes );
+    REQUIRE( inner.intersection_cache_n_dropped() > 0 );
+}
@@ -0,0 +1,53 @@
+#include "trace.hpp"
+#include <catch2/catch_test_macros.hpp>
+#include <filesystem>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <thread>
+
+TEST_CASE( "trace_spans", "[trace]" )
+{
+    namespace fs = std::filesystem;
+    using namespace Flowy;
+
+    // Spans recorded before tracing is enabled are not recorded
+    {
+        Trace::Span span( "before_enable" );
+    }
+
+    Trace::enable( 4 );
+
+    {
+        Trace::Span span( "outer", "test", "idx", 42 );
+        Trace::Span inner( "inner" );
+    }
+
+    auto worker = std::thread(
+        []()
+        {
+            // The ring buffer of this thread only has room for four events, the rest are dropped
+            for( int i = 0; i < 6; i++ )
+            {
+                Trace::Span span( "worker_span" );
+            }
+        } );
+    worker.join();
+
+    auto path = fs::temp_directory_path() / "flowy_test_trace.json";
+    Trace::flush( path );
+
+    std::ifstream file( path );
+    std::stringstream buffer;
+    buffer << file.rdbuf();
+    const std::string json = buffer.str();
+
+    REQUIRE( json.find( "before_enable" ) == std::string::npos );
+    REQUIRE( json.find( "\"name\":\"outer\",\"cat\":\"test\"" ) != std::string::npos );
+    REQUIRE( json.find( "\"args\":{\"idx\":42}" ) != std::string::npos );
+    REQUIRE( json.find( "\"name\":\"inner\"" ) != std::string::npos );
+    REQUIRE( json.find( "\"dropped_events\"" ) != std::string::npos );
+    REQUIRE( json.find( "\"count\":2" ) != std::string::npos );
+
+    fs::remove( path );
+}
@@ -0,0 +1,46 @@
+#include "definitions.hpp"
+#include "vec2.hpp"
+#include <catch2/catch_test_macros.hpp>
+#include <catch2/matchers/catch_matchers_floating_point.hpp>
+#include <type_traits>
+
+TEST_CASE( "vec2_arithmetic", "[vec2]" )
+{
+    using namespace Flowy;
+
+    static_assert( std::is_trivially_copyable_v<Vector2> );
+
+    // The arithmetic can be evaluated at compile time
+    constexpr Vec2 a = { 1.0, -2.0 };
+    constexpr Vec2 b = { 0.5, 4.0 };
+    static_assert( a + b == Vec2( 1.5, 2.0 ) );
+    static_assert( a - b == Vec2( 0.5, -6.0 ) );
+    static_assert( 2.0 * a == a * 2.0 );
+    static_assert( -a == Vec2( -1.0, 2.0 ) );
+    static_assert( b / 0.5 == Vec2( 1.0, 8.0 ) );
+    static_assert( dot( a, b ) == -7.5 );
+
+    Vec2 c = a;
+    c += b;
+    c *= 2.0;
+    c -= a;
+    c /= 4.0;
+    REQUIRE( c == Vec2( 0.5, 1.5 ) );
+    REQUIRE( c != a );
+
+    REQUIRE_THAT( norm( Vec2( 3.0, -4.0 ) ), Catch::Matchers::WithinRel( 5.0, 1e-15 ) );
+}
+
+TEST_CASE( "vec2_xtensor_conversion", "[vec2]" )
+{
+    using namespace Flowy;
+
+    const Vector2 v = { 3.5, -1.25 };
+
+    auto v_xt = to_xtensor( v );
+    REQUIRE( v_xt( 0 ) == v[0] );
+    REQUIRE( v_xt( 1 ) == v[1] );
+
+    // Works with xtensor expressions, too
+    REQUIRE( to_vector2( 2.0 * v_xt ) == 2.0 * v );
+}
@@ -0,0 +1,180 @@
+#include "config.hpp"
+#include "definitions.hpp"
+#include "sampling.hpp"
+#include "vent_sampler.hpp"
+#include <catch2/catch_test_macros.hpp>
+#include <catch2/matchers/catch_matchers_floating_point.hpp>
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+#include <vector>
+
+namespace
+{
+
+// Distance of the point p to the segment [a, b]
+double distance_to_segment( const Flowy::Vector2 & p, const Flowy::Vector2 & a, const Flowy::Vector2 & b )
+{
+    const Flowy::Vector2 ab = b - a;
+    const Flowy::Vector2 ap = p - a;
+
+    const double t  = std::clamp( ( ap[0] * ab[0] + ap[1] * ab[1] ) / ( ab[0] * ab[0] + ab[1] * ab[1] ), 0.0, 1.0 );
+    const double dx = ap[0] - t * ab[0];
+    const double dy = ap[1] - t * ab[1];
+    return std::sqrt( dx * dx + dy * dy );
+}
+
+} // namespace
+
+TEST_CASE( "alias_table", "[vent_sampler]" )
+{
+    using namespace Flowy;
+
+    const std::vector<double> weights = { 1.0, 0.0, 3.0, 6.0 };
+    auto alias_table                  = AliasTable( weights );
+    auto gen                          = RandomStream( 0 );
+
+    const int n_samples = 200000;
+    std::vector<int> counts( weights.size(), 0 );
+    for( int i = 0; i < n_samples; i++ )
+    {
+        counts[alias_table.sample( gen )]++;
+    }
+
+    REQUIRE( counts[1] == 0 );
+    for( std::size_t i = 0; i < weights.size(); i++ )
+    {
+        REQUIRE_THAT( double( counts[i] ) / n_samples, Catch::Matchers::WithinAbs( weights[i] / 10.0, 0.005 ) );
+    }
+
+    REQUIRE_THROWS_AS( AliasTable( { 0.0, 0.0 } ), std::runtime_error );
+    REQUIRE_THROWS_AS( AliasTable( { 1.0, -1.0 } ), std::runtime_error );
+}
+
+TEST_CASE( "vent_sampler_vents", "[vent_sampler]" )
+{
+    using namespace Flowy;
+
+    auto input             = Config::InputParams();
+    input.vent_coordinates = { { 0, 0 }, { 10, 0 }, { 10, 10 } };
+    input.n_flows          = 6;
+    auto gen               = RandomStream( 0 );
+
+    // vent_flag = 0: the flows go through the vents in order
+    input.vent_flag   = 0;
+    auto vent_sampler = VentSampler( input );
+    for( int idx_flow = 0; idx_flow < input.n_flows; idx_flow++ )
+    {
+        REQUIRE( vent_sampler.sample( idx_flow, gen ) == input.vent_coordinates[idx_flow / 2] );
+    }
+
+    // vent_flag = 8: a vent with zero probability is never drawn
+    input.vent_flag             = 8;
+    input.fissure_probabilities = { 1.0, 0.0, 1.0 };
+    vent_sampler                = VentSampler( input );
+    for( int i = 0; i < 1000; i++ )
+    {
+        REQUIRE( vent_sampler.sample( 0, gen ) != input.vent_coordinates[1] );
+    }
+
+    // The number of probabilities has to match the number of vents
+    input.fissure_probabilities = { 1.0, 1.0 };
+    REQUIRE_THROWS_AS( VentSampler( input ), std::runtime_error );
+}
+
+TEST_CASE( "vent_sampler_polyline", "[vent_sampler]" )
+{
+    using namespace Flowy;
+
+    auto input             = Config::InputParams();
+    input.vent_coordinates = { { 0, 0 }, { 30, 0 }, { 30, 10 } };
+    input.vent_flag        = 2;
+
+    auto vent_sampler = VentSampler( input );
+    auto gen          = RandomStream( 1 );
+    auto gen_ref      = RandomStream( 1 );
+
+    // Reference implementation of vent_flag = 2, which draws the same points from the same random numbers
+    const std::vector<double> cumulative_length = { 0.0, 0.75, 1.0 };
+
+    int n_first_segment = 0;
+    const int n_samples = 100000;
+    for( int i = 0; i < n_samples; i++ )
+    {
+        const Vector2 point = vent_sampler.sample( 0, gen );
+
+        const double cum_dist = gen_ref.uniform();
+        auto it               = std::lower_bound( cumulative_length.begin(), cumulative_length.end(), cum_dist );
+        const int idx         = it - cumulative_length.begin();
+        const double alpha
+            = ( cum_dist - cumulative_length[idx - 1] ) / ( cumulative_length[idx] - cumulative_length[idx - 1] );
+        const Vector2 point_ref
+            = alpha * input.vent_coordinates[idx] + ( 1.0 - alpha ) * input.vent_coordinates[idx - 1];
+
+        REQUIRE_THAT( point[0], Catch::Matchers::WithinAbs( point_ref[0], 1e-12 ) );
+        REQUIRE_THAT( point[1], Catch::Matchers::WithinAbs( point_ref[1], 1e-12 ) );
+
+        n_first_segment += point[1] == 0.0 && point[0] < 30.0;
+    }
+
+    // The first segment has 3/4 of the length of the polyline
+    REQUIRE_THAT( double( n_first_segment ) / n_samples, Catch::Matchers::WithinAbs( 0.75, 0.01 ) );
+
+    // vent_flag = 3: every segment has the same probability
+    input.vent_flag = 3;
+    vent_sampler    = VentSampler( input );
+    n_first_segment = 0;
+    for( int i = 0; i < n_samples; i++ )
+    {
+        const Vector2 point = vent_sampler.sample( 0, gen );
+        n_first_segment += point[1] == 0.0 && point[0] < 30.0;
+    }
+    REQUIRE_THAT( double( n_first_segment ) / n_samples, Catch::Matchers::WithinAbs( 0.5, 0.01 ) );
+
+    // vent_flag = 6: the probabilities of the segments are prescribed
+    input.vent_flag             = 6;
+    input.fissure_probabilities = { 0.0, 1.0 };
+    vent_sampler                = VentSampler( input );
+    for( int i = 0; i < 1000; i++ )
+    {
+        REQUIRE_THAT( vent_sampler.sample( 0, gen )[0], Catch::Matchers::WithinAbs( 30.0, 1e-12 ) );
+    }
+}
+
+TEST_CASE( "vent_sampler_fissures", "[vent_sampler]" )
+{
+    using namespace Flowy;
+
+    auto input                 = Config::InputParams();
+    input.vent_coordinates     = { { 0, 0 }, { 100, 100 } };
+    input.vent_end_coordinates = { { 10, 0 }, { 100, 130 } };
+
+    auto gen = RandomStream( 2 );
+
+    for( int vent_flag : { 4, 5, 7 } )
+    {
+        input.vent_flag             = vent_flag;
+        input.fissure_probabilities = { 1.0, 2.0 };
+        auto vent_sampler           = VentSampler( input );
+
+        int n_first_fissure = 0;
+        const int n_samples = 100000;
+        for( int i = 0; i < n_samples; i++ )
+        {
+            const Vector2 point = vent_sampler.sample( 0, gen );
+
+            const double d0 = distance_to_segment( point, input.vent_coordinates[0], input.vent_end_coordinates[0] );
+            const double d1 = distance_to_segment( point, input.vent_coordinates[1], input.vent_end_coordinates[1] );
+            REQUIRE( std::min( d0, d1 ) < 1e-10 );
+            n_first_fissure += d0 < 1e-10;
+        }
+
+        // The fissures have lengths 10 and 30
+        const double expected = vent_flag == 4 ? 0.25 : ( vent_flag == 5 ? 0.5 : 1.0 / 3.0 );
+        REQUIRE_THAT( double( n_first_fissure ) / n_samples, Catch::Matchers::WithinAbs( expected, 0.01 ) );
+    }
+
+    // Every fissure needs an end point
+    input.vent_end_coordinates = { { 10, 0 } };
+    REQUIRE_THROWS_AS( VentSampler( input ), std::runtime_error );
+}